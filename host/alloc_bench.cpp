@@ -0,0 +1,158 @@
+/*
+ * Runs the scale's screen through a long simulated uptime on LVGL's heap
+ * (src/lv_alloc.c) and reports peak use, fragmentation, slab occupancy and
+ * how often the pool fell back to the system heap. Also times single
+ * allocations against the system malloc.
+ *
+ *   alloc_bench [updates]
+ *
+ * Exit status is non-zero if an allocation failed or fell back, or if the
+ * pool ends up more fragmented than after the first hour.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include "Arduino.h"
+#include "lvgl.h"
+#include "lv_alloc.h"
+#include "lv_numeric.h"
+#include "lv_shotchart.h"
+#include "display.h"
+
+void my_print(const char *buf)
+{
+    fputs(buf, stdout);
+}
+
+static lv_color_t *buf;
+static lv_disp_draw_buf_t draw_buf;
+static lv_disp_drv_t disp_drv;
+
+static void null_flush(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t *color_p)
+{
+    LV_UNUSED(area);
+    LV_UNUSED(color_p);
+    lv_disp_flush_ready(drv);
+}
+
+static void print_stats(const char *label)
+{
+    lv_alloc_stats_t s;
+    lv_alloc_get_stats(&s);
+    printf("%-6s used=%u peak=%u of %u, biggest free=%u, frag=%u%%, fallbacks=%u, failures=%u\n", label, s.used,
+           s.peak, s.pool_size, s.free_biggest, s.frag_pct, s.fallbacks, s.failures);
+    printf("       slabs");
+    for (int c = 0; c < LV_ALLOC_SLAB_CLASSES; c++)
+        printf(" %u/%u(peak %u)", s.slab_used[c], s.slab_total[c], s.slab_peak[c]);
+    printf("\n");
+}
+
+// Worst and average time of alloc+free pairs with the sizes LVGL asks for
+template <typename A, typename F>
+static void time_allocs(const char *label, A alloc, F release)
+{
+    static const size_t sizes[] = {8, 12, 24, 40, 7, 60, 100, 200, 16, 500, 32, 1200};
+    static void *live[64];
+    double worst = 0, total = 0;
+    int n = 0;
+    for (int round = 0; round < 2000; round++)
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            auto t0 = std::chrono::steady_clock::now();
+            if (live[i])
+                release(live[i]);
+            live[i] = alloc(sizes[(i * 7 + round) % 12]);
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+            worst = ns > worst ? ns : worst;
+            total += ns;
+            n++;
+        }
+    }
+    for (int i = 0; i < 64; i++)
+    {
+        release(live[i]);
+        live[i] = NULL;
+    }
+    printf("%-6s %.0f ns average, %.0f ns worst per free+alloc\n", label, total / n, worst);
+}
+
+int main(int argc, char **argv)
+{
+    // A week of 10 Hz weight updates is ~6M; the default keeps the run short
+    long updates = (argc > 1) ? atol(argv[1]) : 360000;
+
+    lv_alloc_init();
+    lv_init();
+    buf = (lv_color_t *)malloc(DISPLAY_HOR_RES * DISPLAY_VER_RES * sizeof(lv_color_t));
+    lv_disp_draw_buf_init(&draw_buf, buf, NULL, DISPLAY_HOR_RES * DISPLAY_VER_RES);
+    lv_disp_drv_init(&disp_drv);
+    disp_drv.hor_res = DISPLAY_HOR_RES;
+    disp_drv.ver_res = DISPLAY_VER_RES;
+    disp_drv.flush_cb = null_flush;
+    disp_drv.draw_buf = &draw_buf;
+    disp_drv.direct_mode = 1;
+    lv_disp_drv_register(&disp_drv);
+
+    // The screen main.cpp builds
+    lv_obj_t *scr = lv_scr_act();
+    lv_obj_set_style_bg_color(scr, lv_color_black(), LV_PART_MAIN);
+    lv_obj_t *weight = lv_numeric_create(scr);
+    lv_numeric_set_align(weight, LV_TEXT_ALIGN_RIGHT);
+    lv_numeric_set_font(weight, &lv_font_montserrat_48, "0123456789.- g", 8);
+    lv_obj_align(weight, LV_ALIGN_RIGHT_MID, -10, 0);
+    lv_obj_t *timer = lv_numeric_create(scr);
+    lv_numeric_set_align(timer, LV_TEXT_ALIGN_LEFT);
+    lv_numeric_set_font(timer, &lv_font_montserrat_48, "0123456789 s", 6);
+    lv_obj_align(timer, LV_ALIGN_LEFT_MID, 10, 0);
+    lv_obj_t *chart = lv_shotchart_create(scr);
+    lv_obj_set_size(chart, DISPLAY_HOR_RES - 20, 30);
+    lv_obj_align(chart, LV_ALIGN_BOTTOM_MID, 0, -4);
+    lv_shotchart_set_series_count(chart, 2);
+    lv_refr_now(NULL);
+    print_stats("start");
+
+    uint8_t hour_frag = 0;
+    char text[16];
+    for (long i = 0; i < updates; i++)
+    {
+        snprintf(text, sizeof(text), "%.1f g", (i % 4000) / 10.0f);
+        lv_numeric_set_text(weight, text);
+        snprintf(text, sizeof(text), "%ld s", (i / 10) % 60);
+        lv_numeric_set_text(timer, text);
+        int16_t values[2] = {(int16_t)(i % 400), (int16_t)(i % 30)};
+        lv_shotchart_append(chart, values);
+        if (i % 600 == 0)
+            lv_shotchart_clear(chart);
+
+        // Now and then a message label comes and goes, like the low battery one
+        if (i % 997 == 0)
+        {
+            lv_obj_t *msg = lv_label_create(scr);
+            lv_label_set_text_fmt(msg, "Message %ld", i);
+            lv_obj_align(msg, LV_ALIGN_TOP_MID, 0, 0);
+            lv_refr_now(NULL);
+            lv_obj_del(msg);
+        }
+        if (i % 10 == 0)
+            lv_refr_now(NULL);
+        if (i == 36000)
+        {
+            lv_alloc_stats_t s;
+            lv_alloc_get_stats(&s);
+            hour_frag = s.frag_pct;
+            print_stats("1h");
+        }
+    }
+    lv_refr_now(NULL);
+    printf("%ld updates (%.1f h at 10 Hz)\n", updates, updates / 36000.0);
+    print_stats("end");
+
+    time_allocs("lvgl", lv_mem_alloc, lv_mem_free);
+    time_allocs("system", malloc, free);
+
+    lv_alloc_stats_t s;
+    lv_alloc_get_stats(&s);
+    free(buf);
+    return (s.failures || s.fallbacks || s.frag_pct > hour_frag) ? 1 : 0;
+}
@@ -0,0 +1,361 @@
+/*
+ * Checks the lv_draw_es blend kernels against LVGL's lv_draw_sw_blend_basic()
+ * on random buffers, areas, opacities and masks, then measures both on
+ * full-width and glyph-sized areas and prints megapixels per second. Then
+ * does the same for lv_draw_es_letter() against lv_draw_sw_letter() with the
+ * scale's texts.
+ *
+ *   draw_bench [rounds]
+ *
+ * Exit status is non-zero if any blended pixel differs from the stock one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "Arduino.h"
+#include "lvgl.h"
+#include "lv_draw_es.h"
+#include "display.h"
+
+void my_print(const char *buf)
+{
+    fputs(buf, stdout);
+}
+
+typedef void (*blend_cb_t)(lv_draw_ctx_t *draw_ctx, const lv_draw_sw_blend_dsc_t *dsc);
+
+static const int W = DISPLAY_HOR_RES;
+static const int H = DISPLAY_VER_RES;
+
+static lv_disp_draw_buf_t draw_buf;
+static lv_disp_drv_t disp_drv;
+static lv_color_t *fb;
+static lv_color_t *ref;
+static lv_color_t *start;
+static lv_color_t *src;
+static lv_opa_t *mask;
+
+static lv_draw_sw_ctx_t ctx;
+static lv_draw_es_ctx_t es_ctx;
+static lv_area_t buf_area = {0, 0, W - 1, H - 1};
+static lv_area_t clip_area;
+
+static uint32_t rng = 1;
+
+static uint32_t rnd(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static void null_flush(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t *color_p)
+{
+    LV_UNUSED(area);
+    LV_UNUSED(color_p);
+    lv_disp_flush_ready(drv);
+}
+
+// Any mix of 0, 255 and partial values, to catch every branch
+static void random_mask(int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        uint32_t r = rnd() % 8;
+        mask[i] = r < 3 ? LV_OPA_TRANSP : r < 6 ? LV_OPA_COVER : (lv_opa_t)rnd();
+    }
+}
+
+// Anti-aliased strokes like a glyph: runs of 0 and 255 with partial values at the edges
+static void glyph_mask(int n)
+{
+    int i = 0;
+    while (i < n)
+    {
+        int gap = 2 + rnd() % 12;
+        int stroke = 3 + rnd() % 8;
+        for (int j = 0; j < gap && i < n; j++)
+            mask[i++] = LV_OPA_TRANSP;
+        if (i < n)
+            mask[i++] = (lv_opa_t)rnd();
+        for (int j = 0; j < stroke && i < n; j++)
+            mask[i++] = LV_OPA_COVER;
+        if (i < n)
+            mask[i++] = (lv_opa_t)rnd();
+    }
+}
+
+static void blend(blend_cb_t cb, lv_color_t *dest, const lv_draw_sw_blend_dsc_t *dsc)
+{
+    ctx.base_draw.buf = dest;
+    cb(&ctx.base_draw, dsc);
+}
+
+enum kind_t
+{
+    FILL,
+    FILL_MASK,
+    MAP,
+    MAP_MASK,
+    KIND_COUNT
+};
+
+static const char *kind_names[KIND_COUNT] = {"fill", "fill+mask", "map", "map+mask"};
+
+static void make_dsc(kind_t kind, const lv_area_t *area, lv_opa_t opa, lv_draw_sw_blend_dsc_t *dsc)
+{
+    memset(dsc, 0, sizeof(*dsc));
+    dsc->blend_area = area;
+    dsc->opa = opa;
+    dsc->blend_mode = LV_BLEND_MODE_NORMAL;
+    dsc->color.full = (uint16_t)rnd();
+    if (kind == MAP || kind == MAP_MASK)
+        dsc->src_buf = src;
+    if (kind == FILL_MASK || kind == MAP_MASK)
+    {
+        dsc->mask_buf = mask;
+        dsc->mask_area = area;
+        dsc->mask_res = LV_DRAW_MASK_RES_CHANGED;
+    }
+}
+
+static uint32_t check(int rounds)
+{
+    uint32_t mismatches = 0;
+    uint32_t cases = 0;
+    for (int i = 0; i < rounds; i++)
+    {
+        kind_t kind = (kind_t)(i % KIND_COUNT);
+        // Every opacity, odd and even offsets and widths, areas sticking out of the clip area
+        lv_opa_t opa = (lv_opa_t)(i / KIND_COUNT);
+        lv_area_t area;
+        area.x1 = (lv_coord_t)(rnd() % (W + 20)) - 10;
+        area.y1 = (lv_coord_t)(rnd() % (H + 20)) - 10;
+        area.x2 = area.x1 + (lv_coord_t)(rnd() % 120);
+        area.y2 = area.y1 + (lv_coord_t)(rnd() % 40);
+        clip_area.x1 = (lv_coord_t)(rnd() % 8);
+        clip_area.y1 = (lv_coord_t)(rnd() % 8);
+        clip_area.x2 = W - 1 - (lv_coord_t)(rnd() % 8);
+        clip_area.y2 = H - 1 - (lv_coord_t)(rnd() % 8);
+        if (!_lv_area_intersect(&area, &area, &buf_area))
+            continue;
+
+        lv_draw_sw_blend_dsc_t dsc;
+        make_dsc(kind, &area, opa, &dsc);
+        int n = lv_area_get_size(&area);
+        for (int p = 0; p < n; p++)
+            src[p].full = (uint16_t)rnd();
+        random_mask(n);
+        if (kind == FILL_MASK && rnd() % 4 == 0)
+            dsc.mask_res = LV_DRAW_MASK_RES_FULL_COVER;
+
+        memcpy(ref, start, W * H * sizeof(lv_color_t));
+        memcpy(fb, start, W * H * sizeof(lv_color_t));
+        blend(lv_draw_sw_blend_basic, ref, &dsc);
+        blend(lv_draw_es_blend, fb, &dsc);
+        cases++;
+
+        for (int p = 0; p < W * H; p++)
+        {
+            if (fb[p].full != ref[p].full)
+            {
+                if (mismatches < 8)
+                {
+                    printf("mismatch %s opa %u at (%d,%d): got %04x expected %04x\n", kind_names[kind], opa,
+                           p % W, p / W, fb[p].full, ref[p].full);
+                }
+                mismatches++;
+            }
+        }
+    }
+    printf("exact: %s (%u cases, %u mismatching pixels)\n", mismatches ? "FAIL" : "ok", cases, mismatches);
+    return mismatches;
+}
+
+static double mpps(blend_cb_t cb, kind_t kind, const lv_area_t *area, lv_opa_t opa, int iterations)
+{
+    lv_draw_sw_blend_dsc_t dsc;
+    make_dsc(kind, area, opa, &dsc);
+    rng = 1;
+    glyph_mask(lv_area_get_size(area));
+    memcpy(fb, start, W * H * sizeof(lv_color_t));
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        dsc.color.full = (uint16_t)i; // Keeps the stock fill's last color cache honest
+        blend(cb, fb, &dsc);
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return (double)lv_area_get_size(area) * iterations / s / 1e6;
+}
+
+static void bench(const char *name, kind_t kind, lv_opa_t opa)
+{
+    // The whole screen, and a weight digit placed on an odd column
+    lv_area_t full = {0, 0, W - 1, H - 1};
+    lv_area_t digit = {401, 39, 434, 86};
+    clip_area = full;
+    double stock_full = mpps(lv_draw_sw_blend_basic, kind, &full, opa, 400);
+    double es_full = mpps(lv_draw_es_blend, kind, &full, opa, 400);
+    double stock_digit = mpps(lv_draw_sw_blend_basic, kind, &digit, opa, 40000);
+    double es_digit = mpps(lv_draw_es_blend, kind, &digit, opa, 40000);
+    printf("%-16s screen %7.1f -> %7.1f MP/s (x%.2f)   digit %7.1f -> %7.1f MP/s (x%.2f)\n", name, stock_full,
+           es_full, es_full / stock_full, stock_digit, es_digit, es_digit / stock_digit);
+}
+
+// What the readouts show, over the whole width of the screen
+static const char *texts[] = {"18.3 g", "-0.1 g", "36.0 g", "27 s", "0 s", "Low battery"};
+static const lv_font_t *fonts[] = {&lv_font_montserrat_48, &lv_font_montserrat_28, &lv_font_montserrat_14};
+
+typedef void (*letter_cb_t)(lv_draw_ctx_t *draw_ctx, const lv_draw_label_dsc_t *dsc, const lv_point_t *pos_p,
+                            uint32_t letter);
+
+static uint32_t draw_text(lv_draw_ctx_t *draw_ctx, letter_cb_t cb, lv_color_t *dest, const lv_draw_label_dsc_t *dsc,
+                          lv_coord_t x, lv_coord_t y, const char *text)
+{
+    draw_ctx->buf = dest;
+    uint32_t letters = 0;
+    for (size_t i = 0; text[i]; i++)
+    {
+        lv_point_t pos = {x, y};
+        cb(draw_ctx, dsc, &pos, (uint8_t)text[i]);
+        x += lv_font_get_glyph_width(dsc->font, (uint8_t)text[i], (uint8_t)text[i + 1]);
+        letters++;
+    }
+    return letters;
+}
+
+static uint32_t check_text(int rounds)
+{
+    lv_draw_ctx_t *sw = &ctx.base_draw;
+    lv_draw_ctx_t *es = &es_ctx.base_sw.base_draw;
+    uint32_t mismatches = 0;
+    for (int i = 0; i < rounds; i++)
+    {
+        // Plain and busy backgrounds, clipped at any side, every opacity
+        lv_draw_label_dsc_t dsc;
+        lv_draw_label_dsc_init(&dsc);
+        dsc.font = fonts[i % 3];
+        dsc.color.full = (uint16_t)rnd();
+        dsc.opa = (i & 1) ? LV_OPA_COVER : (lv_opa_t)rnd();
+        const char *text = texts[rnd() % 6];
+        lv_coord_t x = (lv_coord_t)(rnd() % (W + 40)) - 40;
+        lv_coord_t y = (lv_coord_t)(rnd() % (H + 40)) - 40;
+        clip_area.x1 = (lv_coord_t)(rnd() % 64);
+        clip_area.y1 = (lv_coord_t)(rnd() % 32);
+        clip_area.x2 = W - 1 - (lv_coord_t)(rnd() % 64);
+        clip_area.y2 = H - 1 - (lv_coord_t)(rnd() % 32);
+
+        lv_color_t bg;
+        bg.full = (uint16_t)rnd();
+        for (int p = 0; p < W * H; p++)
+            start[p] = (i & 2) ? bg : src[p];
+        memcpy(ref, start, W * H * sizeof(lv_color_t));
+        memcpy(fb, start, W * H * sizeof(lv_color_t));
+        draw_text(sw, lv_draw_sw_letter, ref, &dsc, x, y, text);
+        draw_text(es, lv_draw_es_letter, fb, &dsc, x, y, text);
+
+        for (int p = 0; p < W * H; p++)
+        {
+            if (fb[p].full != ref[p].full)
+            {
+                if (mismatches < 8)
+                {
+                    printf("mismatch \"%s\" at (%d,%d): got %04x expected %04x\n", text, p % W, p / W, fb[p].full,
+                           ref[p].full);
+                }
+                mismatches++;
+            }
+        }
+    }
+    printf("text exact: %s (%d strings, %u mismatching pixels)\n", mismatches ? "FAIL" : "ok", rounds, mismatches);
+    return mismatches;
+}
+
+// Letters per second for a screen of readouts on the black background
+static double letters_per_s(lv_draw_ctx_t *draw_ctx, letter_cb_t cb, const lv_font_t *font, int iterations)
+{
+    lv_draw_label_dsc_t dsc;
+    lv_draw_label_dsc_init(&dsc);
+    dsc.font = font;
+    dsc.color = lv_color_white();
+    clip_area = buf_area;
+    lv_coord_t line_h = lv_font_get_line_height(font);
+
+    uint32_t letters = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        lv_memset_00(fb, W * H * sizeof(lv_color_t));
+        for (lv_coord_t y = 0; y + line_h <= H; y += line_h)
+        {
+            for (lv_coord_t x = 0; x < W - 100; x += 120)
+                letters += draw_text(draw_ctx, cb, fb, &dsc, x, y, texts[(x / 120 + y) % 6]);
+        }
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return letters / s;
+}
+
+static void bench_text(const char *name, const lv_font_t *font, int iterations)
+{
+    double stock = letters_per_s(&ctx.base_draw, lv_draw_sw_letter, font, iterations);
+    double es = letters_per_s(&es_ctx.base_sw.base_draw, lv_draw_es_letter, font, iterations);
+    printf("%-16s %9.0f -> %9.0f letters/s (x%.2f)\n", name, stock, es, es / stock);
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = (argc > 1) ? atoi(argv[1]) : 4096;
+
+    lv_init();
+    fb = (lv_color_t *)malloc(W * H * sizeof(lv_color_t));
+    ref = (lv_color_t *)malloc(W * H * sizeof(lv_color_t));
+    start = (lv_color_t *)malloc(W * H * sizeof(lv_color_t));
+    src = (lv_color_t *)malloc(W * H * sizeof(lv_color_t));
+    mask = (lv_opa_t *)malloc(W * H);
+    lv_disp_draw_buf_init(&draw_buf, fb, NULL, W * H);
+    lv_disp_drv_init(&disp_drv);
+    disp_drv.hor_res = W;
+    disp_drv.ver_res = H;
+    disp_drv.flush_cb = null_flush;
+    disp_drv.draw_buf = &draw_buf;
+    disp_drv.direct_mode = 1;
+    lv_disp_t *disp = lv_disp_drv_register(&disp_drv);
+
+    // Both blend functions look at the display being refreshed
+    _lv_refr_set_disp_refreshing(disp);
+    lv_draw_sw_init_ctx(&disp_drv, &ctx.base_draw);
+    ctx.base_draw.buf_area = &buf_area;
+    ctx.base_draw.clip_area = &clip_area;
+    lv_draw_es_ctx_init(&disp_drv, &es_ctx.base_sw.base_draw);
+    es_ctx.base_sw.base_draw.buf_area = &buf_area;
+    es_ctx.base_sw.base_draw.clip_area = &clip_area;
+
+    for (int p = 0; p < W * H; p++)
+        start[p].full = (uint16_t)rnd();
+    for (int p = 0; p < W * H; p++)
+        src[p].full = (uint16_t)rnd();
+
+    uint32_t mismatches = check(rounds > 256 * KIND_COUNT ? rounds : 256 * KIND_COUNT);
+
+    bench("fill", FILL, LV_OPA_COVER);
+    bench("fill opa", FILL, LV_OPA_50);
+    bench("fill mask", FILL_MASK, LV_OPA_COVER);
+    bench("copy", MAP, LV_OPA_COVER);
+    bench("copy opa", MAP, LV_OPA_50);
+
+    mismatches += check_text(rounds / 4);
+    bench_text("text 48px", &lv_font_montserrat_48, 200);
+    bench_text("text 14px", &lv_font_montserrat_14, 200);
+
+    free(mask);
+    free(src);
+    free(start);
+    free(ref);
+    free(fb);
+    return mismatches ? 1 : 0;
+}
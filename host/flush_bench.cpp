@@ -0,0 +1,315 @@
+/*
+ * Drives my_disp_flush() with known frames on the host and checks what the
+ * emulated panels end up showing, then reports the SPI cost per frame.
+ *
+ *   flush_bench [frames]
+ *
+ * Exit status is non-zero if either panel does not match the reference
+ * mapping below.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include "Arduino.h"
+#include "lvgl.h"
+#include "display.h"
+#include "display_power.h"
+#include "display_stats.h"
+#include "lv_numeric.h"
+#include "lv_shotchart.h"
+#include "lv_draw_es.h"
+#include "jd9613_emu.h"
+
+void my_print(const char *buf)
+{
+    fputs(buf, stdout);
+}
+
+static lv_disp_draw_buf_t draw_buf;
+static lv_disp_drv_t disp_drv;
+static lv_color_t *buf;
+
+// Where a panel pixel comes from in the LVGL frame. TFT_CS_0 shows the
+// right half flipped vertically, TFT_CS_1 the left half mirrored; note that
+// panel 1 row 0 repeats LVGL column 294, the first column of the right half.
+static uint16_t reference(int panel, int x, int y)
+{
+    int row = (panel == 0) ? (DISPLAY_VER_RES - 1 - x) : x;
+    int col = (panel == 0) ? (TFT_HEIGHT + y) : (TFT_HEIGHT - y);
+    return buf[row * DISPLAY_HOR_RES + col].full;
+}
+
+static void fill_pattern(uint32_t seed)
+{
+    for (int y = 0; y < DISPLAY_VER_RES; y++)
+    {
+        for (int x = 0; x < DISPLAY_HOR_RES; x++)
+        {
+            uint32_t v = (uint32_t)(y * DISPLAY_HOR_RES + x) * 2654435761u + seed;
+            buf[y * DISPLAY_HOR_RES + x].full = (uint16_t)(v >> 16);
+        }
+    }
+}
+
+static void flush_frame(void)
+{
+    lv_area_t area = {0, 0, DISPLAY_HOR_RES - 1, DISPLAY_VER_RES - 1};
+    disp_drv.draw_buf->flushing = 1;
+    disp_drv.draw_buf->flushing_last = 1;
+    my_disp_flush(&disp_drv, &area, buf);
+}
+
+static uint32_t verify(void)
+{
+    uint32_t mismatches = 0;
+    for (int panel = 0; panel < Jd9613Emulator::PANEL_COUNT; panel++)
+    {
+        for (int y = 0; y < TFT_HEIGHT; y++)
+        {
+            for (int x = 0; x < TFT_WIDTH; x++)
+            {
+                if (jd9613_emu.pixel(panel, x, y) != reference(panel, x, y))
+                {
+                    if (mismatches < 8)
+                    {
+                        printf("mismatch panel %d (%d,%d): got %04x expected %04x\n", panel, x, y,
+                               jd9613_emu.pixel(panel, x, y), reference(panel, x, y));
+                    }
+                    mismatches++;
+                }
+            }
+        }
+    }
+    return mismatches;
+}
+
+static void fill_rect(int x, int y, int w, int h, uint32_t seed)
+{
+    for (int r = y; r < y + h; r++)
+    {
+        for (int c = x; c < x + w; c++)
+        {
+            buf[r * DISPLAY_HOR_RES + c].full = (uint16_t)((r * 31 + c * 17) * 2654435761u + seed);
+        }
+    }
+}
+
+static void print_stats(const char *label, const jd9613_emu_stats_t &s)
+{
+    double wire_us = (double)s.bytes * 8.0 * 1e6 / SPI_FREQUENCY;
+    printf("%-8s transactions=%u bytes=%u commands=%u windows=%u pixels=%u overruns=%u wire=%.0fus\n",
+           label, s.transactions, s.bytes, s.commands, s.windows, s.pixels, s.overruns, wire_us);
+}
+
+static uint32_t run_case(const char *name)
+{
+    jd9613_emu.resetStats();
+    flush_frame();
+    uint32_t mismatches = verify();
+    printf("%s: %s (%u mismatching pixels)\n", name, mismatches ? "FAIL" : "ok", mismatches);
+    print_stats("panel0", jd9613_emu.stats(0));
+    print_stats("panel1", jd9613_emu.stats(1));
+    return mismatches;
+}
+
+// Idle dimming, sleep-in and wake as seen by the panels
+static uint32_t run_power_case(void)
+{
+    uint32_t failures = 0;
+    setupDisplayPower();
+
+    delay(DISPLAY_DIM_TIMEOUT_MS);
+    updateDisplayPower(false);
+    for (int panel = 0; panel < Jd9613Emulator::PANEL_COUNT; panel++)
+        failures += jd9613_emu.brightness(panel) != DISPLAY_BRIGHTNESS_DIM;
+
+    delay(DISPLAY_SLEEP_TIMEOUT_MS - DISPLAY_DIM_TIMEOUT_MS);
+    updateDisplayPower(false);
+    for (int panel = 0; panel < Jd9613Emulator::PANEL_COUNT; panel++)
+        failures += !jd9613_emu.sleeping(panel) || jd9613_emu.displayOn(panel);
+
+    delay(1000); // Woken well after sleep-in, as between shots
+    jd9613_emu.resetStats();
+    uint32_t t0 = millis();
+    wakeDisplay();
+    uint32_t wake_ms = millis() - t0;
+    for (int panel = 0; panel < Jd9613Emulator::PANEL_COUNT; panel++)
+    {
+        failures += jd9613_emu.sleeping(panel) || !jd9613_emu.displayOn(panel) ||
+                    jd9613_emu.brightness(panel) != DISPLAY_BRIGHTNESS_FULL;
+    }
+    printf("power: %s (wake %u ms, %u bytes)\n", failures ? "FAIL" : "ok", wake_ms, jd9613_emu.total().bytes);
+    return failures;
+}
+
+static uint32_t invalidated_pixels(void)
+{
+    lv_disp_t *disp = lv_disp_get_default();
+    uint32_t px = 0;
+    for (uint16_t i = 0; i < disp->inv_p; i++)
+    {
+        if (!disp->inv_area_joined[i])
+            px += lv_area_get_size(&disp->inv_areas[i]);
+    }
+    return px;
+}
+
+// The weight readout rendered by LVGL itself: a tick of the last digit
+// should only touch that digit's cell
+static uint32_t run_numeric_case(void)
+{
+    lv_obj_t *scr = lv_scr_act();
+    lv_obj_clean(scr);
+    lv_obj_set_style_bg_color(scr, lv_color_black(), LV_PART_MAIN);
+    lv_obj_t *num = lv_numeric_create(scr);
+    lv_numeric_set_align(num, LV_TEXT_ALIGN_RIGHT);
+    lv_numeric_set_font(num, &lv_font_montserrat_48, "0123456789.- g", 8);
+    lv_obj_align(num, LV_ALIGN_RIGHT_MID, -10, 0);
+    lv_numeric_set_text(num, "18.2 g");
+    lv_refr_now(NULL);
+
+    jd9613_emu.resetStats();
+    lv_numeric_set_text(num, "18.3 g");
+    uint32_t inv_px = invalidated_pixels();
+    lv_refr_now(NULL);
+    uint32_t mismatches = verify();
+    printf("numeric: %s (%u mismatching pixels, %u invalidated pixels, %u bytes)\n",
+           mismatches ? "FAIL" : "ok", mismatches, inv_px, jd9613_emu.total().bytes);
+
+    // The profiler's record of that refresh should agree with what the panels received
+    display_frame_t f;
+    uint32_t failures = mismatches;
+    if (display_stats_get_frames(&f, 1) == 1)
+    {
+        for (int panel = 0; panel < Jd9613Emulator::PANEL_COUNT; panel++)
+            failures += f.bytes[panel] != jd9613_emu.stats(panel).bytes;
+        failures += f.pixels != inv_px;
+        printf("stats: %s (%u areas, %u px, render %u us, flush %u us, wait %u us, %u/%u bytes)\n",
+               failures > mismatches ? "FAIL" : "ok", f.areas, f.pixels, f.render_us, f.flush_us, f.wait_us,
+               f.bytes[0], f.bytes[1]);
+    }
+    else
+    {
+        printf("stats: FAIL (no frame recorded)\n");
+        failures++;
+    }
+
+    lv_obj_del(num);
+    lv_refr_now(NULL);
+    return failures;
+}
+
+// A shot plotted at 10 Hz: appending a sample should cost a few columns,
+// compared with invalidating the whole plot for every sample
+static uint32_t run_chart_case(int samples)
+{
+    lv_obj_t *scr = lv_scr_act();
+    lv_obj_t *chart = lv_shotchart_create(scr);
+    lv_obj_set_size(chart, DISPLAY_HOR_RES - 20, 30);
+    lv_obj_align(chart, LV_ALIGN_BOTTOM_MID, 0, -4);
+    lv_shotchart_set_series_count(chart, 2);
+    lv_shotchart_set_range(chart, 0, 0, 400);
+    lv_shotchart_set_range(chart, 1, 0, 30);
+    lv_refr_now(NULL);
+
+    uint32_t mismatches = 0;
+    for (int naive = 0; naive < 2; naive++)
+    {
+        lv_shotchart_clear(chart);
+        lv_refr_now(NULL);
+        uint32_t rescales = lv_shotchart_get_rescale_count(chart);
+        uint64_t inv_px = 0;
+        double host_us = 0;
+        jd9613_emu.resetStats();
+        for (int i = 0; i < samples; i++)
+        {
+            // Preinfusion, a ramp up to ~2 g/s, then tailing off
+            float t = i / 10.0f;
+            float flow = t < 6 ? 0.1f : 2.6f * expf(-(t - 16) * (t - 16) / 120.0f);
+            static float weight;
+            weight = (i == 0) ? 0 : weight + flow / 10.0f;
+            int16_t values[2] = {(int16_t)(weight * 10), (int16_t)(flow * 10)};
+
+            auto t0 = std::chrono::steady_clock::now();
+            lv_shotchart_append(chart, values);
+            if (naive)
+                lv_obj_invalidate(chart);
+            inv_px += invalidated_pixels();
+            lv_refr_now(NULL);
+            host_us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+        }
+        mismatches += verify();
+        printf("chart %s: %s, %d samples, %u rescales, %llu invalidated pixels, %u bytes, %.1f us host time per sample\n",
+               naive ? "naive" : "sweep", mismatches ? "FAIL" : "ok", samples,
+               lv_shotchart_get_rescale_count(chart) - rescales, (unsigned long long)(inv_px / samples),
+               jd9613_emu.total().bytes / samples, host_us / samples);
+    }
+    lv_obj_del(chart);
+    lv_refr_now(NULL);
+    return mismatches;
+}
+
+int main(int argc, char **argv)
+{
+    int frames = (argc > 1) ? atoi(argv[1]) : 50;
+
+    jd9613_emu.resetStats();
+    jd9613_init();
+    print_stats("init", jd9613_emu.total());
+
+    lv_init();
+    buf = (lv_color_t *)malloc(DISPLAY_HOR_RES * DISPLAY_VER_RES * sizeof(lv_color_t));
+    lv_disp_draw_buf_init(&draw_buf, buf, NULL, DISPLAY_HOR_RES * DISPLAY_VER_RES);
+    lv_disp_drv_init(&disp_drv);
+    disp_drv.hor_res = DISPLAY_HOR_RES;
+    disp_drv.ver_res = DISPLAY_VER_RES;
+    disp_drv.flush_cb = my_disp_flush;
+    disp_drv.draw_buf = &draw_buf;
+    disp_drv.direct_mode = 1;
+    disp_drv.draw_ctx_init = lv_draw_es_ctx_init;
+    disp_drv.draw_ctx_deinit = lv_draw_es_ctx_deinit;
+    disp_drv.draw_ctx_size = sizeof(lv_draw_es_ctx_t);
+    lv_disp_drv_register(&disp_drv);
+
+    // Full frame onto panels that show something else
+    fill_pattern(0);
+    display_invalidate_panels();
+    uint32_t mismatches = run_case("full");
+
+    // Same frame again: nothing should go out
+    mismatches += run_case("same");
+
+    // A weight digit sized change on the right half
+    fill_rect(400, 39, 34, 48, 0);
+    mismatches += run_case("digit");
+
+    // A change straddling the seam between the panels
+    fill_rect(280, 10, 30, 100, 0x55);
+    mismatches += run_case("seam");
+
+    mismatches += run_power_case();
+
+    mismatches += run_numeric_case();
+
+    mismatches += run_chart_case(700);
+
+    double host_us = 0;
+    jd9613_emu.resetStats();
+    for (int i = 0; i < frames; i++)
+    {
+        fill_rect(300 + (i * 7) % 250, 39, 34, 48, i + 1);
+        auto t0 = std::chrono::steady_clock::now();
+        flush_frame();
+        host_us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    }
+    printf("bench: %d frames, %.1f us host time per flush, %u bytes per frame\n", frames,
+           frames ? host_us / frames : 0.0, frames ? jd9613_emu.total().bytes / frames : 0);
+    mismatches += verify();
+
+    char text[512];
+    display_stats_format(text, sizeof(text));
+    fputs(text, stdout);
+
+    free(buf);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * Measures the per-glyph cost of lv_font_get_glyph_dsc() on the texts the
+ * scale shows, with the glyph cache warm and with it dropped before every
+ * string, and checks that both give the same descriptors. Then redraws a
+ * screen of labels and prints the cache hit ratio of a frame.
+ *
+ *   font_bench [rounds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "Arduino.h"
+#include "lvgl.h"
+#include "display.h"
+
+#if LV_FONT_FMT_TXT_CACHE_SIZE == 0
+#error "font_bench needs LV_FONT_FMT_TXT_CACHE_SIZE > 0"
+#endif
+
+void my_print(const char *buf)
+{
+    fputs(buf, stdout);
+}
+
+// What the weight and timer readouts cycle through during a shot
+static const char *texts[] = {"18.3 g", "-0.1 g", "36.0 g", "27 s", "0 s", "Low battery"};
+static const lv_font_t *fonts[] = {&lv_font_montserrat_48};
+
+static lv_color_t *buf;
+static lv_disp_draw_buf_t draw_buf;
+static lv_disp_drv_t disp_drv;
+
+static void null_flush(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t *color_p)
+{
+    LV_UNUSED(area);
+    LV_UNUSED(color_p);
+    lv_disp_flush_ready(drv);
+}
+
+// Walk every string like lv_txt_get_width() does; the sum keeps the work alive
+static uint32_t lookup_all(bool cold, lv_font_glyph_dsc_t *out, uint32_t *glyphs)
+{
+    uint32_t sum = 0;
+    uint32_t n = 0;
+    for (const lv_font_t *font : fonts)
+    {
+        for (const char *text : texts)
+        {
+            if (cold)
+                lv_font_fmt_txt_cache_drop(NULL);
+            for (size_t i = 0; text[i]; i++)
+            {
+                lv_font_glyph_dsc_t g;
+                if (lv_font_get_glyph_dsc(font, &g, (uint8_t)text[i], (uint8_t)text[i + 1]))
+                    sum += g.adv_w + g.box_w;
+                if (out)
+                    out[n] = g;
+                n++;
+            }
+        }
+    }
+    *glyphs = n;
+    return sum;
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = (argc > 1) ? atoi(argv[1]) : 20000;
+
+    lv_init();
+    buf = (lv_color_t *)malloc(DISPLAY_HOR_RES * DISPLAY_VER_RES * sizeof(lv_color_t));
+    lv_disp_draw_buf_init(&draw_buf, buf, NULL, DISPLAY_HOR_RES * DISPLAY_VER_RES);
+    lv_disp_drv_init(&disp_drv);
+    disp_drv.hor_res = DISPLAY_HOR_RES;
+    disp_drv.ver_res = DISPLAY_VER_RES;
+    disp_drv.flush_cb = null_flush;
+    disp_drv.draw_buf = &draw_buf;
+    disp_drv.direct_mode = 1;
+    lv_disp_drv_register(&disp_drv);
+
+    // The cached descriptors must match freshly resolved ones
+    static lv_font_glyph_dsc_t cold_dsc[128], warm_dsc[128];
+    uint32_t glyphs;
+    lookup_all(true, cold_dsc, &glyphs);
+    lookup_all(false, warm_dsc, &glyphs);
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < glyphs; i++)
+        mismatches += memcmp(&cold_dsc[i], &warm_dsc[i], sizeof(lv_font_glyph_dsc_t)) != 0;
+    printf("descriptors: %s (%u of %u differ)\n", mismatches ? "FAIL" : "ok", mismatches, glyphs);
+
+    // Cost of dropping the cache itself, taken out of the cold numbers
+    const int strings = sizeof(fonts) / sizeof(fonts[0]) * sizeof(texts) / sizeof(texts[0]);
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds * strings; r++)
+        lv_font_fmt_txt_cache_drop(NULL);
+    double drop_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+
+    volatile uint32_t sink = 0;
+    double ns[2];
+    for (int cold = 1; cold >= 0; cold--)
+    {
+        lv_font_fmt_txt_reset_cache_stats();
+        t0 = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++)
+            sink += lookup_all(cold, NULL, &glyphs);
+        double total = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+        if (cold)
+            total -= drop_ns;
+        ns[cold] = total / ((double)rounds * glyphs);
+        lv_font_fmt_txt_cache_stats_t st;
+        lv_font_fmt_txt_get_cache_stats(&st);
+        printf("%s: %.1f ns per glyph, hits=%u misses=%u\n", cold ? "cold" : "warm", ns[cold], st.hits, st.misses);
+    }
+    printf("lookup: %.2fx faster with the cache\n", ns[1] / ns[0]);
+
+    // One frame of the scale's screen
+    lv_obj_t *scr = lv_scr_act();
+    lv_obj_set_style_bg_color(scr, lv_color_black(), LV_PART_MAIN);
+    lv_obj_t *weight = lv_label_create(scr);
+    lv_obj_set_style_text_font(weight, &lv_font_montserrat_48, LV_PART_MAIN);
+    lv_label_set_text(weight, "18.3 g");
+    lv_obj_align(weight, LV_ALIGN_RIGHT_MID, -10, 0);
+    lv_obj_t *timer = lv_label_create(scr);
+    lv_obj_set_style_text_font(timer, &lv_font_montserrat_48, LV_PART_MAIN);
+    lv_label_set_text(timer, "27 s");
+    lv_obj_align(timer, LV_ALIGN_LEFT_MID, 10, 0);
+    lv_refr_now(NULL);
+
+    lv_font_fmt_txt_reset_cache_stats();
+    lv_obj_invalidate(scr);
+    lv_refr_now(NULL);
+    lv_font_fmt_txt_cache_stats_t st;
+    lv_font_fmt_txt_get_cache_stats(&st);
+    printf("frame: hits=%u misses=%u\n", st.hits, st.misses);
+
+    free(buf);
+    return mismatches ? 1 : 0;
+}
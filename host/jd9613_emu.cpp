@@ -0,0 +1,267 @@
+#include "jd9613_emu.h"
+#include <string.h>
+#include "pin_config.h"
+
+Jd9613Emulator jd9613_emu;
+
+Jd9613Emulator::Jd9613Emulator()
+{
+    memset(_panel, 0, sizeof(_panel));
+    _dc = true;
+    powerOn();
+}
+
+void Jd9613Emulator::panelReset(Panel &p)
+{
+    p.page = 0x00;
+    p.cmd = 0x00;
+    p.param_len = 0;
+    p.xs = 0;
+    p.xe = TFT_WIDTH - 1;
+    p.ys = 0;
+    p.ye = TFT_HEIGHT - 1;
+    p.cur_x = 0;
+    p.cur_y = 0;
+    p.ram_write = false;
+    p.have_half = false;
+    p.window_full = false;
+    p.madctl = 0x00;
+    p.brightness = 0x00;
+    p.sleeping = true;
+    p.display_on = false;
+}
+
+void Jd9613Emulator::powerOn()
+{
+    for (int i = 0; i < PANEL_COUNT; i++)
+    {
+        panelReset(_panel[i]);
+        fillFramebuffer(i, 0x0000);
+    }
+}
+
+void Jd9613Emulator::resetStats()
+{
+    for (int i = 0; i < PANEL_COUNT; i++)
+    {
+        memset(&_panel[i].stats, 0, sizeof(_panel[i].stats));
+    }
+}
+
+jd9613_emu_stats_t Jd9613Emulator::total() const
+{
+    jd9613_emu_stats_t t;
+    memset(&t, 0, sizeof(t));
+    for (int i = 0; i < PANEL_COUNT; i++)
+    {
+        const jd9613_emu_stats_t &s = _panel[i].stats;
+        t.transactions += s.transactions;
+        t.bytes += s.bytes;
+        t.commands += s.commands;
+        t.windows += s.windows;
+        t.pixels += s.pixels;
+        t.overruns += s.overruns;
+    }
+    return t;
+}
+
+void Jd9613Emulator::fillFramebuffer(int panel, uint16_t color)
+{
+    for (uint32_t i = 0; i < TFT_WIDTH * TFT_HEIGHT; i++)
+    {
+        _panel[panel].fb[i] = color;
+    }
+}
+
+void Jd9613Emulator::gpioWrite(uint8_t pin, uint8_t level)
+{
+    switch (pin)
+    {
+    case TFT_CS_0:
+        _panel[0].selected = (level == 0);
+        break;
+    case TFT_CS_1:
+        _panel[1].selected = (level == 0);
+        break;
+    case TFT_DC:
+        _dc = (level != 0);
+        break;
+    case TFT_RES:
+        if (level == 0) powerOn();
+        break;
+    default:
+        break;
+    }
+}
+
+void Jd9613Emulator::spiTransactionBegin()
+{
+    for (int i = 0; i < PANEL_COUNT; i++)
+    {
+        if (_panel[i].selected) _panel[i].stats.transactions++;
+    }
+}
+
+void Jd9613Emulator::spiTransactionEnd()
+{
+}
+
+void Jd9613Emulator::spiByte(uint8_t b)
+{
+    for (int i = 0; i < PANEL_COUNT; i++)
+    {
+        Panel &p = _panel[i];
+        if (!p.selected) continue;
+
+        p.stats.bytes++;
+        if (_dc)
+        {
+            data(p, b);
+        }
+        else
+        {
+            p.stats.commands++;
+            command(p, b);
+        }
+    }
+}
+
+void Jd9613Emulator::command(Panel &p, uint8_t cmd)
+{
+    p.cmd = cmd;
+    p.param_len = 0;
+    p.ram_write = false;
+    p.have_half = false;
+
+    // Only the user command set on page 0 is decoded; the manufacturer
+    // pages reuse the same opcodes for unrelated registers.
+    if (p.page != 0x00 && cmd != 0xfe) return;
+
+    switch (cmd)
+    {
+    case 0x10: // SLPIN
+        p.sleeping = true;
+        break;
+    case 0x11: // SLPOUT
+        p.sleeping = false;
+        break;
+    case 0x28: // DISPOFF
+        p.display_on = false;
+        break;
+    case 0x29: // DISPON
+        p.display_on = true;
+        break;
+    case 0x2c: // RAMWR
+        p.ram_write = true;
+        p.window_full = false;
+        p.cur_x = p.xs;
+        p.cur_y = p.ys;
+        p.stats.windows++;
+        break;
+    case 0x3c: // RAMWRC
+        p.ram_write = true;
+        break;
+    default:
+        break;
+    }
+}
+
+void Jd9613Emulator::data(Panel &p, uint8_t b)
+{
+    if (p.ram_write)
+    {
+        if (!p.have_half)
+        {
+            p.half = b;
+            p.have_half = true;
+        }
+        else
+        {
+            p.have_half = false;
+            storePixel(p, (uint16_t)((p.half << 8) | b));
+        }
+        return;
+    }
+
+    if (p.param_len < sizeof(p.param)) p.param[p.param_len] = b;
+    p.param_len++;
+
+    if (p.cmd == 0xfe)
+    {
+        if (p.param_len == 1) p.page = b;
+        return;
+    }
+    if (p.page != 0x00) return;
+
+    switch (p.cmd)
+    {
+    case 0x2a: // CASET
+        if (p.param_len == 4)
+        {
+            p.xs = (p.param[0] << 8) | p.param[1];
+            p.xe = (p.param[2] << 8) | p.param[3];
+        }
+        break;
+    case 0x2b: // RASET
+        if (p.param_len == 4)
+        {
+            p.ys = (p.param[0] << 8) | p.param[1];
+            p.ye = (p.param[2] << 8) | p.param[3];
+        }
+        break;
+    case TFT_MADCTL:
+        if (p.param_len == 1) p.madctl = b;
+        break;
+    case 0x51: // WRDISBV
+        if (p.param_len == 1) p.brightness = b;
+        break;
+    default:
+        break;
+    }
+}
+
+void Jd9613Emulator::storePixel(Panel &p, uint16_t color)
+{
+    // Logical window coordinates are mapped to panel memory the way MIPI
+    // DCS panels apply MADCTL: MV swaps the axes, MX/MY mirror them.
+    if (p.window_full)
+    {
+        p.stats.overruns++;
+        p.window_full = false;
+    }
+
+    int x = p.cur_x;
+    int y = p.cur_y;
+    if (p.madctl & TFT_MAD_MV)
+    {
+        int t = x;
+        x = y;
+        y = t;
+    }
+    if (p.madctl & TFT_MAD_MX) x = TFT_WIDTH - 1 - x;
+    if (p.madctl & TFT_MAD_MY) y = TFT_HEIGHT - 1 - y;
+
+    if (x >= 0 && x < TFT_WIDTH && y >= 0 && y < TFT_HEIGHT)
+    {
+        p.fb[y * TFT_WIDTH + x] = color;
+    }
+    p.stats.pixels++;
+
+    if (p.cur_x < p.xe)
+    {
+        p.cur_x++;
+    }
+    else
+    {
+        p.cur_x = p.xs;
+        if (p.cur_y < p.ye)
+        {
+            p.cur_y++;
+        }
+        else
+        {
+            p.cur_y = p.ys;
+            p.window_full = true;
+        }
+    }
+}
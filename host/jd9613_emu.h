@@ -0,0 +1,84 @@
+#pragma once
+/*
+ * JD9613 protocol emulator for host builds.
+ *
+ * The host SPI/GPIO stubs feed every chip select, D/C and reset edge and
+ * every byte on MOSI into this class. It decodes the command stream the
+ * same way the panel does (page select, MADCTL, CASET/RASET, RAMWR, sleep,
+ * brightness) into one 126x294 RGB565 framebuffer per chip select, and
+ * counts what each panel received so flush strategies can be compared.
+ */
+#include <stdint.h>
+#include "jd9613.h"
+
+typedef struct
+{
+    uint32_t transactions; // SPI transactions started while the panel was selected
+    uint32_t bytes;        // bytes clocked into the panel (commands + data)
+    uint32_t commands;     // bytes sent with D/C low
+    uint32_t windows;      // RAMWR commands, i.e. address windows opened
+    uint32_t pixels;       // pixels written into panel memory
+    uint32_t overruns;     // pixels that wrapped past the end of the window
+} jd9613_emu_stats_t;
+
+class Jd9613Emulator
+{
+public:
+    static const int PANEL_COUNT = 2;
+
+    Jd9613Emulator();
+
+    // Reset both panels to their power-on state (also done on a TFT_RES pulse)
+    void powerOn();
+    void resetStats();
+
+    const jd9613_emu_stats_t &stats(int panel) const { return _panel[panel].stats; }
+    jd9613_emu_stats_t total() const;
+
+    uint16_t pixel(int panel, int x, int y) const { return _panel[panel].fb[y * TFT_WIDTH + x]; }
+    const uint16_t *framebuffer(int panel) const { return _panel[panel].fb; }
+    void fillFramebuffer(int panel, uint16_t color);
+
+    uint8_t madctl(int panel) const { return _panel[panel].madctl; }
+    uint8_t brightness(int panel) const { return _panel[panel].brightness; }
+    bool sleeping(int panel) const { return _panel[panel].sleeping; }
+    bool displayOn(int panel) const { return _panel[panel].display_on; }
+
+    // Bus hooks called from the Arduino/SPI stubs
+    void gpioWrite(uint8_t pin, uint8_t level);
+    void spiTransactionBegin();
+    void spiTransactionEnd();
+    void spiByte(uint8_t data);
+
+private:
+    struct Panel
+    {
+        bool     selected;
+        uint8_t  page;
+        uint8_t  cmd;
+        uint8_t  param[16];
+        uint8_t  param_len;
+        uint16_t xs, xe, ys, ye;
+        uint16_t cur_x, cur_y;
+        bool     ram_write;
+        bool     have_half;
+        bool     window_full;
+        uint8_t  half;
+        uint8_t  madctl;
+        uint8_t  brightness;
+        bool     sleeping;
+        bool     display_on;
+        uint16_t fb[TFT_WIDTH * TFT_HEIGHT];
+        jd9613_emu_stats_t stats;
+    };
+
+    void panelReset(Panel &p);
+    void command(Panel &p, uint8_t cmd);
+    void data(Panel &p, uint8_t data);
+    void storePixel(Panel &p, uint16_t color);
+
+    Panel _panel[PANEL_COUNT];
+    bool  _dc;
+};
+
+extern Jd9613Emulator jd9613_emu;
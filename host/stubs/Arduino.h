@@ -0,0 +1,40 @@
+#pragma once
+/*
+ * Minimal Arduino core surface for host builds. Only what the display
+ * driver and LVGL's tick source touch is provided; GPIO writes are routed
+ * to the JD9613 emulator so chip select and D/C transitions are observed.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define LOW    0
+#define HIGH   1
+#define INPUT  0x01
+#define OUTPUT 0x03
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+uint32_t millis(void);
+uint32_t micros(void);
+
+#ifdef __cplusplus
+}
+
+#include <algorithm>
+using std::min;
+using std::max;
+#endif
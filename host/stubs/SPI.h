@@ -0,0 +1,49 @@
+#pragma once
+/*
+ * Host replacement for the ESP32 Arduino SPI class. Every byte clocked out
+ * is handed to the JD9613 emulator in wire order (MSB first for the 16 and
+ * 32 bit helpers, memory order for writeBytes()).
+ */
+#include "Arduino.h"
+
+#define SPI_MODE0 0
+#define SPI_MODE1 1
+#define SPI_MODE2 2
+#define SPI_MODE3 3
+
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+class SPISettings
+{
+public:
+    SPISettings() : _clock(1000000), _bitOrder(MSBFIRST), _dataMode(SPI_MODE0) {}
+    SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode)
+        : _clock(clock), _bitOrder(bitOrder), _dataMode(dataMode) {}
+    uint32_t _clock;
+    uint8_t  _bitOrder;
+    uint8_t  _dataMode;
+};
+
+class SPIClass
+{
+public:
+    void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1);
+    void end();
+    void setFrequency(uint32_t freq);
+    uint32_t getFrequency() const { return _freq; }
+
+    void beginTransaction(SPISettings settings);
+    void endTransaction(void);
+
+    void write(uint8_t data);
+    void write16(uint16_t data);
+    void write32(uint32_t data);
+    void writeBytes(const uint8_t *data, uint32_t size);
+    void writePixels(const void *data, uint32_t size);
+
+private:
+    uint32_t _freq = 1000000;
+};
+
+extern SPIClass SPI;
@@ -0,0 +1,117 @@
+#include "Arduino.h"
+#include "SPI.h"
+#include <chrono>
+#include "jd9613_emu.h"
+
+SPIClass SPI;
+
+// delay() advances a virtual clock instead of sleeping so that panel init
+// and power sequencing do not slow benchmarks down, while millis() still
+// moves forward as the firmware expects.
+static uint64_t virtual_us = 0;
+
+static uint64_t host_us(void)
+{
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+extern "C" void pinMode(uint8_t pin, uint8_t mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+extern "C" void digitalWrite(uint8_t pin, uint8_t val)
+{
+    jd9613_emu.gpioWrite(pin, val);
+}
+
+extern "C" int digitalRead(uint8_t pin)
+{
+    (void)pin;
+    return HIGH;
+}
+
+extern "C" void delay(uint32_t ms)
+{
+    virtual_us += (uint64_t)ms * 1000;
+}
+
+extern "C" void delayMicroseconds(uint32_t us)
+{
+    virtual_us += us;
+}
+
+extern "C" uint32_t millis(void)
+{
+    return (uint32_t)((host_us() + virtual_us) / 1000);
+}
+
+extern "C" uint32_t micros(void)
+{
+    return (uint32_t)(host_us() + virtual_us);
+}
+
+void SPIClass::begin(int8_t sck, int8_t miso, int8_t mosi, int8_t ss)
+{
+    (void)sck;
+    (void)miso;
+    (void)mosi;
+    (void)ss;
+}
+
+void SPIClass::end()
+{
+}
+
+void SPIClass::setFrequency(uint32_t freq)
+{
+    _freq = freq;
+}
+
+void SPIClass::beginTransaction(SPISettings settings)
+{
+    _freq = settings._clock;
+    jd9613_emu.spiTransactionBegin();
+}
+
+void SPIClass::endTransaction(void)
+{
+    jd9613_emu.spiTransactionEnd();
+}
+
+void SPIClass::write(uint8_t data)
+{
+    jd9613_emu.spiByte(data);
+}
+
+void SPIClass::write16(uint16_t data)
+{
+    jd9613_emu.spiByte(data >> 8);
+    jd9613_emu.spiByte(data & 0xff);
+}
+
+void SPIClass::write32(uint32_t data)
+{
+    write16(data >> 16);
+    write16(data & 0xffff);
+}
+
+void SPIClass::writeBytes(const uint8_t *data, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++)
+    {
+        jd9613_emu.spiByte(data[i]);
+    }
+}
+
+void SPIClass::writePixels(const void *data, uint32_t size)
+{
+    // Like the ESP32 core: 16-bit pixels are sent high byte first
+    const uint16_t *p = (const uint16_t *)data;
+    for (uint32_t i = 0; i < size / 2; i++)
+    {
+        write16(p[i]);
+    }
+}
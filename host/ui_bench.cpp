@@ -0,0 +1,155 @@
+/*
+ * Renders the scale's real screen (src/ui.cpp) headless under lib/lv_conf.h
+ * and the scale's draw context, and plays a scripted shot through it the
+ * way loop() does: a weight sample at the HX711's 10 Hz, the timer every
+ * second, the chart at 10 Hz and LVGL's handler every 10 ms. Flushes go nowhere, so only LVGL's side is measured.
+ * Every redrawn frame is printed as one CSV row on stdout, a summary goes
+ * to stderr:
+ *
+ *   ui_bench [shots] > frames.csv
+ *
+ * Exit status is non-zero if an LVGL allocation failed or fell back to the
+ * system heap.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "Arduino.h"
+#include "lvgl.h"
+#include "lv_alloc.h"
+#include "lv_draw_es.h"
+#include "display.h"
+#include "display_stats.h"
+#include "ui.h"
+
+void my_print(const char *buf)
+{
+    fputs(buf, stderr);
+}
+
+static lv_color_t *buf;
+static lv_disp_draw_buf_t draw_buf;
+static lv_disp_drv_t disp_drv;
+
+static void null_flush(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t *color_p)
+{
+    LV_UNUSED(area);
+    LV_UNUSED(color_p);
+    lv_disp_flush_ready(drv);
+}
+
+#define LOOP_MS     10      // delay() at the end of loop()
+#define SAMPLE_MS   100     // HX711 at 10 samples/s
+#define SHOT_MS     36000
+#define START_MS    2000    // Timer started
+#define POUR_MS     8000    // End of preinfusion
+#define STOP_MS     30000   // Pump off
+#define TIMER_MS    32000   // Timer stopped
+
+// Cup weight in grams at `ms` into the script: a slow preinfusion, a 1.6 g/s
+// pour, then drips. The +-0.1 g wobble is what the filtered load cell shows.
+static float shot_weight(uint32_t ms)
+{
+    float w;
+    if (ms < START_MS)
+        w = 0;
+    else if (ms < POUR_MS)
+        w = 2.0f * (ms - START_MS) / (POUR_MS - START_MS);
+    else if (ms < STOP_MS)
+        w = 2.0f + 1.6f * (ms - POUR_MS) / 1000.0f;
+    else
+        w = 37.2f + 0.6f * (1.0f - expf(-(float)(ms - STOP_MS) / 1500.0f));
+    static const float wobble[] = {0, 0.1f, 0, -0.1f, 0, 0, 0.1f, -0.1f};
+    return w + wobble[(ms / 70) % 8];
+}
+
+struct totals_t
+{
+    uint32_t frames;
+    uint64_t render_us;
+    uint32_t max_render_us;
+    uint64_t pixels;
+    uint32_t max_pixels;
+};
+
+// Prints the frames LVGL recorded since the last call
+static void print_frames(uint32_t start_ms, float weight, int timer, totals_t *t)
+{
+    static display_frame_t frames[DISPLAY_STATS_RECORDS];
+    uint32_t n = display_stats_get_frames(frames, DISPLAY_STATS_RECORDS);
+    display_stats_reset();
+
+    lv_alloc_stats_t mem;
+    lv_alloc_get_stats(&mem);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const display_frame_t &f = frames[i];
+        printf("%u,%u,%.1f,%d,%u,%u,%u,%u,%u,%u,%u\n", t->frames, f.time_ms - start_ms, weight, timer, f.areas,
+               f.parts, f.pixels, f.render_us, f.frame_us, mem.used, mem.peak);
+        t->frames++;
+        t->render_us += f.render_us;
+        t->max_render_us = f.render_us > t->max_render_us ? f.render_us : t->max_render_us;
+        t->pixels += f.pixels;
+        t->max_pixels = f.pixels > t->max_pixels ? f.pixels : t->max_pixels;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int shots = (argc > 1) ? atoi(argv[1]) : 1;
+
+    lv_alloc_init();
+    lv_init();
+    buf = (lv_color_t *)malloc(DISPLAY_HOR_RES * DISPLAY_VER_RES * sizeof(lv_color_t));
+    lv_disp_draw_buf_init(&draw_buf, buf, NULL, DISPLAY_HOR_RES * DISPLAY_VER_RES);
+    lv_disp_drv_init(&disp_drv);
+    disp_drv.hor_res = DISPLAY_HOR_RES;
+    disp_drv.ver_res = DISPLAY_VER_RES;
+    disp_drv.flush_cb = null_flush;
+    disp_drv.draw_buf = &draw_buf;
+    disp_drv.direct_mode = 1;
+    disp_drv.draw_ctx_init = lv_draw_es_ctx_init;
+    disp_drv.draw_ctx_deinit = lv_draw_es_ctx_deinit;
+    disp_drv.draw_ctx_size = sizeof(lv_draw_es_ctx_t);
+    lv_disp_drv_register(&disp_drv);
+
+    setupUI();
+
+    totals_t t = {0, 0, 0, 0, 0};
+    printf("frame,t_ms,weight_g,timer_s,areas,parts,pixels,render_us,frame_us,heap_used,heap_peak\n");
+    uint32_t start_ms = millis();
+    for (int shot = 0; shot < shots; shot++)
+    {
+        uint32_t shot_start = millis();
+        clearUIChart();
+        for (uint32_t ms = 0; ms < SHOT_MS; ms += LOOP_MS)
+        {
+            // One pass of loop() against the script's clock
+            float weight = shot_weight(ms - ms % SAMPLE_MS);
+            if (ms % SAMPLE_MS == 0)
+                updateUIWeight(weight);
+            bool running = ms >= START_MS && ms < TIMER_MS;
+            int timer = (ms < START_MS) ? 0 : ((running ? ms : TIMER_MS) - START_MS) / 1000;
+            if (running)
+                sampleUIChart(weight);
+            updateUITimer(timer);
+            lv_timer_handler();
+            print_frames(start_ms, weight, timer, &t);
+
+            // Render time is real, the rest of the loop is virtual
+            uint32_t next = shot_start + ms + LOOP_MS;
+            uint32_t now = millis();
+            if ((int32_t)(next - now) > 0)
+                delay(next - now);
+        }
+    }
+
+    lv_alloc_stats_t mem;
+    lv_alloc_get_stats(&mem);
+    fprintf(stderr, "%d shot(s), %u frames: render %.0f us average, %u us worst; %.0f px average, %u px worst\n",
+            shots, t.frames, t.frames ? (double)t.render_us / t.frames : 0.0, t.max_render_us,
+            t.frames ? (double)t.pixels / t.frames : 0.0, t.max_pixels);
+    fprintf(stderr, "LVGL heap: %u used, %u peak of %u, %u fallbacks, %u failures\n", mem.used, mem.peak,
+            mem.pool_size, mem.fallbacks, mem.failures);
+    free(buf);
+    return (mem.failures || mem.fallbacks) ? 1 : 0;
+}
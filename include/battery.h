@@ -1,2 +1,4 @@
+#include <stdint.h>
 void setupBattery();
-float getBatteryVoltage();
\ No newline at end of file
+float getBatteryVoltage();
+uint8_t getBatteryLevel(); // Percent, from the last getBatteryVoltage() reading
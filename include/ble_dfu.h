@@ -0,0 +1,113 @@
+#pragma once
+
+#include <NimBLEDevice.h>
+
+/**
+ * Firmware update over BLE
+ * 
+ * The DFU characteristics let a client flash a new firmware without WiFi.
+ * The client writes requests to the DFU control point and gets responses
+ * as notifications on it; the image goes to the DFU data characteristic as
+ * writes without response, each a uint32 offset followed by as much of the
+ * image as the MTU allows, in order.
+ * 
+ * Incoming data fills one of BLE_DFU_BUFFERS buffers while a writer task
+ * programs the previous one into the inactive OTA partition (erasing
+ * sector by sector as it goes) and hashes it, so receiving and flashing
+ * overlap. After each buffer the written byte count is notified as
+ * PROGRESS; a client keeps at most BLE_DFU_WINDOW bytes beyond it in
+ * flight. The image is checked against the SHA-256 given with BEGIN and by
+ * the bootloader's own checks before the scale boots it.
+ * 
+ * Only signed images are taken. BEGIN carries an ECDSA P-256 signature of
+ * the SHA-256, checked against the public key built into the firmware
+ * (DFU_PUBLIC_KEY_PEM in include/dfu_key.h, see the README); a firmware
+ * built without one refuses every update. Both characteristics need an
+ * encrypted link, and BEGIN a bonded one.
+ * 
+ * Requests, little endian:
+ *   BEGIN  uint32 size, uint8[32] sha256,  Start an update of size bytes
+ *          uint8[] signature               DER, as from openssl dgst -sha256 -sign
+ *   END                                    All data sent: verify, switch and restart
+ *   ABORT                                  Drop the update, the running firmware stays
+ * 
+ * Responses are op | BLE_DFU_RESPONSE, a BLE_DFU_STATUS_* byte and a
+ * uint32: the window for BEGIN, the written bytes for PROGRESS and the
+ * update time in milliseconds for END. A failure once BEGIN was taken,
+ * a bad signature included, is notified as an ABORT response with its
+ * status. After a successful END the scale restarts into the new firmware.
+ */
+#define ESPRESSISCALE_DFU_CONTROL_CHAR_UUID "19B1000D-E8F2-537E-4F6C-D104768A1214"
+#define ESPRESSISCALE_DFU_DATA_CHAR_UUID    "19B1000E-E8F2-537E-4F6C-D104768A1214"
+
+#define BLE_DFU_OP_BEGIN     0x01
+#define BLE_DFU_OP_END       0x02
+#define BLE_DFU_OP_ABORT     0x03
+#define BLE_DFU_OP_PROGRESS  0x04  // Notified only
+#define BLE_DFU_RESPONSE     0x80
+
+#define BLE_DFU_STATUS_OK            0x00
+#define BLE_DFU_STATUS_BUSY          0x01  // Another client is updating
+#define BLE_DFU_STATUS_INVALID       0x02
+#define BLE_DFU_STATUS_TOO_LARGE     0x03  // Bigger than the OTA partition
+#define BLE_DFU_STATUS_FLASH_ERROR   0x04
+#define BLE_DFU_STATUS_OVERRUN       0x05  // Data out of order or beyond the window
+#define BLE_DFU_STATUS_HASH_MISMATCH 0x06
+#define BLE_DFU_STATUS_BAD_IMAGE     0x07  // Rejected by esp_ota_end()
+#define BLE_DFU_STATUS_NO_MEMORY     0x08
+#define BLE_DFU_STATUS_NOT_ALLOWED   0x09  // Link not bonded, or no key built in
+#define BLE_DFU_STATUS_BAD_SIGNATURE 0x0A
+
+#define BLE_DFU_BUFFER_SIZE      16384   // Four flash sectors
+#define BLE_DFU_BUFFERS          2       // One receiving, one being flashed
+#define BLE_DFU_WINDOW           (BLE_DFU_BUFFER_SIZE * BLE_DFU_BUFFERS)
+#define BLE_DFU_BUFFER_WAIT_MS   200     // Longest the NimBLE task waits for a free buffer
+#define BLE_DFU_RESTART_DELAY_MS 500     // Lets the END response go out
+#define BLE_DFU_MAX_SIGNATURE    72      // DER ECDSA P-256
+
+/**
+ * Callback class for writes of the DFU control point
+ */
+class DfuControlCallbacks : public NimBLECharacteristicCallbacks {
+public:
+  /**
+   * Called when a client writes a DFU request
+   * 
+   * @param pCharacteristic Pointer to the NimBLECharacteristic instance
+   * @param desc Connection descriptor of the client
+   */
+  void onWrite(NimBLECharacteristic* pCharacteristic, ble_gap_conn_desc* desc);
+};
+
+/**
+ * Callback class for writes of the DFU data characteristic
+ * 
+ * Copies the image into the receive buffer and hands full buffers to the
+ * writer task.
+ */
+class DfuDataCallbacks : public NimBLECharacteristicCallbacks {
+public:
+  /**
+   * Called for every chunk of the image
+   * 
+   * @param pCharacteristic Pointer to the NimBLECharacteristic instance
+   * @param desc Connection descriptor of the client
+   */
+  void onWrite(NimBLECharacteristic* pCharacteristic, ble_gap_conn_desc* desc);
+};
+
+/**
+ * Add the DFU characteristics to the service and start the writer task
+ * 
+ * Called by setupBLE() before the service starts.
+ * 
+ * @param pService The scale's service
+ */
+void setupBLEDfu(NimBLEService* pService);
+
+/**
+ * Drop the update of a client that disconnected
+ * 
+ * @param connHandle Connection handle of the client
+ */
+void abortBLEDfu(uint16_t connHandle);
@@ -3,6 +3,7 @@
 #include <NimBLEDevice.h>
 #include <NimBLEServer.h>
 #include <NimBLEUtils.h>
+#include "commands.h"
 
 /**
  * BLE Service Implementation for EspressiScale
@@ -26,29 +27,346 @@
 #define ESPRESSISCALE_WEIGHT_CHAR_UUID     "19B10001-E8F2-537E-4F6C-D104768A1214"
 #define ESPRESSISCALE_TIMER_CHAR_UUID      "19B10002-E8F2-537E-4F6C-D104768A1214"
 #define ESPRESSISCALE_COMMAND_CHAR_UUID    "19B10003-E8F2-537E-4F6C-D104768A1214"
+#define ESPRESSISCALE_DISPLAY_STATS_CHAR_UUID "19B10004-E8F2-537E-4F6C-D104768A1214"
+#define ESPRESSISCALE_WEIGHT_STREAM_CHAR_UUID "19B10005-E8F2-537E-4F6C-D104768A1214"
+#define ESPRESSISCALE_STATE_CHAR_UUID      "19B10006-E8F2-537E-4F6C-D104768A1214"
+#define ESPRESSISCALE_LINK_STATS_CHAR_UUID "19B10007-E8F2-537E-4F6C-D104768A1214"
+#define ESPRESSISCALE_COMMAND_STATUS_CHAR_UUID "19B10008-E8F2-537E-4F6C-D104768A1214"
+#define ESPRESSISCALE_CLIENT_CONFIG_CHAR_UUID "19B10009-E8F2-537E-4F6C-D104768A1214"
+#define ESPRESSISCALE_HISTORY_CONTROL_CHAR_UUID "19B1000A-E8F2-537E-4F6C-D104768A1214"
+#define ESPRESSISCALE_HISTORY_DATA_CHAR_UUID "19B1000B-E8F2-537E-4F6C-D104768A1214"
+#define ESPRESSISCALE_TIME_SYNC_CHAR_UUID  "19B1000C-E8F2-537E-4F6C-D104768A1214"
+
+/**
+ * Scale state packet
+ * 
+ * The state characteristic carries everything a client shows in one
+ * 12-byte value (little endian, no padding), so a single read or
+ * notification is always a consistent snapshot. It is notified together
+ * with the weight characteristic, under the same publish policy. The weight
+ * and timer characteristics stay as they are for esp-arduino-ble-scales.
+ */
+#define BLE_STATE_FLAG_STABLE        0x01  // Weight settled
+#define BLE_STATE_FLAG_TARING        0x02  // Tare in progress, weight not meaningful
+#define BLE_STATE_FLAG_TIMER_RUNNING 0x04
+
+struct __attribute__((packed)) BLEScaleState {
+  int32_t weight;         // 0.01 g
+  uint32_t timer_ms;      // Shot timer
+  int16_t flow;           // 0.01 g/s, smoothed
+  uint8_t battery;        // Percent
+  uint8_t flags;          // BLE_STATE_FLAG_*
+};
+
+/**
+ * Weight broadcast
+ * 
+ * With broadcasting on, the advertisements carry the scale's weight, flow,
+ * timer, battery and flags as manufacturer specific data, refreshed at the
+ * broadcast interval, so any number of displays and loggers can follow the
+ * scale by just scanning. The name moves into the advertisement with it,
+ * the service UUID and preferred connection parameters into the scan
+ * response; the scale stays connectable. While all connection slots are
+ * taken it keeps advertising, non-connectable, for the listeners.
+ * 
+ * Off unless the firmware asks for it: scanners that only look at the
+ * advertisement for the service UUID, like esp-arduino-ble-scales, no
+ * longer find a broadcasting scale, unless they scan actively.
+ * 
+ * Legacy advertising leaves 31 bytes: flags (3), name (15) and the
+ * manufacturer data (2 + sizeof(BLEBroadcastPayload)).
+ */
+#define BLE_BROADCAST_COMPANY_ID   0xFFFF  // No company, as for tests and internal use
+#define BLE_BROADCAST_DEFAULT_MS   200     // Suggested interval when turned on
+#define BLE_BROADCAST_MIN_MS       20      // Shortest advertising interval
+
+struct __attribute__((packed)) BLEBroadcastPayload {
+  uint16_t company;       // BLE_BROADCAST_COMPANY_ID
+  uint8_t seq;            // Goes up with every change of the values
+  int16_t weight;         // 0.1 g
+  int16_t flow;           // 0.01 g/s
+  uint16_t timer;         // 0.1 s
+  uint8_t battery;        // Percent
+  uint8_t flags;          // BLE_STATE_FLAG_*
+};
+
+/**
+ * Weight stream packet format
+ * 
+ * The weight stream characteristic notifies batches of weight samples, as
+ * many as the configured batch size and the smallest negotiated MTU of the
+ * connected clients allow. All fields are little endian:
+ * 
+ *   uint8_t  flags      BLE_STREAM_FLAG_RAW if samples carry the raw value,
+ *                       BLE_STREAM_FLAG_CLIENT_TIME if client_time_us follows
+ *   uint8_t  count      Samples in this packet
+ *   uint16_t seq        Sequence number of the first sample, the others follow
+ *                       one by one; a gap to the previous packet is a lost batch
+ *   uint32_t time_ms    Scale uptime of the first sample
+ *   int64_t  client_time_us  The first sample in the client's timebase, only
+ *                       for a client that synchronized its clock (see time sync)
+ *   count times:
+ *     uint16_t dt_ms    Time since the previous sample, 0 for the first
+ *     float    weight   Filtered weight in grams, as on the weight characteristic
+ *     float    raw      Unfiltered weight in grams, only with BLE_STREAM_FLAG_RAW
+ * 
+ * A batch is sent when it is full or its first sample is older than the
+ * flush interval. Clients configure both by writing a BLEStreamConfig to the
+ * characteristic.
+ */
+#define BLE_STREAM_HEADER_SIZE     8
+#define BLE_STREAM_MAX_BATCH       32
+#define BLE_STREAM_DEFAULT_BATCH   10
+#define BLE_STREAM_DEFAULT_FLUSH_MS 500
+#define BLE_STREAM_FLAG_RAW        0x01
+#define BLE_STREAM_FLAG_CLIENT_TIME 0x02  // Set by the scale per client
+#define BLE_STREAM_CLIENT_TIME_SIZE 8
+
+/**
+ * Time sync
+ * 
+ * A client aligns the scale's samples with its own data through the time
+ * sync characteristic, the way NTP does:
+ * 
+ *   1. It writes PING: uint8 op, uint8 seq, uint64 t1, its clock at sending.
+ *   2. The scale notifies op | BLE_TIME_RESPONSE, seq, uint64 t2 (scale
+ *      clock when the write arrived) and uint64 t3 (scale clock when
+ *      answering), both in microseconds since boot.
+ *   3. With t4, its clock when the answer arrived, the client has the
+ *      round trip (t4 - t1) - (t3 - t2) and the offset of its clock to the
+ *      scale's ((t1 - t2) + (t4 - t3)) / 2. It keeps the exchange with the
+ *      shortest round trip out of a few and writes SET: uint8 op, uint8 seq
+ *      of that exchange, int64 offset_us, uint32 rtt_us.
+ * 
+ * The scale keeps the answer times of the last BLE_TIME_PONGS PINGs per
+ * connection and refers a SET to the one with its seq; a SET for an older
+ * or unknown seq is ignored. From SETs at least BLE_TIME_SKEW_MIN_MS apart
+ * it estimates the drift between the two clocks, so the client's time of a
+ * sample stays right between syncs. An offset that moved more than 1000 ppm
+ * of the baseline is a jump of the client's clock, not drift: it restarts
+ * the baseline and keeps the drift. Weight stream packets to the client carry that time from then on,
+ * and reading the characteristic returns the client's BLETimeSyncState.
+ * Repeating the exchange every few seconds tracks the drift; the round trip
+ * tells the client how old a notification is when it arrives.
+ */
+#define BLE_TIME_OP_PING      0x01
+#define BLE_TIME_OP_SET       0x02
+#define BLE_TIME_RESPONSE     0x80
+#define BLE_TIME_SKEW_MIN_MS  10000   // Shorter baselines are dominated by the round trip jitter
+#define BLE_TIME_PONGS        8       // PING answers a SET can refer to
+#define BLE_TIME_MAX_OFFSET_US (1LL << 61) // Larger offsets are rejected, ~73000 years
+
+struct __attribute__((packed)) BLETimeSyncState {
+  int64_t offset_us;      // Client clock minus scale clock at ref_us
+  int64_t ref_us;         // Scale clock the offset was measured at
+  int32_t skew_ppb;       // Client clock drift against the scale's, parts per billion
+  uint32_t rtt_us;        // Round trip of the exchange behind the offset
+  uint8_t synced;         // 0 until the client's first SET
+};
+
+/**
+ * Weight notification policy
+ * 
+ * The weight characteristic is not notified on every sample: a change
+ * smaller than the deadband waits for the keep-alive, and notifications are
+ * never closer together than the minimum interval. State changes (tare
+ * done, weight settled, timer started or stopped) are sent right away.
+ * 
+ * The policy runs for each connected client on its own: every client has
+ * its interval, its last sent weight and its backoff. A client on the
+ * phone parameters (see connection tuning) gets BLE_WEIGHT_PHONE_INTERVAL_MS
+ * unless it writes a BLEClientConfig with an interval of its own. When
+ * NimBLE reports failed notifications to a client (no buffers, congested
+ * link), that client's interval is stretched up to the maximum backoff and
+ * shrinks again as notifications get through; the others are not affected.
+ */
+#define BLE_WEIGHT_MIN_INTERVAL_MS 100    // At most 10 notifications per second
+#define BLE_WEIGHT_PHONE_INTERVAL_MS 250  // Phones redraw at 4 Hz at most anyway
+#define BLE_WEIGHT_DEADBAND_G      0.05f  // Smaller changes are noise
+#define BLE_WEIGHT_KEEPALIVE_MS    1000   // Unchanged weight is still sent this often
+#define BLE_WEIGHT_MAX_BACKOFF_MS  2000
+#define BLE_WEIGHT_STABLE_MS       1000   // Within the deadband this long counts as settled
+
+/**
+ * Per client settings, written by a client as 2 bytes to the client config
+ * characteristic. They apply to the connection that wrote them.
+ */
+struct __attribute__((packed)) BLEClientConfig {
+  uint16_t weight_interval_ms;  // Minimum weight and state interval, 0 for the default
+};
+
+struct BLEPublishPolicy {
+  uint16_t min_interval_ms;
+  float deadband_g;
+  uint16_t keepalive_ms;
+  uint16_t max_backoff_ms;
+};
+
+/**
+ * Connection tuning
+ * 
+ * Every central is first asked for a 7.5 - 15 ms connection interval with
+ * no peripheral latency, the 2M PHY and the longest data length, which a
+ * machine controller accepts. Phones either refuse such a short interval or
+ * ignore it; if the interval is still longer after BLE_LINK_FALLBACK_MS the
+ * scale asks for 15 - 30 ms instead, which iOS and Android accept. A
+ * central without 2M PHY or DLE support keeps 1M and 27-byte packets.
+ */
+#define BLE_LINK_MAX_CONNECTIONS  3     // CONFIG_BT_NIMBLE_MAX_CONNECTIONS, advertising goes on until reached
+#define BLE_LINK_FAST_MIN_ITVL    6     // 7.5 ms, in 1.25 ms units
+#define BLE_LINK_FAST_MAX_ITVL    12    // 15 ms
+#define BLE_LINK_PHONE_MIN_ITVL   12    // 15 ms
+#define BLE_LINK_PHONE_MAX_ITVL   24    // 30 ms
+#define BLE_LINK_TIMEOUT          400   // 4 s supervision timeout, in 10 ms units
+#define BLE_LINK_DATA_LEN         251   // LE Data Length Extension, octets per packet
+#define BLE_LINK_DATA_TIME        2120  // us to send BLE_LINK_DATA_LEN octets on 1M
+#define BLE_LINK_FALLBACK_MS      2000
+
+/**
+ * Subscriptions of a client, one bit per notifying characteristic
+ */
+#define BLE_SUB_WEIGHT         0x01
+#define BLE_SUB_TIMER          0x02
+#define BLE_SUB_STATE          0x04
+#define BLE_SUB_WEIGHT_STREAM  0x08
+#define BLE_SUB_COMMAND_STATUS 0x10
+#define BLE_SUB_HISTORY_DATA   0x20
+
+/**
+ * Link statistics of one connection
+ * 
+ * The link stats characteristic returns one of these per connection (little
+ * endian, no padding). The queueing delay is estimated from the packets of
+ * the connection NimBLE and the controller still hold when a notification is
+ * queued, one connection interval each, plus half an interval for the wait
+ * for the next connection event.
+ */
+struct __attribute__((packed)) BLELinkStats {
+  uint16_t conn_handle;
+  uint16_t interval;        // 1.25 ms units
+  uint16_t latency;         // Connection events the peripheral may skip
+  uint16_t timeout;         // 10 ms units
+  uint16_t mtu;
+  uint8_t tx_phy;           // 1 = 1M, 2 = 2M, 3 = coded
+  uint8_t rx_phy;
+  uint8_t fallback;         // 1 once the phone parameters were requested
+  uint32_t notify_sent;
+  uint32_t notify_failed;   // Not queued: no buffers, link congested
+  uint16_t queue_delay_ms;  // Estimated from the packets in flight and the interval
+  uint8_t subscriptions;    // BLE_SUB_*
+  uint16_t weight_interval_ms; // In use for this client, backoff included
+};
+
+/**
+ * Shot history transfer
+ * 
+ * Saved shots (see shot_log.h) are downloaded through two characteristics.
+ * The client writes requests to the history control point and gets the
+ * responses as notifications on it; the selected file arrives in chunks on
+ * the history data characteristic. One client transfers at a time.
+ * 
+ * Requests, little endian:
+ *   LIST                       Select the shot index: a ShotInfo per shot, oldest first
+ *   SELECT  uint16 id          Select a shot file
+ *   START   uint32 offset,     Send the selection from offset on, with up to
+ *           uint8 window       window unacknowledged chunks (0 for the default)
+ *   ACK     uint32 offset      Everything before offset arrived intact
+ *   ABORT                      Stop sending and drop the selection
+ * 
+ * Responses are op | BLE_HISTORY_RESPONSE, a BLE_HISTORY_STATUS_* byte and
+ * for LIST and SELECT a BLEHistorySelection. Once the whole selection is
+ * acknowledged, DONE is notified with a BLEHistoryDone.
+ * 
+ * A chunk is the uint32 offset of its first byte, the CRC-32 (as zlib's
+ * crc32()) of its payload and the payload, as long as the MTU allows. A
+ * client that finds a gap or a bad CRC sends START from the offset it has;
+ * without ACKs for BLE_HISTORY_ACK_TIMEOUT_MS the scale resends from the
+ * last acknowledged offset. START after a disconnect resumes the same way,
+ * as long as the same shot is selected again.
+ */
+#define BLE_HISTORY_OP_LIST        0x01
+#define BLE_HISTORY_OP_SELECT      0x02
+#define BLE_HISTORY_OP_START       0x03
+#define BLE_HISTORY_OP_ACK         0x04
+#define BLE_HISTORY_OP_ABORT       0x05
+#define BLE_HISTORY_OP_DONE        0x06  // Notified only
+#define BLE_HISTORY_RESPONSE       0x80
+
+#define BLE_HISTORY_STATUS_OK        0x00
+#define BLE_HISTORY_STATUS_NOT_FOUND 0x01
+#define BLE_HISTORY_STATUS_BUSY      0x02  // Another client is transferring
+#define BLE_HISTORY_STATUS_INVALID   0x03
+#define BLE_HISTORY_STATUS_NO_MEMORY 0x04
+
+#define BLE_HISTORY_CHUNK_HEADER   8
+#define BLE_HISTORY_DEFAULT_WINDOW 8
+#define BLE_HISTORY_MAX_WINDOW     32
+#define BLE_HISTORY_ACK_TIMEOUT_MS 1000
+#define BLE_HISTORY_RETRY_MS       10    // Wait for buffers when NimBLE has none
+
+struct __attribute__((packed)) BLEHistorySelection {
+  uint32_t size;          // Bytes
+  uint32_t crc;           // CRC-32 of the whole selection
+};
+
+struct __attribute__((packed)) BLEHistoryDone {
+  uint32_t size;          // Bytes in the selection
+  uint32_t sent;          // Bytes sent, resends included
+  uint32_t time_ms;       // From START to the last ACK
+  uint32_t bytes_per_s;   // Throughput
+};
+
+/**
+ * Weight stream configuration, written by clients as 4 bytes
+ */
+struct __attribute__((packed)) BLEStreamConfig {
+  uint8_t batch;          // Samples per notification, 1 to BLE_STREAM_MAX_BATCH
+  uint8_t flags;          // BLE_STREAM_FLAG_RAW to include raw values
+  uint16_t flush_ms;      // Longest time a sample waits for its batch
+};
 
 /**
  * Command codes for controlling the scale
  * 
  * These codes define the actions that can be triggered via BLE.
  * When a client writes one of these command values to the command characteristic,
- * the corresponding action is executed on the scale.
+ * the command is queued on the command bus (see commands.h) and executed by
+ * the main loop. An optional second byte is a sequence number of the
+ * client's choosing, returned on the command status characteristic once the
+ * command completed.
  * 
- * These codes must match those defined in client applications (esp-arduino-ble-scales library).
+ * The first four codes must match those defined in client applications
+ * (esp-arduino-ble-scales library).
  */
 enum class BLECommand : uint8_t {
   TARE = 0x01,        // Zero the scale
   START_TIMER = 0x02, // Start or resume the timer
   STOP_TIMER = 0x03,  // Pause the timer
-  RESET_TIMER = 0x04  // Reset the timer to zero
+  RESET_TIMER = 0x04, // Reset the timer to zero
+  TOGGLE_TIMER = 0x05, // Start a stopped timer, stop a running one
+  CLEAR_CHART = 0x06  // Clear the shot chart
+};
+
+/**
+ * Command acknowledgement
+ * 
+ * Notified on the command status characteristic for every command that
+ * completed, whatever its source, so clients also see a tare from the touch
+ * panel. A BLE client matches its own commands by source and sequence number.
+ */
+struct __attribute__((packed)) BLECommandAck {
+  uint8_t seq;            // As written after the command code, 0 if none
+  uint8_t command;        // BLECommand
+  uint8_t source;         // CommandSource: 0 touch, 1 BLE, 2 HTTP
+  uint8_t status;         // CommandStatus: 0 done, 1 coalesced, 3 unknown, 4 queue full
 };
 
 /**
  * Callback class for handling BLE server events
  * 
  * This class handles connection and disconnection events from client devices.
- * It maintains a connection state flag and automatically restarts advertising
- * when a client disconnects.
+ * It counts the connected clients and keeps advertising as long as another
+ * one can connect.
  */
 class EspressiScaleServerCallbacks : public NimBLEServerCallbacks {
 public:
@@ -60,26 +378,32 @@ public:
   /**
    * Called when a client connects to the server
    * 
+   * Requests the fast connection parameters, 2M PHY and data length
+   * extension, starts the link statistics and publish state of the
+   * connection and advertises again if there is room for another client.
+   * 
    * @param pServer Pointer to the NimBLEServer instance
+   * @param desc Connection descriptor of the new client
    */
-  void onConnect(NimBLEServer* pServer);
+  void onConnect(NimBLEServer* pServer, ble_gap_conn_desc* desc);
   
   /**
    * Called when a client disconnects from the server
    * 
    * @param pServer Pointer to the NimBLEServer instance
+   * @param desc Connection descriptor of the client that left
    */
-  void onDisconnect(NimBLEServer* pServer);
+  void onDisconnect(NimBLEServer* pServer, ble_gap_conn_desc* desc);
   
   /**
    * Check if a client is currently connected
    * 
-   * @return true if a client is connected, false otherwise
+   * @return true if at least one client is connected, false otherwise
    */
-  bool isConnected() const { return _connected; }
+  bool isConnected() const { return _connections > 0; }
 
 private:
-  bool _connected = false; // Connection state flag
+  uint8_t _connections = 0; // Connected clients
 };
 
 /**
@@ -104,25 +428,223 @@ public:
   void onWrite(NimBLECharacteristic* pCharacteristic);
 };
 
+/**
+ * Callback class for reads of the display stats characteristic
+ * 
+ * Fills the characteristic with a display_stats_histogram_t (see display_stats.h)
+ * of the most recent frames just before it is read, so frame time histograms
+ * can be collected from a scale in use.
+ */
+class DisplayStatsCallbacks : public NimBLECharacteristicCallbacks {
+public:
+  /**
+   * Called when a client reads the display stats characteristic
+   * 
+   * @param pCharacteristic Pointer to the NimBLECharacteristic instance
+   */
+  void onRead(NimBLECharacteristic* pCharacteristic);
+};
+
+/**
+ * Callback class for the notifying characteristics
+ * 
+ * Records which clients subscribed to the characteristic, so the weight
+ * and state are only sent to the clients that want them.
+ */
+class SubscriptionCallbacks : public NimBLECharacteristicCallbacks {
+public:
+  /**
+   * Constructor
+   * 
+   * @param bit The characteristic's BLE_SUB_* bit
+   */
+  explicit SubscriptionCallbacks(uint8_t bit) : _bit(bit) {}
+
+  /**
+   * Called when a client changes its subscription
+   * 
+   * @param pCharacteristic Pointer to the NimBLECharacteristic instance
+   * @param desc Connection descriptor of the client
+   * @param subValue 0 unsubscribed, 1 notifications, 2 indications, 3 both
+   */
+  void onSubscribe(NimBLECharacteristic* pCharacteristic, ble_gap_conn_desc* desc, uint16_t subValue);
+
+private:
+  uint8_t _bit;
+};
+
+/**
+ * Callback class for writes of the client config characteristic
+ * 
+ * Takes a BLEClientConfig for the connection that wrote it.
+ */
+class ClientConfigCallbacks : public NimBLECharacteristicCallbacks {
+public:
+  /**
+   * Called when a client writes its configuration
+   * 
+   * @param pCharacteristic Pointer to the NimBLECharacteristic instance
+   * @param desc Connection descriptor of the client
+   */
+  void onWrite(NimBLECharacteristic* pCharacteristic, ble_gap_conn_desc* desc);
+};
+
+/**
+ * Callback class for reads of the link stats characteristic
+ * 
+ * Fills the characteristic with a BLELinkStats per connected client.
+ */
+class LinkStatsCallbacks : public NimBLECharacteristicCallbacks {
+public:
+  /**
+   * Called when a client reads the link stats characteristic
+   * 
+   * @param pCharacteristic Pointer to the NimBLECharacteristic instance
+   */
+  void onRead(NimBLECharacteristic* pCharacteristic);
+};
+
+/**
+ * Callback class for writes of the history control point
+ * 
+ * Parses the request and hands it to the history transfer task.
+ */
+class HistoryControlCallbacks : public NimBLECharacteristicCallbacks {
+public:
+  /**
+   * Called when a client writes a history request
+   * 
+   * @param pCharacteristic Pointer to the NimBLECharacteristic instance
+   * @param desc Connection descriptor of the client
+   */
+  void onWrite(NimBLECharacteristic* pCharacteristic, ble_gap_conn_desc* desc);
+};
+
+/**
+ * Callback class for the time sync characteristic
+ * 
+ * Answers PINGs, keeps the offset and drift of each client's clock from its
+ * SETs and returns them on reads.
+ */
+class TimeSyncCallbacks : public NimBLECharacteristicCallbacks {
+public:
+  /**
+   * Called when a client writes a PING or SET
+   * 
+   * @param pCharacteristic Pointer to the NimBLECharacteristic instance
+   * @param desc Connection descriptor of the client
+   */
+  void onWrite(NimBLECharacteristic* pCharacteristic, ble_gap_conn_desc* desc);
+
+  /**
+   * Called when a client reads its time sync state
+   * 
+   * @param pCharacteristic Pointer to the NimBLECharacteristic instance
+   * @param desc Connection descriptor of the client
+   */
+  void onRead(NimBLECharacteristic* pCharacteristic, ble_gap_conn_desc* desc);
+};
+
+/**
+ * Callback class for writes of the weight stream characteristic
+ * 
+ * Takes a BLEStreamConfig and applies it from the next batch on.
+ */
+class WeightStreamCallbacks : public SubscriptionCallbacks {
+public:
+  /**
+   * Constructor
+   */
+  WeightStreamCallbacks() : SubscriptionCallbacks(BLE_SUB_WEIGHT_STREAM) {}
+
+  /**
+   * Called when a client writes the weight stream configuration
+   * 
+   * @param pCharacteristic Pointer to the NimBLECharacteristic instance
+   */
+  void onWrite(NimBLECharacteristic* pCharacteristic);
+};
+
 /**
  * Initialize the BLE service for EspressiScale
  * 
  * This function sets up the BLE server, creates the service and characteristics,
  * initializes callbacks, and starts advertising.
  * It should be called once during application startup.
+ * 
+ * @param broadcastMs Weight broadcast interval in milliseconds, 0 for none
+ */
+void setupBLE(uint16_t broadcastMs = 0);
+
+/**
+ * Switch the weight broadcast on, off or to another interval
+ * 
+ * @param intervalMs Refresh and advertising interval in milliseconds, 0 to stop broadcasting
  */
-void setupBLE();
+void setBLEBroadcast(uint16_t intervalMs);
 
 /**
  * Update the weight characteristic with a new value
  * 
- * This function sends the current weight to connected clients by
- * updating the characteristic value and sending a notification.
+ * This function offers the current weight to connected clients. It is
+ * notified to each subscribed client, together with the state, when that
+ * client's publish policy says so: a change beyond the deadband, the
+ * keep-alive, a state change or the weight settling.
  * 
  * @param weight Current weight in grams
  */
 void updateBLEWeight(float weight);
 
+/**
+ * Update the non-weight fields of the state characteristic
+ * 
+ * They go out with the next weight notification. A change of the timer or
+ * tare state makes that happen right away.
+ * 
+ * @param timer_ms Shot timer in milliseconds
+ * @param timer_running Whether the timer runs
+ * @param taring Whether a tare is in progress
+ * @param battery Battery level in percent
+ */
+void updateBLEState(uint32_t timer_ms, bool timer_running, bool taring, uint8_t battery);
+
+/**
+ * Send the next weight right away, whatever the publish policy
+ * 
+ * Called on state changes clients want to see without delay, such as a
+ * finished tare or the timer starting or stopping. Safe from any task.
+ */
+void flagBLEStateChange();
+
+/**
+ * Replace the weight publish policy
+ * 
+ * @param policy Rate limit, deadband, keep-alive and maximum backoff
+ */
+void setBLEPublishPolicy(const BLEPublishPolicy& policy);
+
+/**
+ * Add a weight sample to the weight stream
+ * 
+ * Timestamps and numbers the sample and appends it to the current batch,
+ * which is notified once it is full or older than the flush interval.
+ * 
+ * @param weight Filtered weight in grams
+ * @param raw Unfiltered weight in grams, sent if the client asked for it
+ */
+void streamBLESample(float weight, float raw);
+
+/**
+ * Acknowledge a finished command on the command status characteristic
+ * 
+ * Registered as the command bus acknowledgement handler. Safe from any task:
+ * every ack is notified from its own copy, never from the shared value.
+ * 
+ * @param req The command, its source and sequence number
+ * @param status How it ended
+ */
+void ackBLECommand(const CommandRequest& req, CommandStatus status);
+
 /**
  * Update the timer characteristic with a new value
  * 
@@ -137,6 +659,7 @@ void updateBLETimer(float timer);
  * Process any BLE-related tasks that need to be handled in the main loop
  * 
  * This function should be called regularly in the main application loop
- * to handle any BLE tasks that need periodic attention.
+ * to handle any BLE tasks that need periodic attention, such as sending a
+ * weight stream batch whose flush interval ran out.
  */
 void processBLE(); 
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Command bus
+ *
+ * Touch gestures, BLE writes and HTTP requests don't act on the scale
+ * themselves. They post a command here, from whatever task they run on,
+ * into lock-free queues, and loop() applies them one by one through the
+ * handler main.cpp registers. The timer state is then only ever touched by
+ * loop(), and the NimBLE and web server tasks never block on a tare.
+ *
+ * Timer commands go ahead of the others (tare, clearing the chart) so the
+ * timer starts and stops at the moment it was asked to. Within a priority
+ * commands run in the order they were posted, and a command identical to
+ * the one before it is coalesced into it. Every command is acknowledged
+ * with its source and sequence number once done; BLE clients get that on
+ * the command status characteristic.
+ */
+#define COMMAND_QUEUE_LEN 16    // Per priority, a power of two
+
+enum class Command : uint8_t {
+  TARE = 0x01,          // Same codes as BLECommand
+  START_TIMER = 0x02,
+  STOP_TIMER = 0x03,
+  RESET_TIMER = 0x04,
+  TOGGLE_TIMER = 0x05,
+  CLEAR_CHART = 0x06
+};
+
+enum class CommandSource : uint8_t {
+  TOUCH,
+  BLE,
+  HTTP
+};
+
+enum class CommandStatus : uint8_t {
+  DONE = 0x00,
+  COALESCED = 0x01,     // Folded into an identical command just before it
+  PENDING = 0x02,       // Still running (a tare), acknowledged by finishCommand()
+  UNKNOWN = 0x03,       // Not a command this firmware knows
+  QUEUE_FULL = 0x04     // Dropped, not executed
+};
+
+struct CommandRequest {
+  Command command;
+  CommandSource source;
+  uint8_t seq;          // Chosen by the producer, returned in the acknowledgement
+  uint32_t time;        // millis() of the action that asked for it, e.g. the tap
+};
+
+typedef CommandStatus (*CommandHandler)(const CommandRequest &req);
+typedef void (*CommandAckHandler)(const CommandRequest &req, CommandStatus status);
+
+void setCommandHandler(CommandHandler handler);
+void setCommandAckHandler(CommandAckHandler handler);
+// Any task; acknowledges QUEUE_FULL itself. time 0 is now.
+bool postCommand(Command command, CommandSource source, uint8_t seq = 0, uint32_t time = 0);
+void processCommands();                                                 // loop() only
+void finishCommand(const CommandRequest &req, CommandStatus status);    // Ends a PENDING command, any task
+
+const char *commandName(Command command);           // "tare", "start", ... as in /command?c=
+bool parseCommand(const char *name, Command *command);
+const char *commandSourceName(CommandSource source);
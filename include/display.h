@@ -0,0 +1,14 @@
+#pragma once
+#include "lvgl.h"
+#include "jd9613.h"
+
+// The two JD9613 panels are mounted side by side and driven as one
+// landscape LVGL display. TFT_CS_0 shows the right half, TFT_CS_1 the left.
+#define DISPLAY_HOR_RES (TFT_HEIGHT * 2)
+#define DISPLAY_VER_RES TFT_WIDTH
+
+void my_disp_flush(lv_disp_drv_t *disp, const lv_area_t *area, lv_color_t *color_p);
+
+// Forget what the panels show so the next flush sends every block. Call this
+// after anything other than my_disp_flush() has written to the panels.
+void display_invalidate_panels(void);
@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Display power management
+ *
+ * After a short idle period the panels are dimmed through the brightness
+ * register, then put into sleep-in (display off, RAM retained) while
+ * weighing, BLE and touch keep running. Touch or a weight change brings
+ * them back to full brightness within a few milliseconds.
+ */
+#define DISPLAY_DIM_TIMEOUT_MS   30000  // Idle time before dimming
+#define DISPLAY_SLEEP_TIMEOUT_MS 60000  // Idle time before sleep-in
+#define DISPLAY_BRIGHTNESS_FULL  0xff
+#define DISPLAY_BRIGHTNESS_DIM   0x30
+
+enum class DisplayPowerState : uint8_t {
+  ACTIVE,   // Full brightness, LVGL refreshing
+  DIMMED,   // Reduced brightness, LVGL refreshing
+  SLEEPING  // Panels in sleep-in, LVGL refresh stopped
+};
+
+void setupDisplayPower();
+void wakeDisplay();                   // Activity seen: return to full brightness
+void updateDisplayPower(bool busy);   // Call every loop; busy (e.g. timer running) counts as activity
+void sleepDisplay();                  // Enter sleep-in right away
+DisplayPowerState getDisplayPowerState();
+bool isDisplayAwake();                // false while LVGL refresh should be skipped
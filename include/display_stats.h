@@ -0,0 +1,63 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Frame statistics of the display stack
+ *
+ * LVGL reports every step of a refresh through LV_REFR_PROFILER_CB (see
+ * lib/lv_conf.h) and my_disp_flush() reports the SPI bytes it sends. Each
+ * refresh that redrew something becomes one fixed-size record in a ring of
+ * the last DISPLAY_STATS_RECORDS frames. The ring is summarized as
+ * histograms for the serial console, the /stats web page and the BLE
+ * display stats characteristic, so frame time regressions can be seen on a
+ * scale in use without an overlay on the panels.
+ *
+ * Can be included from C (lv_refr.c).
+ */
+#define DISPLAY_STATS_RECORDS 128
+#define DISPLAY_STATS_PANELS  2
+#define DISPLAY_STATS_BUCKETS 8   // <0.5, <1, <2, <4, <8, <16, <32 and >=32 ms
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  uint32_t time_ms;                       // millis() at the start of the frame
+  uint32_t frame_us;                      // Whole refresh
+  uint32_t render_us;                     // Drawing into the frame buffer
+  uint32_t flush_us;                      // In flush_cb: diffing and SPI
+  uint32_t wait_us;                       // Waiting for the buffer or the draw unit
+  uint32_t pixels;                        // Rendered pixels
+  uint32_t bytes[DISPLAY_STATS_PANELS];   // SPI bytes sent to each panel
+  uint16_t areas;                         // Invalidated areas after joining
+  uint16_t parts;                         // Rendered parts
+} display_frame_t;
+
+// Summary of the frames in the ring. Sent as is (little endian, 82 bytes)
+// on the BLE display stats characteristic.
+typedef struct __attribute__((packed)) {
+  uint32_t max_frame_us;
+  uint32_t avg_pixels;
+  uint32_t avg_bytes[DISPLAY_STATS_PANELS];
+  uint16_t frames;
+  uint16_t frame[DISPLAY_STATS_BUCKETS];  // Frames per frame time bucket
+  uint16_t render[DISPLAY_STATS_BUCKETS];
+  uint16_t flush[DISPLAY_STATS_BUCKETS];
+  uint16_t wait[DISPLAY_STATS_BUCKETS];
+} display_stats_histogram_t;
+
+void display_stats_trace(uint8_t event, uint32_t value);  // LV_REFR_PROFILER_CB
+void display_stats_add_bytes(int panel, uint32_t bytes);  // Called by my_disp_flush()
+
+// Copy up to max records, oldest first. Returns the number copied.
+uint32_t display_stats_get_frames(display_frame_t *out, uint32_t max);
+void display_stats_get_histogram(display_stats_histogram_t *hist);
+// Histograms as text for the serial console and the web page
+size_t display_stats_format(char *buf, size_t size);
+void display_stats_reset(void);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
@@ -1,2 +1,3 @@
 float medianFilter();
+float lastRawWeight(); // Unfiltered sample behind the last medianFilter() result
 float filteredWeight;
\ No newline at end of file
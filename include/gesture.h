@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+#include "touch.h"
+
+/*
+ * Touch gesture recognizer
+ *
+ * A state machine over the touch reports (nextTouch()) and their
+ * timestamps: tap, double-tap, long-press and swipes, each tagged with the
+ * panel it started on. It never waits; loop() feeds it the queued reports
+ * and then polls it, which also ends the double-tap window of a lone tap.
+ * Panels without a double-tap action turn that off and get their taps on
+ * release. A tap's time is always its release, however late it is sent.
+ * The debounce is in the timings, a finger that lingers is not a tap.
+ */
+#define GESTURE_TAP_MAX_MS     300  // Longest press that is still a tap
+#define GESTURE_DOUBLE_TAP_MS  300  // Release of the first tap to press of the second
+#define GESTURE_LONG_PRESS_MS  800
+#define GESTURE_SWIPE_MIN_PX   40   // Shorter moves are taps or long-presses
+
+enum class GestureType : uint8_t {
+  TAP,
+  DOUBLE_TAP,
+  LONG_PRESS,   // Sent while still held
+  SWIPE_LEFT,
+  SWIPE_RIGHT,
+  SWIPE_UP,
+  SWIPE_DOWN
+};
+
+enum class GesturePanel : uint8_t {
+  LEFT,         // Timer side, TFT_CS_1
+  RIGHT         // Weight side, TFT_CS_0
+};
+
+struct Gesture {
+  GestureType type;
+  GesturePanel panel;
+  uint32_t time;    // millis() of the report that completed it
+};
+
+struct GestureTimings {
+  uint16_t tap_max_ms;
+  uint16_t double_tap_ms;
+  uint16_t long_press_ms;
+  uint16_t swipe_min_px;
+};
+
+void setGestureTimings(const GestureTimings &timings);
+void setGestureDoubleTap(GesturePanel panel, bool enabled); // On by default
+void resetGestures();                       // Forget the touch in progress, e.g. one that woke the panels
+void feedGesture(const TouchPoint &p);      // Every touch report, in order
+bool pollGesture(uint32_t now, Gesture *g); // Next recognized gesture, false if there is none
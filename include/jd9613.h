@@ -47,6 +47,7 @@ void lcd_PushColors(uint16_t  x,
                     uint16_t  high,
                     uint16_t *data);
 void lcd_PushColors(uint16_t *data, uint32_t len);
+void lcd_PushPixels(const uint16_t *data, uint32_t len);
 void lcd_PushColors(uint16_t  x,
                     uint16_t  y,
                     uint16_t  width,
@@ -61,4 +62,7 @@ void lcd_PushColors_SoftRotation(uint16_t  x,
                                  uint8_t   r);
 
 void lcd_setRotation(uint8_t r);
+// Commands below go to every panel whose chip select is low
+void lcd_setBrightness(uint8_t level);
+void lcd_sleep(bool enter); // Sleep in keeps panel RAM, sleep out takes ~5 ms
 
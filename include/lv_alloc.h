@@ -0,0 +1,92 @@
+/**
+ * @file lv_alloc.h
+ *
+ * LVGL's own heap. A TLSF pool of LV_MEM_SIZE bytes is taken from internal
+ * SRAM at boot, so LVGL objects, styles and text buffers don't compete with
+ * WiFi, NimBLE and the web server for the system heap and can't fragment it.
+ * The most frequent small sizes are served from fixed-size slabs carved out
+ * of the same pool. If the pool runs out, requests fall back to the system
+ * heap and are counted.
+ *
+ * Used as LV_MEM_CUSTOM_ALLOC/FREE/REALLOC in lv_conf.h.
+ */
+
+#ifndef LV_ALLOC_H
+#define LV_ALLOC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stddef.h>
+#include <stdint.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+#define LV_ALLOC_SLAB_CLASSES 4     /*16, 32, 64 and 128 byte slabs*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+typedef struct {
+    uint32_t pool_size;         /*Bytes of internal RAM owned by LVGL, slabs included*/
+    uint32_t used;              /*Bytes handed out, block and slab sizes*/
+    uint32_t peak;              /*Highest `used` so far*/
+    uint32_t free_biggest;      /*Largest free TLSF block*/
+    uint8_t frag_pct;           /*100 - free_biggest * 100 / free TLSF bytes*/
+    uint32_t alloc_cnt;
+    uint32_t free_cnt;
+    uint16_t slab_used[LV_ALLOC_SLAB_CLASSES];
+    uint16_t slab_peak[LV_ALLOC_SLAB_CLASSES];
+    uint16_t slab_total[LV_ALLOC_SLAB_CLASSES];
+    uint32_t fallbacks;         /*Served by the system heap because the pool was full*/
+    uint32_t failures;          /*Couldn't be served at all*/
+} lv_alloc_stats_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * Take the pool from internal RAM and set up the slabs. Call it early in
+ * setup(), before WiFi and BLE claim their buffers. The first allocation
+ * calls it too if it wasn't.
+ */
+void lv_alloc_init(void);
+
+/**
+ * Allocate memory, `malloc()` replacement for LVGL
+ * @param size      size in bytes
+ * @return          pointer to the memory or NULL
+ */
+void * lv_alloc_malloc(size_t size);
+
+/**
+ * Free memory from `lv_alloc_malloc()` or `lv_alloc_realloc()`
+ * @param p         pointer to the memory, may be NULL
+ */
+void lv_alloc_free(void * p);
+
+/**
+ * Resize memory, keeping its content. Slab blocks are kept while the new size fits.
+ * @param p         pointer to the memory or NULL
+ * @param size      new size in bytes
+ * @return          pointer to the memory or NULL (`p` is still valid then)
+ */
+void * lv_alloc_realloc(void * p, size_t size);
+
+/**
+ * Get the allocator statistics. Walks the TLSF pool for the fragmentation.
+ * @param stats     store the statistics here
+ */
+void lv_alloc_get_stats(lv_alloc_stats_t * stats);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*LV_ALLOC_H*/
@@ -0,0 +1,85 @@
+/**
+ * @file lv_draw_es.h
+ *
+ * EspressiScale draw context. It is LVGL's software renderer with the blend
+ * step replaced by kernels written for the scale's byte-swapped RGB565
+ * buffer. Fills store two pixels per 32-bit word, and opacity blends mix
+ * the channels of two pixels at once in 16-bit lanes of a word. Results are
+ * bit-exact with lv_draw_sw_blend_basic(). Anything the kernels don't cover
+ * (other blend modes, set_px_cb, masked images) goes to the stock path.
+ *
+ * Opaque 4 bpp glyphs with no clipping masks are drawn straight into the
+ * buffer instead of through a mask line and the blend. Each glyph shade
+ * is looked up in a 16-entry ramp of the text color mixed over the
+ * background color under it, kept until either color changes.
+ *
+ * Registered through disp_drv.draw_ctx_init/draw_ctx_deinit/draw_ctx_size.
+ */
+
+#ifndef LV_DRAW_ES_H
+#define LV_DRAW_ES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "lvgl.h"
+#include "src/draw/sw/lv_draw_sw.h"
+
+#if LV_COLOR_DEPTH != 16 || LV_COLOR_16_SWAP == 0
+#error "lv_draw_es expects LV_COLOR_DEPTH 16 with LV_COLOR_16_SWAP 1"
+#endif
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+typedef struct {
+    lv_draw_sw_ctx_t base_sw;
+
+    /*Text color over `ramp_bg` for every 4 bpp shade, filled when first used*/
+    lv_color_t ramp[16];
+    lv_color_t ramp_fg;
+    lv_color_t ramp_bg;
+    uint16_t ramp_valid;    /*Bit per valid `ramp` entry*/
+} lv_draw_es_ctx_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * Initialize the draw context: the software renderer with lv_draw_es_blend()
+ * @param drv           the display driver, unused
+ * @param draw_ctx      the draw context to initialize, `draw_ctx_size` bytes
+ */
+void lv_draw_es_ctx_init(lv_disp_drv_t * drv, lv_draw_ctx_t * draw_ctx);
+
+void lv_draw_es_ctx_deinit(lv_disp_drv_t * drv, lv_draw_ctx_t * draw_ctx);
+
+/**
+ * Blend callback of the draw context. Normal fills and unmasked image copies
+ * run on the word-parallel kernels, everything else on lv_draw_sw_blend_basic().
+ * @param draw_ctx      pointer to a draw context
+ * @param dsc           pointer to an initialized blend descriptor
+ */
+LV_ATTRIBUTE_FAST_MEM void lv_draw_es_blend(lv_draw_ctx_t * draw_ctx, const lv_draw_sw_blend_dsc_t * dsc);
+
+/**
+ * Letter callback of the draw context. Opaque 4 bpp glyphs in the normal
+ * blend mode with no masks on them are drawn here, the rest by lv_draw_sw_letter().
+ * @param draw_ctx      pointer to a draw context
+ * @param dsc           pointer to a label draw descriptor
+ * @param pos_p         left-top coordinate of the letter
+ * @param letter        the letter to draw
+ */
+LV_ATTRIBUTE_FAST_MEM void lv_draw_es_letter(lv_draw_ctx_t * draw_ctx, const lv_draw_label_dsc_t * dsc,
+                                             const lv_point_t * pos_p, uint32_t letter);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*LV_DRAW_ES_H*/
@@ -0,0 +1,98 @@
+/**
+ * @file lv_numeric.h
+ *
+ * Fixed-width numeric readout. The glyphs of a small character set are
+ * rasterized once into opaque RGB565 sprites, pre-blended against the
+ * background, and a new value only redraws and invalidates the character
+ * cells that actually changed.
+ */
+
+#ifndef LV_NUMERIC_H
+#define LV_NUMERIC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "lvgl.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+#define LV_NUMERIC_MAX_CELLS    12  /*Longest text that can be shown*/
+#define LV_NUMERIC_MAX_CHARSET  16  /*Most glyphs that can be pre-rendered*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+typedef struct {
+    char ch;
+    int8_t sprite;      /*Index into the sprites, -1: blank*/
+    lv_coord_t x;       /*Offset from the left of the content area*/
+    lv_coord_t w;
+} lv_numeric_cell_t;
+
+typedef struct {
+    lv_obj_t obj;
+    const lv_font_t * font;
+    char charset[LV_NUMERIC_MAX_CHARSET + 1];
+    lv_img_dsc_t sprites[LV_NUMERIC_MAX_CHARSET];
+    lv_color_t * sprite_buf;
+    lv_coord_t digit_w;     /*Cell width shared by '0'..'9'*/
+    lv_coord_t blank_w;     /*Cell width of characters outside the charset*/
+    lv_coord_t sprite_h;
+    lv_coord_t sprite_y;    /*First line of the font's line box kept in the sprites*/
+    lv_numeric_cell_t cells[LV_NUMERIC_MAX_CELLS];
+    uint8_t cell_cnt;
+    uint8_t max_chars;
+    lv_text_align_t align;
+} lv_numeric_t;
+
+extern const lv_obj_class_t lv_numeric_class;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * Create a numeric readout
+ * @param parent    pointer to an object, it will be the parent of the new readout
+ * @return          pointer to the created readout
+ */
+lv_obj_t * lv_numeric_create(lv_obj_t * parent);
+
+/**
+ * Set the font and the characters to pre-render. The sprites are blended
+ * with the current text color over the first opaque background found on
+ * the object or its parents, so set those styles first; they are rebuilt
+ * when the styles change. The object is resized to hold `max_chars` digits.
+ * @param obj       pointer to a numeric readout
+ * @param font      font to rasterize the glyphs from
+ * @param charset   characters to pre-render, e.g. "0123456789.- g"
+ * @param max_chars longest text that will be shown (at most LV_NUMERIC_MAX_CELLS)
+ */
+void lv_numeric_set_font(lv_obj_t * obj, const lv_font_t * font, const char * charset, uint8_t max_chars);
+
+/**
+ * Show a new text. Only cells whose character or position changed are invalidated.
+ * Characters missing from the charset are shown as blank cells.
+ * @param obj       pointer to a numeric readout
+ * @param text      the new text
+ */
+void lv_numeric_set_text(lv_obj_t * obj, const char * text);
+
+/**
+ * Align the text inside the object
+ * @param obj       pointer to a numeric readout
+ * @param align     LV_TEXT_ALIGN_LEFT or LV_TEXT_ALIGN_RIGHT
+ */
+void lv_numeric_set_align(lv_obj_t * obj, lv_text_align_t align);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*LV_NUMERIC_H*/
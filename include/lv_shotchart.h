@@ -0,0 +1,117 @@
+/**
+ * @file lv_shotchart.h
+ *
+ * Sweep-mode chart for live shot curves. Every series lives in a ring
+ * buffer with one point per column. New points are written at a cursor
+ * that wraps around, like a patient monitor, so appending only redraws
+ * the cursor column and the erase gap in front of it instead of
+ * scrolling and re-plotting the whole plot.
+ */
+
+#ifndef LV_SHOTCHART_H
+#define LV_SHOTCHART_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "lvgl.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+#define LV_SHOTCHART_MAX_SERIES 2
+#define LV_SHOTCHART_GAP        6           /*Cleared columns in front of the cursor*/
+#define LV_SHOTCHART_LINE_WIDTH 2
+#define LV_SHOTCHART_POINT_NONE INT16_MIN
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+typedef struct {
+    lv_color_t color;
+    int16_t min;
+    int16_t max;
+    int16_t init_min;       /*Range set by lv_shotchart_set_range, restored by clear*/
+    int16_t init_max;
+    int16_t * points;       /*One per column, LV_SHOTCHART_POINT_NONE: empty*/
+} lv_shotchart_series_t;
+
+typedef struct {
+    lv_obj_t obj;
+    lv_shotchart_series_t series[LV_SHOTCHART_MAX_SERIES];
+    int16_t * point_buf;
+    uint16_t point_cnt;     /*Columns of the content area*/
+    uint16_t cursor;        /*Column of the next point*/
+    uint8_t series_cnt;
+    uint32_t rescale_cnt;
+} lv_shotchart_t;
+
+extern const lv_obj_class_t lv_shotchart_class;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * Create a shot chart
+ * @param parent    pointer to an object, it will be the parent of the new chart
+ * @return          pointer to the created chart
+ */
+lv_obj_t * lv_shotchart_create(lv_obj_t * parent);
+
+/**
+ * Set the number of series. Clears the chart.
+ * @param obj       pointer to a chart
+ * @param cnt       number of series (at most LV_SHOTCHART_MAX_SERIES)
+ */
+void lv_shotchart_set_series_count(lv_obj_t * obj, uint8_t cnt);
+
+/**
+ * Set the color of a series
+ * @param obj       pointer to a chart
+ * @param id        index of the series
+ * @param color     line color
+ */
+void lv_shotchart_set_series_color(lv_obj_t * obj, uint8_t id, lv_color_t color);
+
+/**
+ * Set the initial value range of a series. The range only grows while
+ * points are added, with some headroom so it rarely has to grow again,
+ * and goes back to this one when the chart is cleared.
+ * @param obj       pointer to a chart
+ * @param id        index of the series
+ * @param min       value at the bottom
+ * @param max       value at the top
+ */
+void lv_shotchart_set_range(lv_obj_t * obj, uint8_t id, int16_t min, int16_t max);
+
+/**
+ * Add a point to every series at the cursor and move the cursor on.
+ * @param obj       pointer to a chart
+ * @param values    one value per series
+ */
+void lv_shotchart_append(lv_obj_t * obj, const int16_t * values);
+
+/**
+ * Remove every point, move the cursor back to the left and restore the
+ * initial ranges
+ * @param obj       pointer to a chart
+ */
+void lv_shotchart_clear(lv_obj_t * obj);
+
+/**
+ * Get how many times a range had to grow, each one redraws the whole chart
+ * @param obj       pointer to a chart
+ * @return          number of rescales since the chart was created
+ */
+uint32_t lv_shotchart_get_rescale_count(const lv_obj_t * obj);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*LV_SHOTCHART_H*/
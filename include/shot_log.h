@@ -0,0 +1,55 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Shot history
+ *
+ * Every shot, from starting the timer to stopping it, is recorded at 10 Hz
+ * and saved as one file in /shots on the LittleFS partition when the timer
+ * stops. The partition holds about SHOT_LOG_MAX shots, the oldest are
+ * deleted to make room. Shots are numbered from 1 up, the number never
+ * goes back, so a client that downloaded up to some id only needs the newer
+ * ones.
+ *
+ * A shot file is a ShotHeader followed by `samples` ShotSample records,
+ * all little endian without padding, and is sent as is over BLE.
+ */
+#define SHOT_LOG_MAX          24      // Shots kept, about a day of them
+#define SHOT_LOG_SAMPLE_MS    100
+#define SHOT_LOG_MAX_SAMPLES  1800    // 3 minutes, longer shots are cut
+#define SHOT_LOG_MIN_SAMPLES  30      // Shorter timer runs are not shots
+#define SHOT_LOG_MAGIC        0x544f4853  // "SHOT"
+#define SHOT_LOG_VERSION      1
+
+struct __attribute__((packed)) ShotHeader {
+  uint32_t magic;         // SHOT_LOG_MAGIC
+  uint8_t version;        // SHOT_LOG_VERSION
+  uint8_t sample_ms;      // SHOT_LOG_SAMPLE_MS
+  uint16_t id;
+  uint32_t start_time;    // Unix time, 0 if the clock was not set
+  uint32_t duration_ms;   // Timer run
+  uint16_t samples;
+  int16_t final_weight;   // 0.1 g, when the timer stopped
+};
+
+struct __attribute__((packed)) ShotSample {
+  int16_t weight;         // 0.1 g
+  int16_t flow;           // 0.01 g/s, smoothed
+};
+
+// One entry of the shot index, as listShots() returns it
+struct __attribute__((packed)) ShotInfo {
+  uint16_t id;
+  uint32_t start_time;
+  uint32_t duration_ms;
+  uint16_t samples;
+  uint32_t size;          // File size in bytes
+};
+
+bool setupShotLog();                          // Mounts LittleFS, formats it if it can't
+void startShot();                             // The timer started
+void sampleShot(float weight);                // Every loop while the timer runs, records at 10 Hz
+void endShot();                               // The timer stopped: writes the shot, loop() only
+size_t listShots(ShotInfo *out, size_t max);  // Oldest first, any task
+uint8_t *loadShot(uint16_t id, size_t *size); // Whole file in PSRAM, free() it; nullptr if there is none
@@ -0,0 +1,26 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Touch service
+ *
+ * The CST820 pulls PIN_TOUCH_INT low with every report, so the controller is
+ * only read after an interrupt, in one burst of the touch count and first
+ * point registers on a 400 kHz bus. There is a single reader: the UI task,
+ * woken by the interrupt, through LVGL's input device. Everything else gets
+ * the decoded points without touching the bus: the latest one from
+ * getTouch(), or every report in order from nextTouch() for the gesture
+ * recognizer (gesture.h).
+ */
+struct TouchPoint {
+  int16_t x;          // Screen coordinates, the black gap between the panels removed
+  int16_t y;
+  bool pressed;
+  bool in_gap;        // Finger on the black gap between the panels
+  uint32_t time;      // millis() of the report
+};
+
+void setupTouch();      // After Wire and the display driver, registers the LVGL input device
+bool readTouch();       // Reads the controller if it raised its interrupt; UI task only. Returns pressed.
+TouchPoint getTouch();  // Latest point, from any task
+bool nextTouch(TouchPoint *p);  // Next queued report for loop(), false if there is none
@@ -0,0 +1,16 @@
+#pragma once
+
+/*
+ * The scale's screen
+ *
+ * Weight readout on the right, shot timer on the left and the shot chart
+ * along the bottom of both panels. setupUI() builds it on the active screen
+ * once LVGL and the display driver are registered; the firmware and the
+ * host ui_bench then only push values in, so both render the same widgets.
+ */
+void setupUI();
+void updateUIWeight(float weight);  // Grams, shown with one decimal
+void updateUITimer(int seconds);
+void sampleUIChart(float weight);   // Call every loop while the timer runs, plots at 10 Hz
+void clearUIChart();
+void showUILowBattery();            // Replaces the weight with a low battery message
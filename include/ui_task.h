@@ -0,0 +1,21 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * LVGL runs in its own task. It sleeps on a task notification until the
+ * next LVGL timer is due, or until loop() has pushed new values into the UI
+ * or a touch came in, so there is no fixed poll and no wakeups while
+ * nothing moves. The display refresh timer is paused while nothing is
+ * invalidated and kicked right away when something is.
+ *
+ * LVGL is not thread safe: anything outside the UI task that calls into it
+ * (the ui.h functions included) does so between lockUI() and unlockUI().
+ */
+#define UI_WAKE_DATA  (1 << 0)  // New weight, timer or state in the UI
+#define UI_WAKE_TOUCH (1 << 1)  // Touch interrupt, see touch.h
+
+void startUITask();
+void wakeUITask(uint32_t reason);
+void wakeUITaskFromISR(uint32_t reason);
+void lockUI();
+void unlockUI();
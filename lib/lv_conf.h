@@ -60,10 +60,15 @@
 #endif
 
 #else       /*LV_MEM_CUSTOM*/
-#define LV_MEM_CUSTOM_INCLUDE <stdlib.h>   /*Header for the dynamic memory function*/
-#define LV_MEM_CUSTOM_ALLOC   malloc
-#define LV_MEM_CUSTOM_FREE    free
-#define LV_MEM_CUSTOM_REALLOC realloc
+/*LVGL's own TLSF pool and slabs in internal RAM, see include/lv_alloc.h*/
+#define LV_MEM_CUSTOM_INCLUDE "lv_alloc.h"   /*Header for the dynamic memory function*/
+#define LV_MEM_CUSTOM_ALLOC   lv_alloc_malloc
+#define LV_MEM_CUSTOM_FREE    lv_alloc_free
+#define LV_MEM_CUSTOM_REALLOC lv_alloc_realloc
+
+/*Build lv_tlsf for the custom allocator too. LV_MEM_SIZE is then the size of its pool*/
+#define LV_MEM_CUSTOM_TLSF 1
+#define LV_MEM_SIZE (96U * 1024U)          /*[bytes]*/
 #endif     /*LV_MEM_CUSTOM*/
 
 /*Number of the intermediate memory buffer used during rendering and other internal processing mechanisms.
@@ -251,6 +256,14 @@ e.g. "stm32f769xx.h" or "stm32f429xx.h"*/
 #define LV_USE_PERF_MONITOR_POS LV_ALIGN_BOTTOM_RIGHT
 #endif
 
+/*1: Call LV_REFR_PROFILER_CB(event, value) at every step of a refresh (see `lv_refr_profiler_event_t`)
+ *to time rendering, waiting and flushing without drawing anything on the screen*/
+#define LV_USE_REFR_PROFILER 1
+#if LV_USE_REFR_PROFILER
+#define LV_REFR_PROFILER_INCLUDE "display_stats.h"
+#define LV_REFR_PROFILER_CB(event, value) display_stats_trace(event, value)
+#endif
+
 /*1: Show the used memory and the memory fragmentation
  * Requires LV_MEM_CUSTOM = 0*/
 #define LV_USE_MEM_MONITOR 0
@@ -376,6 +389,11 @@ e.g. "stm32f769xx.h" or "stm32f429xx.h"*/
 /*Enables/disables support for compressed fonts.*/
 #define LV_USE_FONT_COMPRESSED 0
 
+/*Number of entries in the glyph lookup cache shared by the built-in font format.
+ *It keeps the resolved glyph id and descriptor (with kerning) per (font, letter).
+ *Must be a power of 2 (it is 2-way set associative). 0: disable the cache*/
+#define LV_FONT_FMT_TXT_CACHE_SIZE 64
+
 /*Enable subpixel rendering*/
 #define LV_USE_FONT_SUBPX 0
 #if LV_USE_FONT_SUBPX
@@ -22,6 +22,10 @@
     #include "../widgets/lv_label.h"
 #endif
 
+#if LV_USE_REFR_PROFILER
+    #include LV_REFR_PROFILER_INCLUDE
+#endif
+
 /*********************
  *      DEFINES
  *********************/
@@ -90,6 +94,12 @@ static lv_disp_t * disp_refr; /*Display being refreshed*/
     #define REFR_TRACE(...)
 #endif
 
+#if LV_USE_REFR_PROFILER
+    #define REFR_PROFILE(event, value) LV_REFR_PROFILER_CB(event, value)
+#else
+    #define REFR_PROFILE(event, value)
+#endif
+
 /**********************
  *   GLOBAL FUNCTIONS
  **********************/
@@ -323,6 +333,17 @@ void _lv_disp_refr_timer(lv_timer_t * tmr)
 
     lv_refr_join_area();
 
+#if LV_USE_REFR_PROFILER
+    if(disp_refr->inv_p != 0) {
+        uint32_t area_cnt = 0;
+        uint16_t i;
+        for(i = 0; i < disp_refr->inv_p; i++) {
+            if(disp_refr->inv_area_joined[i] == 0) area_cnt++;
+        }
+        REFR_PROFILE(LV_REFR_PROFILER_FRAME_START, area_cnt);
+    }
+#endif
+
     lv_refr_areas();
 
     /*If refresh happened ...*/
@@ -339,6 +360,8 @@ void _lv_disp_refr_timer(lv_timer_t * tmr)
         lv_memset_00(disp_refr->inv_area_joined, sizeof(disp_refr->inv_area_joined));
         disp_refr->inv_p = 0;
 
+        REFR_PROFILE(LV_REFR_PROFILER_FRAME_END, px_num);
+
         elaps = lv_tick_elaps(start);
         /*Call monitor cb if present*/
         if(disp_refr->driver->monitor_cb) {
@@ -621,11 +644,15 @@ static void lv_refr_area_part(lv_draw_ctx_t * draw_ctx)
     /* Below the `area_p` area will be redrawn into the draw buffer.
      * In single buffered mode wait here until the buffer is freed.*/
     if(draw_buf->buf1 && !draw_buf->buf2) {
+        REFR_PROFILE(LV_REFR_PROFILER_WAIT_START, 0);
         while(draw_buf->flushing) {
             if(disp_refr->driver->wait_cb) disp_refr->driver->wait_cb(disp_refr->driver);
         }
+        REFR_PROFILE(LV_REFR_PROFILER_WAIT_END, 0);
     }
 
+    REFR_PROFILE(LV_REFR_PROFILER_PART_START, lv_area_get_size(draw_ctx->clip_area));
+
     lv_obj_t * top_act_scr = NULL;
     lv_obj_t * top_prev_scr = NULL;
 
@@ -696,6 +723,8 @@ static void lv_refr_area_part(lv_draw_ctx_t * draw_ctx)
     lv_refr_obj_and_children(draw_ctx, lv_disp_get_layer_top(disp_refr));
     lv_refr_obj_and_children(draw_ctx, lv_disp_get_layer_sys(disp_refr));
 
+    REFR_PROFILE(LV_REFR_PROFILER_PART_END, 0);
+
     /*In true double buffered mode flush only once when all areas were rendered.
      *In normal mode flush after every area*/
     if(disp_refr->driver->full_refresh == false) {
@@ -1019,6 +1048,7 @@ static void draw_buf_flush(lv_disp_t * disp)
 
     /*Flush the rendered content to the display*/
     lv_draw_ctx_t * draw_ctx = disp->driver->draw_ctx;
+    REFR_PROFILE(LV_REFR_PROFILER_WAIT_START, 0);
     if(draw_ctx->wait_for_finish) draw_ctx->wait_for_finish(draw_ctx);
 
     /* In double buffered mode wait until the other buffer is freed
@@ -1028,6 +1058,7 @@ static void draw_buf_flush(lv_disp_t * disp)
             if(disp_refr->driver->wait_cb) disp_refr->driver->wait_cb(disp_refr->driver);
         }
     }
+    REFR_PROFILE(LV_REFR_PROFILER_WAIT_END, 0);
 
     draw_buf->flushing = 1;
 
@@ -1037,6 +1068,7 @@ static void draw_buf_flush(lv_disp_t * disp)
     bool flushing_last = draw_buf->flushing_last;
 
     if(disp->driver->flush_cb) {
+        REFR_PROFILE(LV_REFR_PROFILER_FLUSH_START, 0);
         /*Rotate the buffer to the display's native orientation if necessary*/
         if(disp->driver->rotated != LV_DISP_ROT_NONE && disp->driver->sw_rotate) {
             draw_buf_rotate(draw_ctx->buf_area, draw_ctx->buf);
@@ -1044,6 +1076,7 @@ static void draw_buf_flush(lv_disp_t * disp)
         else {
             call_flush_cb(disp->driver, draw_ctx->buf_area, draw_ctx->buf);
         }
+        REFR_PROFILE(LV_REFR_PROFILER_FLUSH_END, 0);
     }
     /*If there are 2 buffers swap them. With direct mode swap only on the last area*/
     if(draw_buf->buf1 && draw_buf->buf2 && (!disp->driver->direct_mode || flushing_last)) {
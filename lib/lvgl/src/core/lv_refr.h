@@ -26,6 +26,23 @@ extern "C" {
  *      TYPEDEFS
  **********************/
 
+/**
+ * Steps of a refresh reported to `LV_REFR_PROFILER_CB(event, value)` if `LV_USE_REFR_PROFILER` is enabled.
+ * A frame is FRAME_START, then PART_START/PART_END for every rendered part with the waits and flushes
+ * in between, then FRAME_END. Refreshes with nothing invalidated are not reported.
+ */
+enum {
+    LV_REFR_PROFILER_FRAME_START,   /**< value: number of areas to redraw after joining*/
+    LV_REFR_PROFILER_PART_START,    /**< value: pixels to render in the part*/
+    LV_REFR_PROFILER_PART_END,
+    LV_REFR_PROFILER_WAIT_START,    /**< Waiting for the draw buffer or the GPU*/
+    LV_REFR_PROFILER_WAIT_END,
+    LV_REFR_PROFILER_FLUSH_START,   /**< `flush_cb` called*/
+    LV_REFR_PROFILER_FLUSH_END,
+    LV_REFR_PROFILER_FRAME_END,     /**< value: pixels redrawn in the frame*/
+};
+typedef uint8_t lv_refr_profiler_event_t;
+
 /**********************
  *  STATIC PROTOTYPES
  **********************/
@@ -22,6 +22,16 @@
 /**********************
  *      TYPEDEFS
  **********************/
+#if LV_FONT_FMT_TXT_CACHE_SIZE
+typedef struct {
+    const lv_font_t * font;
+    uint32_t letter;
+    uint32_t letter_next;       /*`dsc` includes the kerning to this letter*/
+    uint32_t gid;               /*0: the letter is not in the font*/
+    lv_font_glyph_dsc_t dsc;
+} glyph_cache_entry_t;
+#endif
+
 typedef enum {
     RLE_STATE_SINGLE = 0,
     RLE_STATE_REPEATE,
@@ -37,6 +47,11 @@ static int32_t unicode_list_compare(const void * ref, const void * element);
 static int32_t kern_pair_8_compare(const void * ref, const void * element);
 static int32_t kern_pair_16_compare(const void * ref, const void * element);
 
+#if LV_FONT_FMT_TXT_CACHE_SIZE
+    static inline glyph_cache_entry_t * cache_set(const lv_font_t * font, uint32_t letter, uint32_t letter_next);
+    static uint32_t get_glyph_dsc_id_cached(const lv_font_t * font, uint32_t letter);
+#endif
+
 #if LV_USE_FONT_COMPRESSED
     static void decompress(const uint8_t * in, uint8_t * out, lv_coord_t w, lv_coord_t h, uint8_t bpp, bool prefilter);
     static inline void decompress_line(uint8_t * out, lv_coord_t w);
@@ -49,6 +64,12 @@ static int32_t kern_pair_16_compare(const void * ref, const void * element);
 /**********************
  *  STATIC VARIABLES
  **********************/
+#if LV_FONT_FMT_TXT_CACHE_SIZE
+    static glyph_cache_entry_t glyph_cache[LV_FONT_FMT_TXT_CACHE_SIZE];
+    static glyph_cache_entry_t * glyph_cache_last;   /*Usually the glyph whose bitmap is asked next*/
+    static lv_font_fmt_txt_cache_stats_t glyph_cache_stats;
+#endif
+
 #if LV_USE_FONT_COMPRESSED
     static uint32_t rle_rdp;
     static const uint8_t * rle_in;
@@ -81,7 +102,11 @@ const uint8_t * lv_font_get_bitmap_fmt_txt(const lv_font_t * font, uint32_t unic
     if(unicode_letter == '\t') unicode_letter = ' ';
 
     lv_font_fmt_txt_dsc_t * fdsc = (lv_font_fmt_txt_dsc_t *)font->dsc;
+#if LV_FONT_FMT_TXT_CACHE_SIZE
+    uint32_t gid = get_glyph_dsc_id_cached(font, unicode_letter);
+#else
     uint32_t gid = get_glyph_dsc_id(font, unicode_letter);
+#endif
     if(!gid) return NULL;
 
     const lv_font_fmt_txt_glyph_dsc_t * gdsc = &fdsc->glyph_dsc[gid];
@@ -154,8 +179,46 @@ bool lv_font_get_glyph_dsc_fmt_txt(const lv_font_t * font, lv_font_glyph_dsc_t *
         is_tab = true;
     }
     lv_font_fmt_txt_dsc_t * fdsc = (lv_font_fmt_txt_dsc_t *)font->dsc;
+
+#if LV_FONT_FMT_TXT_CACHE_SIZE
+    /*Tabs are rare and their descriptor differs from the space's, don't cache them.
+     *Without kerning the next letter doesn't matter, so all pairs share one entry.*/
+    glyph_cache_entry_t * entry = NULL;
+    if(!is_tab) {
+        if(fdsc->kern_dsc == NULL) unicode_letter_next = 0;
+        glyph_cache_entry_t * set = cache_set(font, unicode_letter, unicode_letter_next);
+        uint32_t way;
+        for(way = 0; way < 2; way++) {
+            entry = &set[way];
+            if(entry->font == font && entry->letter == unicode_letter && entry->letter_next == unicode_letter_next) {
+                glyph_cache_stats.hits++;
+                glyph_cache_last = entry;
+                if(entry->gid == 0) return false;
+                *dsc_out = entry->dsc;
+                return true;
+            }
+        }
+        glyph_cache_stats.misses++;
+
+        /*Evict the older way*/
+        set[1] = set[0];
+        entry = &set[0];
+    }
+#endif
+
     uint32_t gid = get_glyph_dsc_id(font, unicode_letter);
-    if(!gid) return false;
+    if(!gid) {
+#if LV_FONT_FMT_TXT_CACHE_SIZE
+        if(entry) {
+            entry->font = font;
+            entry->letter = unicode_letter;
+            entry->letter_next = unicode_letter_next;
+            entry->gid = 0;
+            glyph_cache_last = entry;
+        }
+#endif
+        return false;
+    }
 
     int8_t kvalue = 0;
     if(fdsc->kern_dsc) {
@@ -186,6 +249,17 @@ bool lv_font_get_glyph_dsc_fmt_txt(const lv_font_t * font, lv_font_glyph_dsc_t *
 
     if(is_tab) dsc_out->box_w = dsc_out->box_w * 2;
 
+#if LV_FONT_FMT_TXT_CACHE_SIZE
+    if(entry) {
+        entry->font = font;
+        entry->letter = unicode_letter;
+        entry->letter_next = unicode_letter_next;
+        entry->gid = gid;
+        entry->dsc = *dsc_out;
+        glyph_cache_last = entry;
+    }
+#endif
+
     return true;
 }
 
@@ -202,6 +276,28 @@ void _lv_font_clean_up_fmt_txt(void)
 #endif
 }
 
+#if LV_FONT_FMT_TXT_CACHE_SIZE
+void lv_font_fmt_txt_get_cache_stats(lv_font_fmt_txt_cache_stats_t * stats)
+{
+    *stats = glyph_cache_stats;
+}
+
+void lv_font_fmt_txt_reset_cache_stats(void)
+{
+    glyph_cache_stats.hits = 0;
+    glyph_cache_stats.misses = 0;
+}
+
+void lv_font_fmt_txt_cache_drop(const lv_font_t * font)
+{
+    uint32_t i;
+    for(i = 0; i < LV_FONT_FMT_TXT_CACHE_SIZE; i++) {
+        if(font == NULL || glyph_cache[i].font == font) glyph_cache[i].font = NULL;
+    }
+    glyph_cache_last = NULL;
+}
+#endif
+
 /**********************
  *   STATIC FUNCTIONS
  **********************/
@@ -267,6 +363,33 @@ static uint32_t get_glyph_dsc_id(const lv_font_t * font, uint32_t letter)
 
 }
 
+#if LV_FONT_FMT_TXT_CACHE_SIZE
+/**
+ * The two ways of the set a glyph belongs to. Way 0 holds the most recently added glyph.
+ */
+static inline glyph_cache_entry_t * cache_set(const lv_font_t * font, uint32_t letter, uint32_t letter_next)
+{
+    uint32_t h = (uint32_t)((lv_uintptr_t)font >> 3) ^ (letter * 0x9E3779B1u) ^ (letter_next * 0x85EBCA6Bu);
+    h ^= h >> 16;
+    return &glyph_cache[(h & (LV_FONT_FMT_TXT_CACHE_SIZE / 2 - 1)) * 2];
+}
+
+/**
+ * Glyph id of a letter for its bitmap. Drawing a letter gets its descriptor
+ * right before the bitmap, so the last used cache entry is checked.
+ */
+static uint32_t get_glyph_dsc_id_cached(const lv_font_t * font, uint32_t letter)
+{
+    glyph_cache_entry_t * entry = glyph_cache_last;
+    if(entry && entry->font == font && entry->letter == letter) {
+        glyph_cache_stats.hits++;
+        return entry->gid;
+    }
+    glyph_cache_stats.misses++;
+    return get_glyph_dsc_id(font, letter);
+}
+#endif
+
 static int8_t get_kern_value(const lv_font_t * font, uint32_t gid_left, uint32_t gid_right)
 {
     lv_font_fmt_txt_dsc_t * fdsc = (lv_font_fmt_txt_dsc_t *)font->dsc;
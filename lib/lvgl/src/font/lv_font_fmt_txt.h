@@ -156,6 +156,12 @@ typedef struct {
     uint32_t last_glyph_id;
 } lv_font_fmt_txt_glyph_cache_t;
 
+/*Lookups answered by the glyph cache (see `LV_FONT_FMT_TXT_CACHE_SIZE`)*/
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+} lv_font_fmt_txt_cache_stats_t;
+
 /*Describe store additional data for fonts*/
 typedef struct {
     /*The bitmaps of all glyphs*/
@@ -225,6 +231,25 @@ bool lv_font_get_glyph_dsc_fmt_txt(const lv_font_t * font, lv_font_glyph_dsc_t *
  */
 void _lv_font_clean_up_fmt_txt(void);
 
+#if LV_FONT_FMT_TXT_CACHE_SIZE
+/**
+ * Get the hit and miss counters of the glyph cache
+ * @param stats store the counters here
+ */
+void lv_font_fmt_txt_get_cache_stats(lv_font_fmt_txt_cache_stats_t * stats);
+
+/**
+ * Reset the hit and miss counters of the glyph cache
+ */
+void lv_font_fmt_txt_reset_cache_stats(void);
+
+/**
+ * Drop the cached glyphs of a font. Must be called before a font's memory is freed.
+ * @param font pointer to a font, NULL to drop every font
+ */
+void lv_font_fmt_txt_cache_drop(const lv_font_t * font);
+#endif
+
 /**********************
  *      MACROS
  **********************/
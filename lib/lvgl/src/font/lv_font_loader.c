@@ -117,6 +117,9 @@ lv_font_t * lv_font_load(const char * font_name)
 void lv_font_free(lv_font_t * font)
 {
     if(NULL != font) {
+#if LV_FONT_FMT_TXT_CACHE_SIZE
+        lv_font_fmt_txt_cache_drop(font);
+#endif
         lv_font_fmt_txt_dsc_t * dsc = (lv_font_fmt_txt_dsc_t *)font->dsc;
 
         if(NULL != dsc) {
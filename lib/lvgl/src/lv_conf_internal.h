@@ -174,6 +174,24 @@
             #define LV_MEM_CUSTOM_REALLOC realloc
         #endif
     #endif
+
+    /*Build lv_tlsf for the custom allocator too. LV_MEM_SIZE is then the size of its pool*/
+    #ifndef LV_MEM_CUSTOM_TLSF
+        #ifdef CONFIG_LV_MEM_CUSTOM_TLSF
+            #define LV_MEM_CUSTOM_TLSF CONFIG_LV_MEM_CUSTOM_TLSF
+        #else
+            #define LV_MEM_CUSTOM_TLSF 0
+        #endif
+    #endif
+    #if LV_MEM_CUSTOM_TLSF
+        #ifndef LV_MEM_SIZE
+            #ifdef CONFIG_LV_MEM_SIZE
+                #define LV_MEM_SIZE CONFIG_LV_MEM_SIZE
+            #else
+                #define LV_MEM_SIZE (48U * 1024U)          /*[bytes]*/
+            #endif
+        #endif
+    #endif
 #endif     /*LV_MEM_CUSTOM*/
 
 /*Number of the intermediate memory buffer used during rendering and other internal processing mechanisms.
@@ -687,6 +705,32 @@
     #endif
 #endif
 
+/*1: Call LV_REFR_PROFILER_CB(event, value) at every step of a refresh (see `lv_refr_profiler_event_t`)
+ *to time rendering, waiting and flushing without drawing anything on the screen*/
+#ifndef LV_USE_REFR_PROFILER
+    #ifdef CONFIG_LV_USE_REFR_PROFILER
+        #define LV_USE_REFR_PROFILER CONFIG_LV_USE_REFR_PROFILER
+    #else
+        #define LV_USE_REFR_PROFILER 0
+    #endif
+#endif
+#if LV_USE_REFR_PROFILER
+    #ifndef LV_REFR_PROFILER_INCLUDE
+        #ifdef CONFIG_LV_REFR_PROFILER_INCLUDE
+            #define LV_REFR_PROFILER_INCLUDE CONFIG_LV_REFR_PROFILER_INCLUDE
+        #else
+            #define LV_REFR_PROFILER_INCLUDE <stdint.h>
+        #endif
+    #endif
+    #ifndef LV_REFR_PROFILER_CB
+        #ifdef CONFIG_LV_REFR_PROFILER_CB
+            #define LV_REFR_PROFILER_CB CONFIG_LV_REFR_PROFILER_CB
+        #else
+            #define LV_REFR_PROFILER_CB(event, value)
+        #endif
+    #endif
+#endif
+
 /*1: Show the used memory and the memory fragmentation
  * Requires LV_MEM_CUSTOM = 0*/
 #ifndef LV_USE_MEM_MONITOR
@@ -1148,6 +1192,17 @@
     #endif
 #endif
 
+/*Number of entries in the glyph lookup cache shared by the built-in font format.
+ *It keeps the resolved glyph id and descriptor (with kerning) per (font, letter).
+ *Must be a power of 2 (it is 2-way set associative). 0: disable the cache*/
+#ifndef LV_FONT_FMT_TXT_CACHE_SIZE
+    #ifdef CONFIG_LV_FONT_FMT_TXT_CACHE_SIZE
+        #define LV_FONT_FMT_TXT_CACHE_SIZE CONFIG_LV_FONT_FMT_TXT_CACHE_SIZE
+    #else
+        #define LV_FONT_FMT_TXT_CACHE_SIZE 0
+    #endif
+#endif
+
 /*Enable subpixel rendering*/
 #ifndef LV_USE_FONT_SUBPX
     #ifdef CONFIG_LV_USE_FONT_SUBPX
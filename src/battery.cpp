@@ -3,6 +3,7 @@
 #define BAT_ADC    2
 
 float voltage = 0.0;
+static uint32_t millivolts = 0;
 char voltage_String[10] = "";
 uint32_t readADC_Cal(int ADC_Raw);
 
@@ -12,11 +13,19 @@ void setupBattery(){
 }
 
 float getBatteryVoltage(){
-    voltage = (readADC_Cal(analogRead(BAT_ADC))) * 2 / 1000;
+    millivolts = readADC_Cal(analogRead(BAT_ADC)) * 2;
+    voltage = millivolts / 1000;
     return voltage;
     delay(60000); // Delay for 1 minute
 }
 
+// Linear over the usable range of the LiPo cell, 3.3 V empty to 4.2 V full
+uint8_t getBatteryLevel(){
+    if (millivolts <= 3300) return 0;
+    if (millivolts >= 4200) return 100;
+    return (millivolts - 3300) * 100 / (4200 - 3300);
+}
+
 uint32_t readADC_Cal(int ADC_Raw)
 {
     esp_adc_cal_characteristics_t adc_chars;
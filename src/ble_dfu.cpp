@@ -0,0 +1,478 @@
+#include "ble_dfu.h"
+#include "arduino.h"
+#include "esp_ota_ops.h"
+#include "mbedtls/md.h"
+#include "mbedtls/pk.h"
+#if __has_include("dfu_key.h")
+#include "dfu_key.h"
+#define DFU_HAS_KEY 1
+#else
+#define DFU_HAS_KEY 0
+#endif
+
+/**
+ * BLE firmware update for EspressiScale
+ * 
+ * Two sides share the receive buffers. The NimBLE task copies the image
+ * into the buffer being filled and queues it once full; the writer task
+ * erases and programs queued buffers into the OTA partition, hashes them
+ * and puts them back in the free queue. Control point requests go through
+ * the same job queue, so the writer sees BEGIN, the data and END in order.
+ * 
+ * The NimBLE side state is only touched from NimBLE callbacks, the writer
+ * state only from the writer task. dfuFailed is the one flag both use.
+ */
+
+#define DFU_JOB_BEGIN 0
+#define DFU_JOB_WRITE 1
+#define DFU_JOB_END   2
+#define DFU_JOB_ABORT 3
+
+/**
+ * Work for the writer task
+ */
+struct DfuJob {
+  uint8_t type;    // DFU_JOB_*
+  uint8_t buffer;  // Buffer to write, DFU_JOB_WRITE only
+};
+
+struct DfuBuffer {
+  uint8_t* data;
+  size_t length;
+};
+
+NimBLECharacteristic* pDfuControlCharacteristic = nullptr;
+NimBLECharacteristic* pDfuDataCharacteristic = nullptr;
+DfuControlCallbacks* pDfuControlCallbacks = nullptr;
+DfuDataCallbacks* pDfuDataCallbacks = nullptr;
+
+static QueueHandle_t dfuJobQueue = nullptr;
+static QueueHandle_t dfuFreeQueue = nullptr;         // Indexes of empty buffers
+static DfuBuffer dfuBuffers[BLE_DFU_BUFFERS];        // Allocated by the first BEGIN, kept
+static volatile bool dfuFailed = false;              // Set by the writer, the NimBLE side stops taking data
+
+// NimBLE side
+static volatile uint16_t dfuConn = BLE_HS_CONN_HANDLE_NONE; // Client updating, none when idle
+static uint32_t dfuSize = 0;
+static uint32_t dfuReceived = 0;
+static int dfuFill = -1;                             // Buffer being filled, -1 for none
+static uint8_t dfuHash[32];                          // Expected SHA-256 of the image
+static uint8_t dfuSignature[BLE_DFU_MAX_SIGNATURE];  // Of dfuHash, checked by the writer
+static size_t dfuSignatureLength = 0;
+
+// Writer side
+static esp_ota_handle_t dfuHandle = 0;
+static bool dfuOpen = false;
+static uint32_t dfuWritten = 0;
+static uint32_t dfuStartMs = 0;
+static mbedtls_md_context_t dfuSha;
+
+/**
+ * Notify a DFU response to the updating client
+ * 
+ * @param op Request the response is for
+ * @param status BLE_DFU_STATUS_*
+ * @param value Response value
+ */
+static void respondDfu(uint8_t op, uint8_t status, uint32_t value) {
+  uint16_t conn = dfuConn;
+  if (conn == BLE_HS_CONN_HANDLE_NONE) {
+    return;
+  }
+  uint8_t response[6];
+  response[0] = op | BLE_DFU_RESPONSE;
+  response[1] = status;
+  memcpy(&response[2], &value, sizeof(value));
+  struct os_mbuf* om = ble_hs_mbuf_from_flat(response, sizeof(response));
+  if (om != nullptr) {
+    ble_gattc_notify_custom(conn, pDfuControlCharacteristic->getHandle(), om);
+  }
+}
+
+/**
+ * Queue a job for the writer task
+ * 
+ * The queue has room for every buffer and a few control jobs, this only
+ * waits if a client floods the control point.
+ * 
+ * @param type DFU_JOB_*
+ * @param buffer Buffer to write
+ */
+static void postDfuJob(uint8_t type, uint8_t buffer = 0) {
+  DfuJob job = {type, buffer};
+  xQueueSend(dfuJobQueue, &job, portMAX_DELAY);
+}
+
+/**
+ * Give back the buffer being filled
+ */
+static void releaseFill() {
+  if (dfuFill >= 0) {
+    uint8_t index = dfuFill;
+    xQueueSend(dfuFreeQueue, &index, 0);
+    dfuFill = -1;
+  }
+}
+
+/**
+ * Stop the update on the NimBLE side and tell the writer to drop it
+ * 
+ * @param status Reported to the client with the ABORT response, none if BLE_DFU_STATUS_OK
+ */
+static void stopDfu(uint8_t status) {
+  if (status != BLE_DFU_STATUS_OK) {
+    respondDfu(BLE_DFU_OP_ABORT, status, dfuReceived);
+    Serial.printf("BLE DFU: aborted at %u of %u bytes, status %u\n", dfuReceived, dfuSize, status);
+  }
+  releaseFill();
+  postDfuJob(DFU_JOB_ABORT);
+  dfuConn = BLE_HS_CONN_HANDLE_NONE;
+}
+
+/**
+ * Allocate the receive buffers on the first update
+ * 
+ * In internal RAM: flash writes run with the cache, and so PSRAM, disabled.
+ * 
+ * @return true if all buffers are there
+ */
+static bool allocateDfuBuffers() {
+  for (int i = 0; i < BLE_DFU_BUFFERS; i++) {
+    if (dfuBuffers[i].data == nullptr) {
+      dfuBuffers[i].data = (uint8_t*)heap_caps_malloc(BLE_DFU_BUFFER_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+      if (dfuBuffers[i].data == nullptr) {
+        return false;
+      }
+      uint8_t index = i;
+      xQueueSend(dfuFreeQueue, &index, 0);
+    }
+  }
+  return true;
+}
+
+/**
+ * Handle a request on the DFU control point
+ * 
+ * @param pCharacteristic Pointer to the NimBLECharacteristic instance
+ * @param desc Connection descriptor of the client
+ */
+void DfuControlCallbacks::onWrite(NimBLECharacteristic* pCharacteristic, ble_gap_conn_desc* desc) {
+  std::string value = pCharacteristic->getValue();
+  if (value.empty()) {
+    return;
+  }
+  uint8_t op = value[0];
+  bool owner = dfuConn == desc->conn_handle;
+
+  if (dfuConn != BLE_HS_CONN_HANDLE_NONE && !owner) {
+    // Answered to the asking client only, the update goes on
+    uint8_t response[6] = {(uint8_t)(op | BLE_DFU_RESPONSE), BLE_DFU_STATUS_BUSY, 0, 0, 0, 0};
+    struct os_mbuf* om = ble_hs_mbuf_from_flat(response, sizeof(response));
+    if (om != nullptr) {
+      ble_gattc_notify_custom(desc->conn_handle, pCharacteristic->getHandle(), om);
+    }
+    return;
+  }
+
+  switch (op) {
+    case BLE_DFU_OP_BEGIN: {
+      if (owner) {
+        stopDfu(BLE_DFU_STATUS_OK); // Starting over
+      }
+      dfuConn = desc->conn_handle;
+      if (!DFU_HAS_KEY || !desc->sec_state.encrypted || !desc->sec_state.bonded) {
+        respondDfu(op, BLE_DFU_STATUS_NOT_ALLOWED, 0);
+        dfuConn = BLE_HS_CONN_HANDLE_NONE;
+        return;
+      }
+      uint32_t size;
+      const size_t header = 1 + sizeof(size) + sizeof(dfuHash);
+      if (value.length() <= header || value.length() > header + BLE_DFU_MAX_SIGNATURE) {
+        respondDfu(op, BLE_DFU_STATUS_INVALID, 0);
+        dfuConn = BLE_HS_CONN_HANDLE_NONE;
+        return;
+      }
+      memcpy(&size, &value[1], sizeof(size));
+      const esp_partition_t* partition = esp_ota_get_next_update_partition(NULL);
+      if (size == 0 || partition == nullptr || size > partition->size) {
+        respondDfu(op, BLE_DFU_STATUS_TOO_LARGE, partition != nullptr ? partition->size : 0);
+        dfuConn = BLE_HS_CONN_HANDLE_NONE;
+        return;
+      }
+      if (!allocateDfuBuffers()) {
+        respondDfu(op, BLE_DFU_STATUS_NO_MEMORY, 0);
+        dfuConn = BLE_HS_CONN_HANDLE_NONE;
+        return;
+      }
+      memcpy(dfuHash, &value[1 + sizeof(size)], sizeof(dfuHash));
+      dfuSignatureLength = value.length() - header;
+      memcpy(dfuSignature, &value[header], dfuSignatureLength);
+      dfuSize = size;
+      dfuReceived = 0;
+      dfuFailed = false;
+      postDfuJob(DFU_JOB_BEGIN); // The writer answers once the partition is open
+      Serial.printf("BLE DFU: %u bytes from connection %u\n", size, dfuConn);
+      break;
+    }
+
+    case BLE_DFU_OP_END:
+      if (!owner) {
+        respondDfu(op, BLE_DFU_STATUS_INVALID, 0);
+      } else if (dfuFailed) {
+        stopDfu(BLE_DFU_STATUS_OK); // The writer already reported why
+      } else if (dfuReceived != dfuSize) {
+        stopDfu(BLE_DFU_STATUS_INVALID);
+      } else {
+        // The last buffer is usually partly filled
+        if (dfuFill >= 0) {
+          postDfuJob(DFU_JOB_WRITE, dfuFill);
+          dfuFill = -1;
+        }
+        postDfuJob(DFU_JOB_END);
+      }
+      break;
+
+    case BLE_DFU_OP_ABORT:
+      if (owner) {
+        respondDfu(op, BLE_DFU_STATUS_OK, dfuReceived);
+        stopDfu(BLE_DFU_STATUS_OK);
+      }
+      break;
+
+    default:
+      respondDfu(op, BLE_DFU_STATUS_INVALID, 0);
+      break;
+  }
+}
+
+/**
+ * Copy a chunk of the image into the receive buffers
+ * 
+ * Only waits when the client sent more than BLE_DFU_WINDOW ahead of the
+ * flash; stalling the NimBLE task longer than BLE_DFU_BUFFER_WAIT_MS stops
+ * the update.
+ * 
+ * @param pCharacteristic Pointer to the NimBLECharacteristic instance
+ * @param desc Connection descriptor of the client
+ */
+void DfuDataCallbacks::onWrite(NimBLECharacteristic* pCharacteristic, ble_gap_conn_desc* desc) {
+  if (dfuConn == BLE_HS_CONN_HANDLE_NONE || desc->conn_handle != dfuConn) {
+    return;
+  }
+  if (dfuFailed) {
+    releaseFill(); // Ignored until END, ABORT or a new BEGIN
+    return;
+  }
+
+  std::string value = pCharacteristic->getValue();
+  uint32_t offset;
+  if (value.length() <= sizeof(offset)) {
+    return;
+  }
+  memcpy(&offset, value.data(), sizeof(offset));
+  const uint8_t* data = (const uint8_t*)value.data() + sizeof(offset);
+  size_t length = value.length() - sizeof(offset);
+  if (offset != dfuReceived || length > dfuSize - dfuReceived) {
+    stopDfu(BLE_DFU_STATUS_OVERRUN);
+    return;
+  }
+
+  while (length > 0) {
+    if (dfuFill < 0) {
+      uint8_t index;
+      if (xQueueReceive(dfuFreeQueue, &index, pdMS_TO_TICKS(BLE_DFU_BUFFER_WAIT_MS)) != pdTRUE) {
+        stopDfu(BLE_DFU_STATUS_OVERRUN);
+        return;
+      }
+      dfuFill = index;
+      dfuBuffers[index].length = 0;
+    }
+    DfuBuffer& buffer = dfuBuffers[dfuFill];
+    size_t n = min(length, (size_t)(BLE_DFU_BUFFER_SIZE - buffer.length));
+    memcpy(buffer.data + buffer.length, data, n);
+    buffer.length += n;
+    data += n;
+    length -= n;
+    dfuReceived += n;
+    if (buffer.length == BLE_DFU_BUFFER_SIZE) {
+      postDfuJob(DFU_JOB_WRITE, dfuFill);
+      dfuFill = -1;
+    }
+  }
+}
+
+/**
+ * Drop the open update on the writer side
+ */
+static void closeDfu() {
+  if (dfuOpen) {
+    esp_ota_abort(dfuHandle);
+    dfuOpen = false;
+  }
+}
+
+/**
+ * Fail the update from the writer task
+ * 
+ * @param status BLE_DFU_STATUS_*
+ * @param err What the OTA call returned
+ */
+static void failDfu(uint8_t status, esp_err_t err) {
+  closeDfu();
+  dfuFailed = true;
+  respondDfu(BLE_DFU_OP_ABORT, status, dfuWritten);
+  Serial.printf("BLE DFU: failed at %u bytes, status %u (%s)\n", dfuWritten, status, esp_err_to_name(err));
+}
+
+/**
+ * Check the signature of the image hash from BEGIN
+ * 
+ * @return true if it was made with the key built into the firmware
+ */
+static bool verifyDfuSignature() {
+#if DFU_HAS_KEY
+  mbedtls_pk_context key;
+  mbedtls_pk_init(&key);
+  bool valid = mbedtls_pk_parse_public_key(&key, (const unsigned char*)DFU_PUBLIC_KEY_PEM,
+                                           sizeof(DFU_PUBLIC_KEY_PEM)) == 0 &&
+               mbedtls_pk_can_do(&key, MBEDTLS_PK_ECKEY) &&
+               mbedtls_pk_verify(&key, MBEDTLS_MD_SHA256, dfuHash, sizeof(dfuHash), dfuSignature,
+                                 dfuSignatureLength) == 0;
+  mbedtls_pk_free(&key);
+  return valid;
+#else
+  return false;
+#endif
+}
+
+/**
+ * Check the image and boot it
+ * 
+ * The hash is checked first, esp_ota_end() then validates the image
+ * headers and segments before the boot partition is switched.
+ */
+static void finishDfu() {
+  uint8_t hash[32];
+  mbedtls_md_finish(&dfuSha, hash);
+  if (memcmp(hash, dfuHash, sizeof(hash)) != 0) {
+    failDfu(BLE_DFU_STATUS_HASH_MISMATCH, ESP_ERR_INVALID_CRC);
+    return;
+  }
+  dfuOpen = false;
+  esp_err_t err = esp_ota_end(dfuHandle);
+  if (err != ESP_OK) {
+    failDfu(BLE_DFU_STATUS_BAD_IMAGE, err);
+    return;
+  }
+  err = esp_ota_set_boot_partition(esp_ota_get_next_update_partition(NULL));
+  if (err != ESP_OK) {
+    failDfu(BLE_DFU_STATUS_FLASH_ERROR, err);
+    return;
+  }
+
+  uint32_t ms = millis() - dfuStartMs;
+  respondDfu(BLE_DFU_OP_END, BLE_DFU_STATUS_OK, ms);
+  Serial.printf("BLE DFU: %u bytes in %u ms, %u bytes/s, restarting\n", dfuWritten, ms,
+                ms > 0 ? (uint32_t)((uint64_t)dfuWritten * 1000 / ms) : 0);
+  vTaskDelay(pdMS_TO_TICKS(BLE_DFU_RESTART_DELAY_MS));
+  esp_restart();
+}
+
+/**
+ * Writer task of the firmware update
+ * 
+ * Programs one buffer while the NimBLE task fills the other. With
+ * sequential writes esp_ota_write() erases each sector just before
+ * writing it, so there is no long erase of the whole partition up front.
+ * 
+ * @param parameter Unused
+ */
+static void dfuWriterTask(void* parameter) {
+  mbedtls_md_init(&dfuSha);
+  mbedtls_md_setup(&dfuSha, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 0);
+
+  DfuJob job;
+  for (;;) {
+    xQueueReceive(dfuJobQueue, &job, portMAX_DELAY);
+    switch (job.type) {
+      case DFU_JOB_BEGIN: {
+        closeDfu();
+        dfuFailed = false; // A failure of the previous update is no longer news
+        dfuWritten = 0;
+        dfuStartMs = millis();
+        // Before anything is erased: the hash the image is checked against must be ours
+        if (!verifyDfuSignature()) {
+          failDfu(BLE_DFU_STATUS_BAD_SIGNATURE, ESP_ERR_INVALID_ARG);
+          break;
+        }
+        esp_err_t err = esp_ota_begin(esp_ota_get_next_update_partition(NULL), OTA_WITH_SEQUENTIAL_WRITES,
+                                      &dfuHandle);
+        if (err != ESP_OK) {
+          failDfu(BLE_DFU_STATUS_FLASH_ERROR, err);
+          break;
+        }
+        dfuOpen = true;
+        mbedtls_md_starts(&dfuSha);
+        respondDfu(BLE_DFU_OP_BEGIN, BLE_DFU_STATUS_OK, BLE_DFU_WINDOW);
+        break;
+      }
+
+      case DFU_JOB_WRITE: {
+        DfuBuffer& buffer = dfuBuffers[job.buffer];
+        if (dfuOpen) {
+          esp_err_t err = esp_ota_write(dfuHandle, buffer.data, buffer.length);
+          if (err != ESP_OK) {
+            failDfu(BLE_DFU_STATUS_FLASH_ERROR, err);
+          } else {
+            mbedtls_md_update(&dfuSha, buffer.data, buffer.length);
+            dfuWritten += buffer.length;
+            respondDfu(BLE_DFU_OP_PROGRESS, BLE_DFU_STATUS_OK, dfuWritten);
+          }
+        }
+        xQueueSend(dfuFreeQueue, &job.buffer, 0);
+        break;
+      }
+
+      case DFU_JOB_END:
+        if (dfuOpen) {
+          finishDfu();
+        }
+        break;
+
+      case DFU_JOB_ABORT:
+        closeDfu();
+        break;
+    }
+  }
+}
+
+void setupBLEDfu(NimBLEService* pService) {
+  dfuJobQueue = xQueueCreate(BLE_DFU_BUFFERS + 4, sizeof(DfuJob));
+  dfuFreeQueue = xQueueCreate(BLE_DFU_BUFFERS, sizeof(uint8_t));
+  // Above loop() and the BLE history task, below NimBLE: flashing keeps up with the radio
+  xTaskCreate(dfuWriterTask, "BLEDfu", 8192, NULL, 3, NULL); // ECDSA needs the room
+
+  // Bond on request so an updater can get the encrypted link BEGIN needs. Just Works: the
+  // scale has no input, the signature is what keeps foreign images out
+  NimBLEDevice::setSecurityAuth(true, false, true);
+
+  // Firmware update: requests and responses on the control point, the image on the data characteristic
+  pDfuControlCharacteristic = pService->createCharacteristic(
+    ESPRESSISCALE_DFU_CONTROL_CHAR_UUID,
+    NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::WRITE_ENC | NIMBLE_PROPERTY::NOTIFY
+  );
+  pDfuControlCallbacks = new DfuControlCallbacks();
+  pDfuControlCharacteristic->setCallbacks(pDfuControlCallbacks);
+  pDfuDataCharacteristic = pService->createCharacteristic(
+    ESPRESSISCALE_DFU_DATA_CHAR_UUID,
+    NIMBLE_PROPERTY::WRITE_NR | NIMBLE_PROPERTY::WRITE_ENC
+  );
+  pDfuDataCallbacks = new DfuDataCallbacks();
+  pDfuDataCharacteristic->setCallbacks(pDfuDataCallbacks);
+}
+
+void abortBLEDfu(uint16_t connHandle) {
+  if (dfuConn != BLE_HS_CONN_HANDLE_NONE && dfuConn == connHandle) {
+    stopDfu(BLE_DFU_STATUS_OK);
+  }
+}
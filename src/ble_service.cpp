@@ -1,6 +1,17 @@
 #include "ble_service.h"
+#include "ble_dfu.h"
 #include "arduino.h"
 #include "scale.h"
+#include "display_stats.h"
+#include "shot_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+// Per connection packet counts of the host, not in NimBLE's public API
+#if defined(CONFIG_NIMBLE_CPP_IDF)
+#include "../src/ble_hs_priv.h"
+#else
+#include "nimble/nimble/host/src/ble_hs_priv.h"
+#endif
 
 /**
  * BLE Service Implementation for EspressiScale
@@ -8,8 +19,20 @@
  * This file implements the BLE functionality defined in ble_service.h.
  * It creates a BLE server that allows clients to:
  * - Receive weight measurements via notifications
+ * - Receive timestamped batches of weight samples on the weight stream
  * - Receive timer values via notifications
- * - Send commands to control the scale (tare, timer functions)
+ * - Receive weight, timer, flow, battery and flags as one packed state
+ * - Send commands to control the scale (tare, timer functions) and receive
+ *   their acknowledgements
+ * - Read frame time histograms of the display
+ * - Read connection parameters and notification statistics per client
+ * - Download the saved shots
+ * - Synchronize their clock with the scale's, for sample times in their timebase
+ * - Update the firmware, see ble_dfu.cpp
+ * - Follow the weight without connecting, from the advertisements
+ * 
+ * Several clients can be connected at once. Each one gets the weight and
+ * state at its own rate, see updateBLEWeight().
  */
 
 // Global BLE server and characteristics pointers
@@ -18,6 +41,15 @@ NimBLEService* pService = nullptr;
 NimBLECharacteristic* pWeightCharacteristic = nullptr;
 NimBLECharacteristic* pTimerCharacteristic = nullptr;
 NimBLECharacteristic* pCommandCharacteristic = nullptr;
+NimBLECharacteristic* pDisplayStatsCharacteristic = nullptr;
+NimBLECharacteristic* pWeightStreamCharacteristic = nullptr;
+NimBLECharacteristic* pStateCharacteristic = nullptr;
+NimBLECharacteristic* pLinkStatsCharacteristic = nullptr;
+NimBLECharacteristic* pCommandStatusCharacteristic = nullptr;
+NimBLECharacteristic* pClientConfigCharacteristic = nullptr;
+NimBLECharacteristic* pHistoryControlCharacteristic = nullptr;
+NimBLECharacteristic* pHistoryDataCharacteristic = nullptr;
+NimBLECharacteristic* pTimeSyncCharacteristic = nullptr;
 
 // Create server callbacks instance
 EspressiScaleServerCallbacks* pServerCallbacks = nullptr;
@@ -25,51 +57,406 @@ EspressiScaleServerCallbacks* pServerCallbacks = nullptr;
 // Create command callbacks instance
 CommandCallbacks* pCommandCallbacks = nullptr;
 
+// Create display stats callbacks instance
+DisplayStatsCallbacks* pDisplayStatsCallbacks = nullptr;
+
+// Create link stats callbacks instance
+LinkStatsCallbacks* pLinkStatsCallbacks = nullptr;
+
+// Create time sync callbacks instance
+TimeSyncCallbacks* pTimeSyncCallbacks = nullptr;
+
+// Sends to one client, defined with the publishing code below
+static bool notifyClient(uint16_t connHandle, NimBLECharacteristic* pCharacteristic, const void* data,
+                         size_t length);
+static void noteNotifyFailed(uint16_t connHandle, uint16_t attrHandle);
+static uint16_t inFlightPackets(uint16_t connHandle);
+// Shot history transfer task, started by setupBLE()
+static void historyTask(void* parameter);
+
+/**
+ * Link statistics and weight publish state per connection
+ * 
+ * Written from the NimBLE host task (connection, subscription and GAP
+ * events) and the loop task (publishing), read from both, hence the lock.
+ */
+struct LinkSlot {
+  bool used;
+  uint32_t connectedAt;     // millis() of the connection
+  uint32_t queueDelayUs;    // Smoothed wait behind the packets in flight when notifyClient() queues one
+  uint16_t intervalMs;      // Weight interval the client asked for, 0 for the default
+  uint16_t backoffMs;       // Added to the interval while notifications fail
+  bool stateChange;         // Send the next weight right away
+  float publishedWeight;
+  uint32_t publishedTime;
+  int64_t pongUs[BLE_TIME_PONGS]; // Scale clock of recent PING answers, by seq % BLE_TIME_PONGS
+  uint8_t pongSeq[BLE_TIME_PONGS];
+  uint8_t pongValid;        // Bit per entry
+  int64_t skewBaseUs;       // Older SET the drift is measured against
+  int64_t skewBaseOffsetUs;
+  bool skewKnown;
+  BLETimeSyncState sync;
+  BLELinkStats stats;
+};
+static portMUX_TYPE linkMux = portMUX_INITIALIZER_UNLOCKED;
+static LinkSlot linkSlots[BLE_LINK_MAX_CONNECTIONS];
+static struct ble_gap_event_listener linkListener;
+
+// Create subscription callbacks instances
+SubscriptionCallbacks* pWeightCallbacks = nullptr;
+SubscriptionCallbacks* pTimerCallbacks = nullptr;
+SubscriptionCallbacks* pStateCallbacks = nullptr;
+SubscriptionCallbacks* pCommandStatusCallbacks = nullptr;
+
+// Create client config callbacks instance
+ClientConfigCallbacks* pClientConfigCallbacks = nullptr;
+
+// Create history callbacks instances
+HistoryControlCallbacks* pHistoryControlCallbacks = nullptr;
+SubscriptionCallbacks* pHistoryDataCallbacks = nullptr;
+
+/**
+ * Shot history transfer state
+ * 
+ * Control point writes arrive on the NimBLE task and go to the transfer
+ * task through the queue. Everything else is only touched by the transfer
+ * task, which also does the flash reads and the sending, so the NimBLE task
+ * never waits for either.
+ */
+struct HistoryRequest {
+  uint16_t conn;
+  uint8_t op;
+  bool valid;               // Length matched the op
+  uint16_t id;
+  uint32_t offset;
+  uint8_t window;
+};
+static QueueHandle_t historyQueue = nullptr;
+static uint8_t* historyData = nullptr;       // Selection, in PSRAM
+static size_t historySize = 0;
+static uint16_t historyConn = BLE_HS_CONN_HANDLE_NONE; // Owner of the selection
+static bool historySending = false;
+static bool historyBlocked = false;           // NimBLE was out of buffers
+static uint32_t historyNext = 0;              // Offset of the next chunk
+static uint32_t historyAcked = 0;
+static size_t historyChunk = 0;               // Payload bytes per chunk
+static uint8_t historyWindow = BLE_HISTORY_DEFAULT_WINDOW;
+static uint32_t historyStartMs = 0;
+static uint32_t historyLastAckMs = 0;
+static uint32_t historySent = 0;
+
+/**
+ * Weight publish policy, shared by all clients. What was sent to each
+ * client lives in its LinkSlot; the settling check only in the loop task.
+ */
+static BLEPublishPolicy publishPolicy = {
+  BLE_WEIGHT_MIN_INTERVAL_MS, BLE_WEIGHT_DEADBAND_G, BLE_WEIGHT_KEEPALIVE_MS, BLE_WEIGHT_MAX_BACKOFF_MS
+};
+static float stableRef = 0;          // Weight the settling check compares against
+static uint32_t stableSince = 0;
+static bool stable = false;
+
+/**
+ * Scale state packet being kept up to date, sent with the weight
+ */
+static BLEScaleState scaleState = {0, 0, 0, 0, 0};
+static float flowWeight = 0;         // Weight of the last flow sample
+static uint32_t flowTime = 0;
+static float flow = 0;               // Smoothed g/s
+
+/**
+ * Weight broadcast state, changed from the loop task; the advertising type
+ * also from the NimBLE task when clients come and go
+ */
+static const char deviceName[] = "EspressiScale";
+static uint16_t broadcastIntervalMs = 0;  // 0 while not broadcasting
+static uint32_t broadcastTime = 0;
+static BLEBroadcastPayload broadcastPayload = {BLE_BROADCAST_COMPANY_ID, 0, 0, 0, 0, 0, 0};
+static volatile bool broadcastOnly = false; // Advertising non-connectable, all slots taken
+// Preferred connection interval 7.5 - 22.5 ms, helps iPhones connect
+static const char connItvlAd[] = {5, BLE_HS_ADV_TYPE_SLAVE_ITVL_RANGE, 0x06, 0x00, 0x12, 0x00};
+
+// Create weight stream callbacks instance
+WeightStreamCallbacks* pWeightStreamCallbacks = nullptr;
+
 /**
- * External references to scale control functions defined in main.cpp
- * These functions are called when BLE commands are received
+ * Weight stream state
+ * 
+ * The configuration is written from the NimBLE task and taken by the loop
+ * task when it starts a batch, hence the lock. The batch itself is only
+ * touched from the loop task.
  */
-extern void tareScale();      // Zeroes the scale
-extern void startTimer();     // Starts or resumes the timer
-extern void stopTimer();      // Pauses the timer
-extern void resetTimer();     // Resets the timer to zero
+#define BLE_STREAM_SAMPLE_SIZE(flags) (((flags) & BLE_STREAM_FLAG_RAW) ? 10 : 6)
+static portMUX_TYPE streamConfigMux = portMUX_INITIALIZER_UNLOCKED;
+static BLEStreamConfig streamConfig = {BLE_STREAM_DEFAULT_BATCH, 0, BLE_STREAM_DEFAULT_FLUSH_MS};
+static uint8_t streamPacket[BLE_STREAM_HEADER_SIZE + BLE_STREAM_MAX_BATCH * BLE_STREAM_SAMPLE_SIZE(BLE_STREAM_FLAG_RAW)];
+static size_t streamLen = 0;         // Bytes in streamPacket
+static uint8_t streamCount = 0;      // Samples in the batch
+static uint8_t streamLimit = 0;      // Samples that fit this batch
+static uint8_t streamFlags = 0;      // Flags of this batch
+static uint16_t streamFlushMs = BLE_STREAM_DEFAULT_FLUSH_MS;
+static uint16_t streamSeq = 0;       // Sequence number of the next sample
+static uint32_t streamFirstTime = 0; // millis() of the first sample in the batch
+static int64_t streamFirstUs = 0;    // The same on the microsecond clock, for client times
+static uint8_t streamClientPacket[sizeof(streamPacket) + BLE_STREAM_CLIENT_TIME_SIZE]; // With a client time
+static uint32_t streamLastTime = 0;  // millis() of the last sample in the batch
 
 /**
  * BLEServerCallbacks constructor
- * Initializes the connected state to false
+ * Initializes the client count to zero
  */
 EspressiScaleServerCallbacks::EspressiScaleServerCallbacks() {
-  _connected = false;
+  _connections = 0;
+}
+
+/**
+ * Find the link statistics of a connection, lock held
+ * 
+ * @param connHandle Connection handle
+ * @return The slot, or nullptr if the connection has none
+ */
+static LinkSlot* findLinkSlot(uint16_t connHandle) {
+  for (LinkSlot& slot : linkSlots) {
+    if (slot.used && slot.stats.conn_handle == connHandle) {
+      return &slot;
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * Copy the negotiated parameters of a connection into its statistics
+ * 
+ * @param connHandle Connection handle
+ */
+static void refreshLinkParams(uint16_t connHandle) {
+  ble_gap_conn_desc desc;
+  if (ble_gap_conn_find(connHandle, &desc) != 0) {
+    return;
+  }
+  uint16_t mtu = pServer->getPeerMTU(connHandle);
+  portENTER_CRITICAL(&linkMux);
+  LinkSlot* slot = findLinkSlot(connHandle);
+  if (slot != nullptr) {
+    slot->stats.interval = desc.conn_itvl;
+    slot->stats.latency = desc.conn_latency;
+    slot->stats.timeout = desc.supervision_timeout;
+    slot->stats.mtu = mtu;
+  }
+  portEXIT_CRITICAL(&linkMux);
+}
+
+/**
+ * GAP events NimBLEServer doesn't pass on: parameter and PHY updates and
+ * the outcome of every notification, per connection
+ * 
+ * @param event The GAP event
+ * @param arg Unused
+ * @return Always 0
+ */
+static int linkGapEvent(struct ble_gap_event* event, void* arg) {
+  switch (event->type) {
+    case BLE_GAP_EVENT_CONN_UPDATE:
+      refreshLinkParams(event->conn_update.conn_handle);
+      break;
+    case BLE_GAP_EVENT_MTU:
+      refreshLinkParams(event->mtu.conn_handle);
+      break;
+    case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE: {
+      portENTER_CRITICAL(&linkMux);
+      LinkSlot* slot = findLinkSlot(event->phy_updated.conn_handle);
+      if (slot != nullptr && event->phy_updated.status == 0) {
+        slot->stats.tx_phy = event->phy_updated.tx_phy;
+        slot->stats.rx_phy = event->phy_updated.rx_phy;
+      }
+      portEXIT_CRITICAL(&linkMux);
+      break;
+    }
+    case BLE_GAP_EVENT_NOTIFY_TX: {
+      if (event->notify_tx.indication) {
+        break;
+      }
+      portENTER_CRITICAL(&linkMux);
+      LinkSlot* slot = findLinkSlot(event->notify_tx.conn_handle);
+      if (slot != nullptr) {
+        bool publish = event->notify_tx.attr_handle == pWeightCharacteristic->getHandle() ||
+                       event->notify_tx.attr_handle == pStateCharacteristic->getHandle();
+        if (event->notify_tx.status == 0) {
+          slot->stats.notify_sent++;
+          // Weight and state notifications getting through shrink this client's backoff
+          if (publish) {
+            slot->backoffMs /= 2;
+          }
+        }
+      }
+      portEXIT_CRITICAL(&linkMux);
+      // Not queued (out of mbufs, congested link)
+      if (event->notify_tx.status != 0) {
+        noteNotifyFailed(event->notify_tx.conn_handle, event->notify_tx.attr_handle);
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  return 0;
 }
 
 /**
  * Called when a client connects to the BLE server
  * 
- * Updates the connection state and logs the connection event
+ * Updates the connection state, starts the link statistics of the
+ * connection and asks for the fast link: a short connection interval with
+ * no latency, 2M PHY and data length extension. Anything the central
+ * refuses stays as it negotiated.
  * 
  * @param pServer Pointer to the BLE server
+ * @param desc Connection descriptor of the new client
  */
-void EspressiScaleServerCallbacks::onConnect(NimBLEServer* pServer) {
-  _connected = true;
-  Serial.println("BLE client connected");
+void EspressiScaleServerCallbacks::onConnect(NimBLEServer* pServer, ble_gap_conn_desc* desc) {
+  _connections++;
+  Serial.printf("BLE client connected, %u connected\n", _connections);
+
+  portENTER_CRITICAL(&linkMux);
+  for (LinkSlot& slot : linkSlots) {
+    if (!slot.used) {
+      memset(&slot, 0, sizeof(slot));
+      slot.used = true;
+      slot.connectedAt = millis();
+      slot.stats.conn_handle = desc->conn_handle;
+      slot.stats.interval = desc->conn_itvl;
+      slot.stats.latency = desc->conn_latency;
+      slot.stats.timeout = desc->supervision_timeout;
+      slot.stats.mtu = BLE_ATT_MTU_DFLT;
+      slot.stats.tx_phy = BLE_GAP_LE_PHY_1M;
+      slot.stats.rx_phy = BLE_GAP_LE_PHY_1M;
+      slot.stateChange = true; // Weight and state right after subscribing
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&linkMux);
+
+  pServer->updateConnParams(desc->conn_handle, BLE_LINK_FAST_MIN_ITVL, BLE_LINK_FAST_MAX_ITVL, 0, BLE_LINK_TIMEOUT);
+  ble_gap_set_prefered_le_phy(desc->conn_handle, BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_2M_MASK,
+                              BLE_GAP_LE_PHY_CODED_ANY);
+  ble_gap_set_data_len(desc->conn_handle, BLE_LINK_DATA_LEN, BLE_LINK_DATA_TIME);
+
+  // Advertising stops on every connection, keep it up while another client fits,
+  // and for the broadcast listeners once none does
+  if (pServer->getConnectedCount() < BLE_LINK_MAX_CONNECTIONS) {
+    NimBLEDevice::startAdvertising();
+  } else if (broadcastIntervalMs != 0) {
+    broadcastOnly = true;
+    NimBLEDevice::getAdvertising()->setAdvertisementType(BLE_GAP_CONN_MODE_NON);
+    NimBLEDevice::startAdvertising();
+  }
 }
 
 /**
  * Called when a client disconnects from the BLE server
  * 
- * Updates the connection state, logs the event, and restarts advertising
- * to allow new clients to connect.
+ * Updates the client count, drops the link statistics and publish state of
+ * the connection, logs the event, and restarts advertising to allow new
+ * clients to connect.
  * 
  * @param pServer Pointer to the BLE server
+ * @param desc Connection descriptor of the client that left
  */
-void EspressiScaleServerCallbacks::onDisconnect(NimBLEServer* pServer) {
-  _connected = false;
-  Serial.println("BLE client disconnected");
+void EspressiScaleServerCallbacks::onDisconnect(NimBLEServer* pServer, ble_gap_conn_desc* desc) {
+  if (_connections > 0) {
+    _connections--;
+  }
+  Serial.printf("BLE client disconnected, %u connected\n", _connections);
+
+  portENTER_CRITICAL(&linkMux);
+  LinkSlot* slot = findLinkSlot(desc->conn_handle);
+  if (slot != nullptr) {
+    slot->used = false;
+  }
+  portEXIT_CRITICAL(&linkMux);
+
+  // A history transfer of this client stops, START resumes it after reconnecting
+  HistoryRequest req = {desc->conn_handle, BLE_HISTORY_OP_ABORT, false, 0, 0, 0};
+  xQueueSend(historyQueue, &req, 0);
+
+  // A firmware update has to start over
+  abortBLEDfu(desc->conn_handle);
   
-  // Restart advertising when client disconnects
+  // Restart advertising when client disconnects, connectable again
+  if (broadcastOnly) {
+    broadcastOnly = false;
+    NimBLEDevice::stopAdvertising();
+    NimBLEDevice::getAdvertising()->setAdvertisementType(BLE_GAP_CONN_MODE_UND);
+  }
   NimBLEDevice::startAdvertising();
 }
 
+/**
+ * Fall back to phone connection parameters where the fast ones didn't stick
+ * 
+ * Called from processBLE(). A central that still runs a longer interval
+ * than asked for a while after connecting is most likely a phone, and gets
+ * the 15 - 30 ms interval phones accept.
+ */
+static void checkLinkFallback() {
+  uint16_t pending[BLE_LINK_MAX_CONNECTIONS];
+  int count = 0;
+  uint32_t now = millis();
+  portENTER_CRITICAL(&linkMux);
+  for (LinkSlot& slot : linkSlots) {
+    if (slot.used && !slot.stats.fallback && now - slot.connectedAt >= BLE_LINK_FALLBACK_MS &&
+        slot.stats.interval > BLE_LINK_FAST_MAX_ITVL) {
+      slot.stats.fallback = 1;
+      pending[count++] = slot.stats.conn_handle;
+    }
+  }
+  portEXIT_CRITICAL(&linkMux);
+
+  for (int i = 0; i < count; i++) {
+    Serial.printf("BLE connection %u: fast interval refused, asking for phone parameters\n", pending[i]);
+    pServer->updateConnParams(pending[i], BLE_LINK_PHONE_MIN_ITVL, BLE_LINK_PHONE_MAX_ITVL, 0, BLE_LINK_TIMEOUT);
+  }
+}
+
+/**
+ * Weight interval of a client without the backoff, lock held
+ * 
+ * @param slot The client's slot
+ * @return What the client asked for, else the phone or the policy interval
+ */
+static uint16_t weightInterval(const LinkSlot& slot) {
+  if (slot.intervalMs != 0) {
+    return slot.intervalMs;
+  }
+  return slot.stats.fallback ? max(publishPolicy.min_interval_ms, (uint16_t)BLE_WEIGHT_PHONE_INTERVAL_MS)
+                             : publishPolicy.min_interval_ms;
+}
+
+/**
+ * Serve a read of the link stats characteristic
+ * 
+ * Sets a BLELinkStats for every connected client as the characteristic
+ * value, which NimBLE then returns.
+ * 
+ * @param pCharacteristic Pointer to the characteristic being read
+ */
+void LinkStatsCallbacks::onRead(NimBLECharacteristic* pCharacteristic) {
+  BLELinkStats stats[BLE_LINK_MAX_CONNECTIONS];
+  size_t count = 0;
+  portENTER_CRITICAL(&linkMux);
+  for (LinkSlot& slot : linkSlots) {
+    if (slot.used) {
+      stats[count] = slot.stats;
+      // Packets ahead in the queue plus on average half an interval to the next connection event
+      stats[count].queue_delay_ms = slot.queueDelayUs / 1000 + slot.stats.interval * 5 / 8;
+      stats[count].weight_interval_ms = weightInterval(slot) + slot.backoffMs;
+      count++;
+    }
+  }
+  portEXIT_CRITICAL(&linkMux);
+  pCharacteristic->setValue((const uint8_t*)stats, count * sizeof(BLELinkStats));
+}
+
 /**
  * CommandCallbacks constructor
  */
@@ -78,11 +465,12 @@ CommandCallbacks::CommandCallbacks() {
 }
 
 /**
- * Process commands received from BLE clients
+ * Queue commands received from BLE clients
  * 
- * This function is called when a client writes to the command characteristic.
- * It interprets the command code and calls the appropriate function to
- * execute the requested action.
+ * This function is called from the NimBLE host task when a client writes to
+ * the command characteristic. It only posts the command to the command bus;
+ * the main loop executes it and the acknowledgement comes back on the
+ * command status characteristic.
  * 
  * @param pCharacteristic Pointer to the characteristic that received the write
  */
@@ -91,31 +479,281 @@ void CommandCallbacks::onWrite(NimBLECharacteristic* pCharacteristic) {
   
   if (value.length() > 0) {
     uint8_t command = value[0];
+    uint8_t seq = value.length() > 1 ? value[1] : 0;
     
-    switch (static_cast<BLECommand>(command)) {
-      case BLECommand::TARE:
-        Serial.println("BLE Command: TARE");
-        tareScale();
-        break;
-      case BLECommand::START_TIMER:
-        Serial.println("BLE Command: START_TIMER");
-        startTimer();
-        break;
-      case BLECommand::STOP_TIMER:
-        Serial.println("BLE Command: STOP_TIMER");
-        stopTimer();
-        break;
-      case BLECommand::RESET_TIMER:
-        Serial.println("BLE Command: RESET_TIMER");
-        resetTimer();
-        break;
-      default:
-        Serial.println("Unknown BLE command received");
-        break;
+    if (command >= (uint8_t)BLECommand::TARE && command <= (uint8_t)BLECommand::CLEAR_CHART) {
+      postCommand(static_cast<Command>(command), CommandSource::BLE, seq);
+    } else {
+      Serial.println("Unknown BLE command received");
+      CommandRequest req = {static_cast<Command>(command), CommandSource::BLE, seq, millis()};
+      ackBLECommand(req, CommandStatus::UNKNOWN);
+    }
+  }
+}
+
+/**
+ * Serve a read of the display stats characteristic
+ * 
+ * Summarizes the frames in the display stats ring into histograms and
+ * sets them as the characteristic value, which NimBLE then returns.
+ * 
+ * @param pCharacteristic Pointer to the characteristic being read
+ */
+void DisplayStatsCallbacks::onRead(NimBLECharacteristic* pCharacteristic) {
+  display_stats_histogram_t hist;
+  display_stats_get_histogram(&hist);
+  pCharacteristic->setValue((const uint8_t*)&hist, sizeof(hist));
+}
+
+/**
+ * Record a client's subscription to a notifying characteristic
+ * 
+ * @param pCharacteristic Pointer to the characteristic
+ * @param desc Connection descriptor of the client
+ * @param subValue 0 unsubscribed, else notifications and/or indications
+ */
+void SubscriptionCallbacks::onSubscribe(NimBLECharacteristic* pCharacteristic, ble_gap_conn_desc* desc,
+                                        uint16_t subValue) {
+  portENTER_CRITICAL(&linkMux);
+  LinkSlot* slot = findLinkSlot(desc->conn_handle);
+  if (slot != nullptr) {
+    if (subValue != 0) {
+      slot->stats.subscriptions |= _bit;
+      slot->stateChange = true; // The current value right away
+    } else {
+      slot->stats.subscriptions &= ~_bit;
+    }
+  }
+  portEXIT_CRITICAL(&linkMux);
+}
+
+/**
+ * Apply the settings a client wrote for its own connection
+ * 
+ * Writes of the wrong length are ignored. The interval is kept within the
+ * policy minimum and the keep-alive.
+ * 
+ * @param pCharacteristic Pointer to the characteristic that received the write
+ * @param desc Connection descriptor of the client
+ */
+void ClientConfigCallbacks::onWrite(NimBLECharacteristic* pCharacteristic, ble_gap_conn_desc* desc) {
+  std::string value = pCharacteristic->getValue();
+  if (value.length() != sizeof(BLEClientConfig)) {
+    Serial.println("Invalid client configuration");
+    return;
+  }
+
+  BLEClientConfig config;
+  memcpy(&config, value.data(), sizeof(config));
+  if (config.weight_interval_ms != 0) {
+    config.weight_interval_ms = constrain(config.weight_interval_ms, publishPolicy.min_interval_ms,
+                                          publishPolicy.keepalive_ms);
+  }
+
+  portENTER_CRITICAL(&linkMux);
+  LinkSlot* slot = findLinkSlot(desc->conn_handle);
+  if (slot != nullptr) {
+    slot->intervalMs = config.weight_interval_ms;
+  }
+  portEXIT_CRITICAL(&linkMux);
+  Serial.printf("BLE connection %u: weight interval %u ms\n", desc->conn_handle, config.weight_interval_ms);
+}
+
+/**
+ * Hand a history request to the transfer task
+ * 
+ * @param pCharacteristic Pointer to the characteristic that received the write
+ * @param desc Connection descriptor of the client
+ */
+void HistoryControlCallbacks::onWrite(NimBLECharacteristic* pCharacteristic, ble_gap_conn_desc* desc) {
+  std::string value = pCharacteristic->getValue();
+  if (value.empty()) {
+    return;
+  }
+
+  HistoryRequest req = {desc->conn_handle, (uint8_t)value[0], false, 0, 0, 0};
+  switch (req.op) {
+    case BLE_HISTORY_OP_LIST:
+    case BLE_HISTORY_OP_ABORT:
+      req.valid = value.length() == 1;
+      break;
+    case BLE_HISTORY_OP_SELECT:
+      req.valid = value.length() == 3;
+      if (req.valid) {
+        memcpy(&req.id, &value[1], sizeof(req.id));
+      }
+      break;
+    case BLE_HISTORY_OP_START:
+      req.valid = value.length() == 6;
+      if (req.valid) {
+        memcpy(&req.offset, &value[1], sizeof(req.offset));
+        req.window = value[5];
+      }
+      break;
+    case BLE_HISTORY_OP_ACK:
+      req.valid = value.length() == 5;
+      if (req.valid) {
+        memcpy(&req.offset, &value[1], sizeof(req.offset));
+      }
+      break;
+    default:
+      break;
+  }
+  if (xQueueSend(historyQueue, &req, 0) != pdTRUE) {
+    Serial.println("History request dropped, queue full");
+  }
+}
+
+/**
+ * A scale clock time in a client's timebase, lock held
+ * 
+ * @param slot The client's slot, synced
+ * @param scaleUs Scale clock in microseconds since boot
+ * @return The client's clock at that moment
+ */
+static int64_t clientTime(const LinkSlot& slot, int64_t scaleUs) {
+  int64_t sinceRef = scaleUs - slot.sync.ref_us;
+  return scaleUs + slot.sync.offset_us + sinceRef * slot.sync.skew_ppb / 1000000000LL;
+}
+
+/**
+ * Take a client's clock offset, and its drift once the baseline is long enough, lock held
+ * 
+ * @param slot The client's slot
+ * @param ref Scale clock of the PING answer the offset was measured with
+ * @param offset Client clock minus scale clock at ref, within BLE_TIME_MAX_OFFSET_US
+ * @param rtt Round trip of that exchange
+ */
+static void updateClockSync(LinkSlot& slot, int64_t ref, int64_t offset, uint32_t rtt) {
+  int64_t span = ref - slot.skewBaseUs;
+  int64_t moved = offset - slot.skewBaseOffsetUs; // Both offsets are within 2^61, no overflow
+  if (!slot.sync.synced) {
+    slot.skewBaseUs = ref;
+    slot.skewBaseOffsetUs = offset;
+  } else if (span >= BLE_TIME_SKEW_MIN_MS * 1000LL) {
+    // More than 1000 ppm is a jump of the client's clock, not drift (crystals are within 50)
+    if (llabs(moved) <= span / 1000) {
+      // ppb = moved * 1e9 / span, divided first so it stays in range
+      int64_t measured = moved * 1000000LL / (span / 1000);
+      int32_t skew = slot.sync.skew_ppb;
+      slot.sync.skew_ppb = slot.skewKnown ? skew + (int32_t)(measured - skew) / 4 : (int32_t)measured;
+      slot.skewKnown = true;
+    }
+    slot.skewBaseUs = ref;
+    slot.skewBaseOffsetUs = offset;
+  }
+  slot.sync.offset_us = offset;
+  slot.sync.ref_us = ref;
+  slot.sync.rtt_us = rtt;
+  slot.sync.synced = 1;
+}
+
+/**
+ * Answer a PING or take a SET
+ * 
+ * The PING answer goes out from here, right after the write arrived, so
+ * t2 and t3 are as close to the radio as the host stack allows.
+ * 
+ * @param pCharacteristic Pointer to the characteristic that received the write
+ * @param desc Connection descriptor of the client
+ */
+void TimeSyncCallbacks::onWrite(NimBLECharacteristic* pCharacteristic, ble_gap_conn_desc* desc) {
+  int64_t t2 = esp_timer_get_time();
+  std::string value = pCharacteristic->getValue();
+
+  if (value.length() == 10 && value[0] == BLE_TIME_OP_PING) {
+    uint8_t response[18];
+    response[0] = BLE_TIME_OP_PING | BLE_TIME_RESPONSE;
+    response[1] = value[1];
+    memcpy(&response[2], &t2, sizeof(t2));
+    int64_t t3 = esp_timer_get_time();
+    memcpy(&response[10], &t3, sizeof(t3));
+    notifyClient(desc->conn_handle, pCharacteristic, response, sizeof(response));
+
+    portENTER_CRITICAL(&linkMux);
+    LinkSlot* slot = findLinkSlot(desc->conn_handle);
+    if (slot != nullptr) {
+      uint8_t seq = value[1];
+      int i = seq % BLE_TIME_PONGS;
+      slot->pongUs[i] = t2 + (t3 - t2) / 2;
+      slot->pongSeq[i] = seq;
+      slot->pongValid |= 1 << i;
+    }
+    portEXIT_CRITICAL(&linkMux);
+  } else if (value.length() == 14 && value[0] == BLE_TIME_OP_SET) {
+    uint8_t seq = value[1];
+    int64_t offset;
+    uint32_t rtt;
+    memcpy(&offset, &value[2], sizeof(offset));
+    memcpy(&rtt, &value[10], sizeof(rtt));
+    if (offset > BLE_TIME_MAX_OFFSET_US || offset < -BLE_TIME_MAX_OFFSET_US) {
+      Serial.println("Time sync offset out of range");
+      return;
+    }
+
+    bool known = false;
+    int i = seq % BLE_TIME_PONGS;
+    portENTER_CRITICAL(&linkMux);
+    LinkSlot* slot = findLinkSlot(desc->conn_handle);
+    if (slot != nullptr && (slot->pongValid & (1 << i)) && slot->pongSeq[i] == seq) {
+      updateClockSync(*slot, slot->pongUs[i], offset, rtt);
+      known = true;
     }
+    portEXIT_CRITICAL(&linkMux);
+    if (!known) {
+      Serial.printf("Time sync SET for unknown PING %u\n", seq);
+    }
+  } else {
+    Serial.println("Invalid time sync request");
   }
 }
 
+/**
+ * Serve a client's read of its time sync state
+ * 
+ * @param pCharacteristic Pointer to the characteristic being read
+ * @param desc Connection descriptor of the client
+ */
+void TimeSyncCallbacks::onRead(NimBLECharacteristic* pCharacteristic, ble_gap_conn_desc* desc) {
+  BLETimeSyncState state;
+  memset(&state, 0, sizeof(state));
+  portENTER_CRITICAL(&linkMux);
+  LinkSlot* slot = findLinkSlot(desc->conn_handle);
+  if (slot != nullptr) {
+    state = slot->sync;
+  }
+  portEXIT_CRITICAL(&linkMux);
+  pCharacteristic->setValue((const uint8_t*)&state, sizeof(state));
+}
+
+/**
+ * Apply a weight stream configuration written by a client
+ * 
+ * Out of range batch sizes are clamped, a zero flush interval falls back to
+ * the default. Writes of the wrong length are ignored.
+ * 
+ * @param pCharacteristic Pointer to the characteristic that received the write
+ */
+void WeightStreamCallbacks::onWrite(NimBLECharacteristic* pCharacteristic) {
+  std::string value = pCharacteristic->getValue();
+  if (value.length() != sizeof(BLEStreamConfig)) {
+    Serial.println("Invalid weight stream configuration");
+    return;
+  }
+
+  BLEStreamConfig config;
+  memcpy(&config, value.data(), sizeof(config));
+  config.batch = constrain(config.batch, 1, BLE_STREAM_MAX_BATCH);
+  if (config.flush_ms == 0) {
+    config.flush_ms = BLE_STREAM_DEFAULT_FLUSH_MS;
+  }
+
+  portENTER_CRITICAL(&streamConfigMux);
+  streamConfig = config;
+  portEXIT_CRITICAL(&streamConfigMux);
+  Serial.printf("Weight stream: %u samples, flush %u ms, flags 0x%02x\n", config.batch, config.flush_ms, config.flags);
+}
+
 /**
  * Initialize the BLE service
  * 
@@ -125,18 +763,30 @@ void CommandCallbacks::onWrite(NimBLECharacteristic* pCharacteristic) {
  * 3. Sets up connection callbacks
  * 4. Creates the service and characteristics
  * 5. Sets up command handling
- * 6. Starts advertising
+ * 6. Starts advertising, with the weight broadcast if asked for
  * 
  * This should be called once during device initialization.
+ * 
+ * @param broadcastMs Weight broadcast interval in milliseconds, 0 for none
  */
-void setupBLE() {
+void setupBLE(uint16_t broadcastMs) {
   Serial.println("Initializing BLE...");
   
   // Initialize NimBLE device
-  NimBLEDevice::init("EspressiScale");
+  NimBLEDevice::init(deviceName);
+
+  // Shot history downloads run on their own task
+  historyQueue = xQueueCreate(8, sizeof(HistoryRequest));
+  xTaskCreate(historyTask, "BLEHistory", 4096, NULL, 1, NULL);
   
+  // Ask for the largest MTU, batches and the state packet fit in one notification
+  NimBLEDevice::setMTU(BLE_ATT_MTU_MAX);
+
   // Create the server
   pServer = NimBLEDevice::createServer();
+
+  // Parameter and PHY updates and notification results for the link statistics
+  ble_gap_event_listener_register(&linkListener, linkGapEvent, NULL);
   
   // Set server callbacks
   pServerCallbacks = new EspressiScaleServerCallbacks();
@@ -151,10 +801,15 @@ void setupBLE() {
     NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY
   );
   
+  pWeightCallbacks = new SubscriptionCallbacks(BLE_SUB_WEIGHT);
+  pWeightCharacteristic->setCallbacks(pWeightCallbacks);
+  
   pTimerCharacteristic = pService->createCharacteristic(
     ESPRESSISCALE_TIMER_CHAR_UUID,
     NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY
   );
+  pTimerCallbacks = new SubscriptionCallbacks(BLE_SUB_TIMER);
+  pTimerCharacteristic->setCallbacks(pTimerCallbacks);
   
   pCommandCharacteristic = pService->createCharacteristic(
     ESPRESSISCALE_COMMAND_CHAR_UUID,
@@ -164,34 +819,448 @@ void setupBLE() {
   // Set command characteristic callbacks
   pCommandCallbacks = new CommandCallbacks();
   pCommandCharacteristic->setCallbacks(pCommandCallbacks);
+
+  // Display frame time histograms, filled on read
+  pDisplayStatsCharacteristic = pService->createCharacteristic(
+    ESPRESSISCALE_DISPLAY_STATS_CHAR_UUID,
+    NIMBLE_PROPERTY::READ
+  );
+  pDisplayStatsCallbacks = new DisplayStatsCallbacks();
+  pDisplayStatsCharacteristic->setCallbacks(pDisplayStatsCallbacks);
+
+  // Weight, timer, flow, battery and flags in one value
+  pStateCharacteristic = pService->createCharacteristic(
+    ESPRESSISCALE_STATE_CHAR_UUID,
+    NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY
+  );
+  pStateCharacteristic->setValue((const uint8_t*)&scaleState, sizeof(scaleState));
+  pStateCallbacks = new SubscriptionCallbacks(BLE_SUB_STATE);
+  pStateCharacteristic->setCallbacks(pStateCallbacks);
+
+  // Connection parameters and notification statistics per client, filled on read
+  pLinkStatsCharacteristic = pService->createCharacteristic(
+    ESPRESSISCALE_LINK_STATS_CHAR_UUID,
+    NIMBLE_PROPERTY::READ
+  );
+  pLinkStatsCallbacks = new LinkStatsCallbacks();
+  pLinkStatsCharacteristic->setCallbacks(pLinkStatsCallbacks);
+
+  // Acknowledgements of finished commands
+  pCommandStatusCharacteristic = pService->createCharacteristic(
+    ESPRESSISCALE_COMMAND_STATUS_CHAR_UUID,
+    NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY
+  );
+  pCommandStatusCallbacks = new SubscriptionCallbacks(BLE_SUB_COMMAND_STATUS);
+  pCommandStatusCharacteristic->setCallbacks(pCommandStatusCallbacks);
+
+  // Settings of the client that writes them, such as its weight rate
+  pClientConfigCharacteristic = pService->createCharacteristic(
+    ESPRESSISCALE_CLIENT_CONFIG_CHAR_UUID,
+    NIMBLE_PROPERTY::WRITE
+  );
+  pClientConfigCallbacks = new ClientConfigCallbacks();
+  pClientConfigCharacteristic->setCallbacks(pClientConfigCallbacks);
+
+  // Clock synchronization, PING/SET writes, answers notified, the client's state on reads
+  pTimeSyncCharacteristic = pService->createCharacteristic(
+    ESPRESSISCALE_TIME_SYNC_CHAR_UUID,
+    NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::NOTIFY
+  );
+  pTimeSyncCallbacks = new TimeSyncCallbacks();
+  pTimeSyncCharacteristic->setCallbacks(pTimeSyncCallbacks);
+
+  // Shot history: requests and responses on the control point, chunks on the data characteristic
+  pHistoryControlCharacteristic = pService->createCharacteristic(
+    ESPRESSISCALE_HISTORY_CONTROL_CHAR_UUID,
+    NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::WRITE_NR | NIMBLE_PROPERTY::NOTIFY
+  );
+  pHistoryControlCallbacks = new HistoryControlCallbacks();
+  pHistoryControlCharacteristic->setCallbacks(pHistoryControlCallbacks);
+  pHistoryDataCharacteristic = pService->createCharacteristic(
+    ESPRESSISCALE_HISTORY_DATA_CHAR_UUID,
+    NIMBLE_PROPERTY::NOTIFY
+  );
+  pHistoryDataCallbacks = new SubscriptionCallbacks(BLE_SUB_HISTORY_DATA);
+  pHistoryDataCharacteristic->setCallbacks(pHistoryDataCallbacks);
+
+  // Batched, timestamped weight samples, configured by writes
+  pWeightStreamCharacteristic = pService->createCharacteristic(
+    ESPRESSISCALE_WEIGHT_STREAM_CHAR_UUID,
+    NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::NOTIFY
+  );
+  pWeightStreamCallbacks = new WeightStreamCallbacks();
+  pWeightStreamCharacteristic->setCallbacks(pWeightStreamCallbacks);
+
+  // Firmware update, with its own writer task
+  setupBLEDfu(pService);
   
   // Start the service
   pService->start();
   
   // Start advertising
-  NimBLEAdvertising* pAdvertising = NimBLEDevice::getAdvertising();
-  pAdvertising->addServiceUUID(ESPRESSISCALE_SERVICE_UUID);
-  pAdvertising->setScanResponse(true);
-  pAdvertising->setMinPreferred(0x06);  // functions that help with iPhone connections issue
-  pAdvertising->setMaxPreferred(0x12);
+  NimBLEDevice::getAdvertising()->setScanResponse(true);
+  setBLEBroadcast(broadcastMs);
   
   NimBLEDevice::startAdvertising();
   
   Serial.println("BLE initialized, advertising started");
 }
 
+/**
+ * Notify one client only
+ * 
+ * NimBLECharacteristic::notify() sends to every subscriber at once. This
+ * hands the value to NimBLE for one connection, so each client can be on its
+ * own rate. A failure is counted through noteNotifyFailed(), and the
+ * packets still in flight after each call feed the client's queue delay
+ * estimate. Notifications sent with notify() are counted only.
+ * 
+ * @param connHandle Connection handle of the client
+ * @param pCharacteristic Characteristic whose value is sent
+ * @param data Value
+ * @param length Value length in bytes
+ * @return true if NimBLE queued the notification
+ */
+static bool notifyClient(uint16_t connHandle, NimBLECharacteristic* pCharacteristic, const void* data,
+                         size_t length) {
+  struct os_mbuf* om = ble_hs_mbuf_from_flat(data, length);
+  if (om == nullptr) {
+    noteNotifyFailed(connHandle, pCharacteristic->getHandle()); // Never got to NimBLE, no event
+    return false;
+  }
+  if (ble_gattc_notify_custom(connHandle, pCharacteristic->getHandle(), om) != 0) { // Takes the mbuf
+    return false;
+  }
+  uint16_t packets = inFlightPackets(connHandle);
+  portENTER_CRITICAL(&linkMux);
+  LinkSlot* slot = findLinkSlot(connHandle);
+  if (slot != nullptr) {
+    // Worst case of one packet per connection event
+    int32_t delay = packets * (int32_t)slot->stats.interval * 1250;
+    slot->queueDelayUs += (delay - (int32_t)slot->queueDelayUs) / 8;
+  }
+  portEXIT_CRITICAL(&linkMux);
+  return true;
+}
+
+/**
+ * Packets of a connection NimBLE has not seen go out yet
+ * 
+ * Those handed to the controller and not reported by its Number of
+ * Completed Packets event, plus those the host holds back while the
+ * controller has no buffers. NOTIFY_TX doesn't tell: for notifications it
+ * is raised as soon as the host takes the value.
+ * 
+ * @param connHandle Connection handle of the client
+ * @return Packets in flight, including the one just queued
+ */
+static uint16_t inFlightPackets(uint16_t connHandle) {
+  uint16_t count = 0;
+  ble_hs_lock();
+  struct ble_hs_conn* conn = ble_hs_conn_find(connHandle);
+  if (conn != nullptr) {
+    count = conn->bhc_outstanding_pkts;
+    struct os_mbuf_pkthdr* omp;
+    STAILQ_FOREACH(omp, &conn->bhc_tx_q, omp_next) {
+      count++;
+    }
+  }
+  ble_hs_unlock();
+  return count;
+}
+
+/**
+ * Count a notification that was not queued and back off
+ * 
+ * Called for failed NOTIFY_TX events and by notifyClient() when NimBLE had
+ * no mbuf for the value, which raises no event at all. Weight and state
+ * notifications failing grow the client's backoff, up to the policy maximum.
+ * 
+ * @param connHandle Connection handle of the client
+ * @param attrHandle Value handle of the characteristic
+ */
+static void noteNotifyFailed(uint16_t connHandle, uint16_t attrHandle) {
+  bool publish = attrHandle == pWeightCharacteristic->getHandle() || attrHandle == pStateCharacteristic->getHandle();
+  portENTER_CRITICAL(&linkMux);
+  LinkSlot* slot = findLinkSlot(connHandle);
+  if (slot != nullptr) {
+    slot->stats.notify_failed++;
+    if (publish) {
+      slot->backoffMs = min(max(slot->backoffMs * 2, (int)publishPolicy.min_interval_ms),
+                            (int)publishPolicy.max_backoff_ms);
+    }
+  }
+  portEXIT_CRITICAL(&linkMux);
+}
+
 /**
  * Send weight updates to connected clients
  * 
- * This function updates the weight characteristic with the current weight value
- * and sends a notification to all connected clients that have enabled notifications.
+ * This function updates the weight and state characteristics with the
+ * current values and notifies each subscribed client when its publish
+ * policy allows it. A client on a slow or congested link only delays its
+ * own updates. Unsent values are simply replaced by newer ones, so a slow
+ * link never queues up stale weights. A notification that could not be
+ * queued leaves the client due again once its backoff ran out, so a tare,
+ * settle or timer change is not lost.
  * 
  * @param weight Current weight in grams
  */
 void updateBLEWeight(float weight) {
-  if (pWeightCharacteristic != nullptr) {
-    pWeightCharacteristic->setValue(weight);
-    pWeightCharacteristic->notify();
+  if (pWeightCharacteristic == nullptr) {
+    return;
+  }
+  uint32_t now = millis();
+
+  // Settled once it stayed within the deadband for a while, sent once then
+  bool settled = false;
+  if (fabsf(weight - stableRef) >= publishPolicy.deadband_g) {
+    stableRef = weight;
+    stableSince = now;
+    stable = false;
+  } else if (!stable && now - stableSince >= BLE_WEIGHT_STABLE_MS) {
+    stable = true;
+    settled = true;
+  }
+
+  // Flow for the state packet, like the shot chart: 10 Hz, smoothed
+  uint32_t dt = now - flowTime;
+  if (dt >= 100) {
+    if (dt < 500) {
+      flow += 0.2f * ((weight - flowWeight) * 1000.0f / dt - flow);
+    } else {
+      flow = 0; // First sample after a pause
+    }
+    flowWeight = weight;
+    flowTime = now;
+  }
+
+  if (settled) {
+    flagBLEStateChange();
+  }
+
+  // Each client on its own interval, backoff and last sent weight
+  uint16_t pending[BLE_LINK_MAX_CONNECTIONS];
+  uint8_t pendingSubs[BLE_LINK_MAX_CONNECTIONS];
+  int count = 0;
+  portENTER_CRITICAL(&linkMux);
+  for (LinkSlot& slot : linkSlots) {
+    if (!slot.used || !(slot.stats.subscriptions & (BLE_SUB_WEIGHT | BLE_SUB_STATE))) {
+      continue;
+    }
+    uint32_t elapsed = now - slot.publishedTime;
+    bool send;
+    if (slot.stateChange) {
+      send = elapsed >= slot.backoffMs;
+    } else {
+      send = elapsed >= (uint32_t)weightInterval(slot) + slot.backoffMs &&
+             (fabsf(weight - slot.publishedWeight) >= publishPolicy.deadband_g ||
+              elapsed >= publishPolicy.keepalive_ms);
+    }
+    if (send) {
+      slot.stateChange = false;
+      slot.publishedWeight = weight;
+      slot.publishedTime = now;
+      pending[count] = slot.stats.conn_handle;
+      pendingSubs[count] = slot.stats.subscriptions;
+      count++;
+    }
+  }
+  portEXIT_CRITICAL(&linkMux);
+
+  // The same moment as one packed value, kept current for the broadcast
+  scaleState.weight = lroundf(weight * 100);
+  scaleState.flow = constrain(lroundf(flow * 100), INT16_MIN, INT16_MAX);
+  scaleState.flags = (scaleState.flags & ~BLE_STATE_FLAG_STABLE) | (stable ? BLE_STATE_FLAG_STABLE : 0);
+  if (count == 0) {
+    return;
+  }
+
+  // Values for reads, then a notification to each client that is due only
+  pWeightCharacteristic->setValue(weight);
+  pStateCharacteristic->setValue((const uint8_t*)&scaleState, sizeof(scaleState));
+  for (int i = 0; i < count; i++) {
+    bool sent = true;
+    if (pendingSubs[i] & BLE_SUB_WEIGHT) {
+      sent = notifyClient(pending[i], pWeightCharacteristic, &weight, sizeof(weight));
+    }
+    if (pendingSubs[i] & BLE_SUB_STATE) {
+      sent = notifyClient(pending[i], pStateCharacteristic, &scaleState, sizeof(scaleState)) && sent;
+    }
+    if (!sent) {
+      // The client still has an older value: due again after the backoff, whatever the deadband says
+      portENTER_CRITICAL(&linkMux);
+      LinkSlot* slot = findLinkSlot(pending[i]);
+      if (slot != nullptr) {
+        slot->stateChange = true;
+      }
+      portEXIT_CRITICAL(&linkMux);
+    }
+  }
+}
+
+/**
+ * Update the non-weight fields of the state packet
+ * 
+ * @param timer_ms Shot timer in milliseconds
+ * @param timer_running Whether the timer runs
+ * @param taring Whether a tare is in progress
+ * @param battery Battery level in percent
+ */
+void updateBLEState(uint32_t timer_ms, bool timer_running, bool taring, uint8_t battery) {
+  uint8_t flags = (scaleState.flags & BLE_STATE_FLAG_STABLE) |
+                  (timer_running ? BLE_STATE_FLAG_TIMER_RUNNING : 0) |
+                  (taring ? BLE_STATE_FLAG_TARING : 0);
+  if (flags != scaleState.flags) {
+    flagBLEStateChange();
+  }
+  scaleState.timer_ms = timer_ms;
+  scaleState.battery = battery;
+  scaleState.flags = flags;
+}
+
+/**
+ * Make the next weight update bypass the publish policy for every client
+ */
+void flagBLEStateChange() {
+  portENTER_CRITICAL(&linkMux);
+  for (LinkSlot& slot : linkSlots) {
+    slot.stateChange = true;
+  }
+  portEXIT_CRITICAL(&linkMux);
+}
+
+/**
+ * Replace the weight publish policy
+ * 
+ * @param policy Rate limit, deadband, keep-alive and maximum backoff
+ */
+void setBLEPublishPolicy(const BLEPublishPolicy& policy) {
+  publishPolicy = policy;
+}
+
+/**
+ * Smallest ATT payload among the clients subscribed to the weight stream
+ * 
+ * Notifications go to every subscriber with the same value, so a batch has
+ * to fit the subscriber with the smallest negotiated MTU.
+ * 
+ * @return Usable bytes per notification
+ */
+static size_t streamPayloadSize() {
+  uint16_t mtu = BLE_ATT_MTU_MAX;
+  portENTER_CRITICAL(&linkMux);
+  for (LinkSlot& slot : linkSlots) {
+    if (slot.used && (slot.stats.subscriptions & BLE_SUB_WEIGHT_STREAM) && slot.stats.mtu < mtu) {
+      mtu = slot.stats.mtu;
+    }
+  }
+  portEXIT_CRITICAL(&linkMux);
+  return mtu > 3 ? mtu - 3 : 0; // ATT notification header
+}
+
+/**
+ * Notify the weight stream batch and start a new one
+ * 
+ * Each subscriber gets its own notification: as is, or with the time of
+ * the first sample in its timebase once it synchronized its clock.
+ */
+static void flushStream() {
+  if (streamCount == 0) {
+    return;
+  }
+  streamPacket[1] = streamCount;
+
+  uint16_t conns[BLE_LINK_MAX_CONNECTIONS];
+  bool synced[BLE_LINK_MAX_CONNECTIONS];
+  int64_t clientUs[BLE_LINK_MAX_CONNECTIONS];
+  int count = 0;
+  portENTER_CRITICAL(&linkMux);
+  for (LinkSlot& slot : linkSlots) {
+    if (slot.used && (slot.stats.subscriptions & BLE_SUB_WEIGHT_STREAM)) {
+      conns[count] = slot.stats.conn_handle;
+      synced[count] = slot.sync.synced;
+      clientUs[count] = synced[count] ? clientTime(slot, streamFirstUs) : 0;
+      count++;
+    }
+  }
+  portEXIT_CRITICAL(&linkMux);
+
+  pWeightStreamCharacteristic->setValue(streamPacket, streamLen);
+  for (int i = 0; i < count; i++) {
+    if (!synced[i]) {
+      notifyClient(conns[i], pWeightStreamCharacteristic, streamPacket, streamLen);
+      continue;
+    }
+    memcpy(streamClientPacket, streamPacket, BLE_STREAM_HEADER_SIZE);
+    streamClientPacket[0] |= BLE_STREAM_FLAG_CLIENT_TIME;
+    memcpy(&streamClientPacket[BLE_STREAM_HEADER_SIZE], &clientUs[i], sizeof(clientUs[i]));
+    memcpy(&streamClientPacket[BLE_STREAM_HEADER_SIZE + BLE_STREAM_CLIENT_TIME_SIZE],
+           &streamPacket[BLE_STREAM_HEADER_SIZE], streamLen - BLE_STREAM_HEADER_SIZE);
+    notifyClient(conns[i], pWeightStreamCharacteristic, streamClientPacket, streamLen + BLE_STREAM_CLIENT_TIME_SIZE);
+  }
+  streamCount = 0;
+  streamLen = 0;
+}
+
+/**
+ * Add a weight sample to the weight stream
+ * 
+ * Samples are numbered even while nobody is subscribed, so a client can tell
+ * from the sequence numbers how many it missed.
+ * 
+ * @param weight Filtered weight in grams
+ * @param raw Unfiltered weight in grams
+ */
+void streamBLESample(float weight, float raw) {
+  uint16_t seq = streamSeq++;
+  uint32_t now = millis();
+  if (pWeightStreamCharacteristic == nullptr || pWeightStreamCharacteristic->getSubscribedCount() == 0) {
+    streamCount = 0;
+    streamLen = 0;
+    return;
+  }
+
+  if (streamCount == 0) {
+    // Start a batch with the latest configuration, sized to the MTU
+    portENTER_CRITICAL(&streamConfigMux);
+    BLEStreamConfig config = streamConfig;
+    portEXIT_CRITICAL(&streamConfigMux);
+
+    size_t sampleSize = BLE_STREAM_SAMPLE_SIZE(config.flags);
+    size_t payload = streamPayloadSize();
+    size_t header = BLE_STREAM_HEADER_SIZE + BLE_STREAM_CLIENT_TIME_SIZE; // Room for a client time
+    size_t fit = payload > header ? (payload - header) / sampleSize : 0;
+    if (fit == 0) {
+      return; // MTU below the header and one sample, can't happen with the minimum of 23
+    }
+    streamLimit = min((size_t)config.batch, fit);
+    streamFlags = config.flags & BLE_STREAM_FLAG_RAW;
+    streamFlushMs = config.flush_ms;
+    streamFirstTime = now;
+    streamFirstUs = esp_timer_get_time();
+    streamLastTime = now;
+
+    streamPacket[0] = streamFlags;
+    streamPacket[1] = 0;
+    memcpy(&streamPacket[2], &seq, sizeof(seq));
+    memcpy(&streamPacket[4], &now, sizeof(now));
+    streamLen = BLE_STREAM_HEADER_SIZE;
+  }
+
+  uint16_t dt = min(now - streamLastTime, (uint32_t)UINT16_MAX);
+  streamLastTime = now;
+  memcpy(&streamPacket[streamLen], &dt, sizeof(dt));
+  memcpy(&streamPacket[streamLen + 2], &weight, sizeof(weight));
+  streamLen += 6;
+  if (streamFlags & BLE_STREAM_FLAG_RAW) {
+    memcpy(&streamPacket[streamLen], &raw, sizeof(raw));
+    streamLen += 4;
+  }
+  streamCount++;
+
+  if (streamCount >= streamLimit) {
+    flushStream();
   }
 }
 
@@ -210,16 +1279,357 @@ void updateBLETimer(float timer) {
   }
 }
 
+/**
+ * Acknowledge a finished command
+ * 
+ * Called by the command bus from the loop task, from the tare task once a
+ * tare is done, from the web server task and from the NimBLE task for
+ * commands that never made it into the queue. A value set and then
+ * notified could be replaced in between, so each subscriber is sent the
+ * ack itself.
+ * Commands finished flag a state change, so the state characteristic
+ * reflects them together with the acknowledgement.
+ * 
+ * @param req The command, its source and sequence number
+ * @param status How it ended
+ */
+void ackBLECommand(const CommandRequest& req, CommandStatus status) {
+  if (pCommandStatusCharacteristic == nullptr) {
+    return;
+  }
+  BLECommandAck ack = {req.seq, (uint8_t)req.command, (uint8_t)req.source, (uint8_t)status};
+  pCommandStatusCharacteristic->setValue((const uint8_t*)&ack, sizeof(ack)); // For reads
+
+  // Each subscriber gets this ack's own copy: another task may set its ack in between
+  uint16_t conns[BLE_LINK_MAX_CONNECTIONS];
+  int count = 0;
+  portENTER_CRITICAL(&linkMux);
+  for (LinkSlot& slot : linkSlots) {
+    if (slot.used && (slot.stats.subscriptions & BLE_SUB_COMMAND_STATUS)) {
+      conns[count++] = slot.stats.conn_handle;
+    }
+  }
+  portEXIT_CRITICAL(&linkMux);
+  for (int i = 0; i < count; i++) {
+    notifyClient(conns[i], pCommandStatusCharacteristic, &ack, sizeof(ack));
+  }
+  if (status == CommandStatus::DONE) {
+    flagBLEStateChange();
+  }
+}
+
+/**
+ * Notify a history response to the client that asked
+ * 
+ * @param conn Connection handle of the client
+ * @param op Request the response is for
+ * @param status BLE_HISTORY_STATUS_*
+ * @param payload Response payload, nullptr if none
+ * @param length Payload length in bytes
+ */
+static void respondHistory(uint16_t conn, uint8_t op, uint8_t status, const void* payload, size_t length) {
+  uint8_t response[2 + sizeof(BLEHistoryDone)];
+  response[0] = op | BLE_HISTORY_RESPONSE;
+  response[1] = status;
+  if (payload != nullptr) {
+    memcpy(&response[2], payload, length);
+  }
+  notifyClient(conn, pHistoryControlCharacteristic, response, 2 + (payload != nullptr ? length : 0));
+}
+
+/**
+ * Drop the selection and stop sending
+ */
+static void clearHistory() {
+  free(historyData);
+  historyData = nullptr;
+  historySize = 0;
+  historyConn = BLE_HS_CONN_HANDLE_NONE;
+  historySending = false;
+}
+
+/**
+ * Make a new selection for a client and tell it its size and CRC
+ * 
+ * @param conn Connection handle of the client
+ * @param op LIST or SELECT
+ * @param data Selection in PSRAM, taken over
+ * @param size Selection length in bytes
+ */
+static void selectHistory(uint16_t conn, uint8_t op, uint8_t* data, size_t size) {
+  clearHistory();
+  historyData = data;
+  historySize = size;
+  historyConn = conn;
+  BLEHistorySelection selection = {(uint32_t)size, esp_rom_crc32_le(0, data, size)};
+  respondHistory(conn, op, BLE_HISTORY_STATUS_OK, &selection, sizeof(selection));
+}
+
+/**
+ * The whole selection was acknowledged: report the throughput
+ */
+static void finishHistory() {
+  BLEHistoryDone done;
+  done.size = historySize;
+  done.sent = historySent;
+  done.time_ms = max(millis() - historyStartMs, 1UL);
+  done.bytes_per_s = (uint64_t)historySize * 1000 / done.time_ms;
+  historySending = false;
+  respondHistory(historyConn, BLE_HISTORY_OP_DONE, BLE_HISTORY_STATUS_OK, &done, sizeof(done));
+  Serial.printf("History transfer: %u bytes (%u sent) in %u ms, %u bytes/s\n", done.size, done.sent, done.time_ms,
+                done.bytes_per_s);
+}
+
+/**
+ * Carry out one history request, on the transfer task
+ * 
+ * @param req The request
+ */
+static void handleHistoryRequest(const HistoryRequest& req) {
+  bool mine = req.conn == historyConn;
+  if (req.op == BLE_HISTORY_OP_ABORT) {
+    if (mine) {
+      clearHistory();
+    }
+    if (req.valid) {
+      respondHistory(req.conn, req.op, BLE_HISTORY_STATUS_OK, nullptr, 0);
+    }
+    return;
+  }
+  if (!req.valid) {
+    respondHistory(req.conn, req.op, BLE_HISTORY_STATUS_INVALID, nullptr, 0);
+    return;
+  }
+  if (!mine && historyConn != BLE_HS_CONN_HANDLE_NONE) {
+    respondHistory(req.conn, req.op, BLE_HISTORY_STATUS_BUSY, nullptr, 0);
+    return;
+  }
+
+  switch (req.op) {
+    case BLE_HISTORY_OP_LIST: {
+      ShotInfo* index = (ShotInfo*)ps_malloc(SHOT_LOG_MAX * 2 * sizeof(ShotInfo));
+      if (index == nullptr) {
+        respondHistory(req.conn, req.op, BLE_HISTORY_STATUS_NO_MEMORY, nullptr, 0);
+        break;
+      }
+      size_t count = listShots(index, SHOT_LOG_MAX * 2);
+      selectHistory(req.conn, req.op, (uint8_t*)index, count * sizeof(ShotInfo));
+      break;
+    }
+    case BLE_HISTORY_OP_SELECT: {
+      size_t size = 0;
+      uint8_t* data = loadShot(req.id, &size);
+      if (data == nullptr) {
+        respondHistory(req.conn, req.op, BLE_HISTORY_STATUS_NOT_FOUND, nullptr, 0);
+        break;
+      }
+      selectHistory(req.conn, req.op, data, size);
+      break;
+    }
+    case BLE_HISTORY_OP_START: {
+      uint16_t mtu = pServer->getPeerMTU(req.conn);
+      if (!mine || historyData == nullptr || req.offset > historySize ||
+          mtu <= 3 + BLE_HISTORY_CHUNK_HEADER) {
+        respondHistory(req.conn, req.op, BLE_HISTORY_STATUS_INVALID, nullptr, 0);
+        break;
+      }
+      historyChunk = mtu - 3 - BLE_HISTORY_CHUNK_HEADER; // ATT notification header
+      historyWindow = req.window ? min(req.window, (uint8_t)BLE_HISTORY_MAX_WINDOW) : BLE_HISTORY_DEFAULT_WINDOW;
+      historyNext = req.offset;
+      historyAcked = req.offset;
+      historyStartMs = millis();
+      historyLastAckMs = historyStartMs;
+      historySent = 0;
+      historySending = true;
+      historyBlocked = false;
+      if (historyAcked >= historySize) {
+        finishHistory();
+      }
+      break;
+    }
+    case BLE_HISTORY_OP_ACK:
+      if (mine && historySending && req.offset > historyAcked && req.offset <= historyNext) {
+        historyAcked = req.offset;
+        historyLastAckMs = millis();
+        if (historyAcked >= historySize) {
+          finishHistory();
+        }
+      }
+      break;
+    default:
+      respondHistory(req.conn, req.op, BLE_HISTORY_STATUS_INVALID, nullptr, 0);
+      break;
+  }
+}
+
+/**
+ * Whether the transfer task can send a chunk right now
+ * 
+ * @return true if a chunk is waiting and fits in the window
+ */
+static bool historyCanSend() {
+  return historySending && !historyBlocked && historyNext < historySize &&
+         historyNext - historyAcked < historyWindow * historyChunk;
+}
+
+/**
+ * Send chunks until the window is full or NimBLE runs out of buffers
+ * 
+ * Without ACKs for a while the chunks after the last acknowledged offset
+ * are sent again.
+ */
+static void pumpHistory() {
+  uint32_t now = millis();
+  if (historyNext > historyAcked && now - historyLastAckMs >= BLE_HISTORY_ACK_TIMEOUT_MS) {
+    historyNext = historyAcked;
+    historyLastAckMs = now;
+  }
+
+  historyBlocked = false;
+  uint8_t packet[BLE_HISTORY_CHUNK_HEADER + BLE_ATT_MTU_MAX];
+  while (historyCanSend()) {
+    size_t length = min(historyChunk, (size_t)(historySize - historyNext));
+    uint32_t crc = esp_rom_crc32_le(0, historyData + historyNext, length);
+    memcpy(&packet[0], &historyNext, sizeof(historyNext));
+    memcpy(&packet[4], &crc, sizeof(crc));
+    memcpy(&packet[BLE_HISTORY_CHUNK_HEADER], historyData + historyNext, length);
+    if (!notifyClient(historyConn, pHistoryDataCharacteristic, packet, BLE_HISTORY_CHUNK_HEADER + length)) {
+      historyBlocked = true; // Retried after BLE_HISTORY_RETRY_MS
+      break;
+    }
+    historyNext += length;
+    historySent += length;
+  }
+}
+
+/**
+ * History transfer task
+ * 
+ * Takes requests as they come and sends chunks in between. It sleeps while
+ * nothing is selected, and wakes up every BLE_HISTORY_RETRY_MS while a
+ * transfer waits for ACKs or buffers.
+ * 
+ * @param parameter Unused
+ */
+static void historyTask(void* parameter) {
+  HistoryRequest req;
+  for (;;) {
+    TickType_t wait = portMAX_DELAY;
+    if (historySending) {
+      wait = historyCanSend() ? 0 : pdMS_TO_TICKS(BLE_HISTORY_RETRY_MS);
+    }
+    if (xQueueReceive(historyQueue, &req, wait) == pdTRUE) {
+      handleHistoryRequest(req);
+    } else if (historySending) {
+      pumpHistory();
+    }
+  }
+}
+
+/**
+ * Set the advertisement: the service, or the name and broadcast values
+ */
+static void setAdvertisementData() {
+  NimBLEAdvertisementData adv;
+  adv.setFlags(BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP);
+  if (broadcastIntervalMs != 0) {
+    adv.setName(deviceName);
+    adv.setManufacturerData(std::string((const char*)&broadcastPayload, sizeof(broadcastPayload)));
+  } else {
+    adv.setCompleteServices(NimBLEUUID(ESPRESSISCALE_SERVICE_UUID));
+    adv.addData(std::string(connItvlAd, sizeof(connItvlAd)));
+  }
+  NimBLEDevice::getAdvertising()->setAdvertisementData(adv);
+}
+
+/**
+ * Set the scan response: the name, or the service while broadcasting
+ */
+static void setScanResponseData() {
+  NimBLEAdvertisementData scan;
+  if (broadcastIntervalMs != 0) {
+    scan.setCompleteServices(NimBLEUUID(ESPRESSISCALE_SERVICE_UUID));
+    scan.addData(std::string(connItvlAd, sizeof(connItvlAd)));
+  } else {
+    scan.setName(deviceName);
+  }
+  NimBLEDevice::getAdvertising()->setScanResponseData(scan);
+}
+
+/**
+ * Switch the weight broadcast on, off or to another interval
+ * 
+ * Advertising restarts with the new data and interval if it was running.
+ * 
+ * @param intervalMs Refresh and advertising interval in milliseconds, 0 to stop broadcasting
+ */
+void setBLEBroadcast(uint16_t intervalMs) {
+  NimBLEAdvertising* pAdvertising = NimBLEDevice::getAdvertising();
+  bool advertising = pAdvertising->isAdvertising();
+  if (advertising) {
+    pAdvertising->stop();
+  }
+  if (intervalMs == 0 && broadcastOnly) {
+    broadcastOnly = false; // Nothing left to advertise for until a client leaves
+    pAdvertising->setAdvertisementType(BLE_GAP_CONN_MODE_UND);
+    advertising = false;
+  }
+
+  broadcastIntervalMs = intervalMs != 0 ? max(intervalMs, (uint16_t)BLE_BROADCAST_MIN_MS) : 0;
+  uint16_t itvl = broadcastIntervalMs * 8 / 5; // 0.625 ms units, 0 for NimBLE's default
+  pAdvertising->setMinInterval(itvl);
+  pAdvertising->setMaxInterval(itvl);
+  setAdvertisementData();
+  setScanResponseData();
+
+  if (advertising) {
+    pAdvertising->start();
+  }
+}
+
+/**
+ * Put the latest values into the advertisement, at the broadcast interval
+ * 
+ * The advertisement is only set again when a value changed.
+ */
+static void refreshBroadcast() {
+  uint32_t now = millis();
+  if (broadcastIntervalMs == 0 || now - broadcastTime < broadcastIntervalMs) {
+    return;
+  }
+  broadcastTime = now;
+
+  BLEBroadcastPayload payload = broadcastPayload;
+  int32_t weight = scaleState.weight;
+  payload.weight = constrain((weight + (weight < 0 ? -5 : 5)) / 10, INT16_MIN, INT16_MAX);
+  payload.flow = scaleState.flow;
+  payload.timer = min(scaleState.timer_ms / 100, (uint32_t)UINT16_MAX);
+  payload.battery = scaleState.battery;
+  payload.flags = scaleState.flags;
+  if (memcmp(&payload, &broadcastPayload, sizeof(payload)) == 0) {
+    return;
+  }
+  payload.seq++;
+  broadcastPayload = payload;
+  setAdvertisementData();
+}
+
 /**
  * Process any BLE tasks in the main loop
  * 
- * This function is a placeholder for any BLE-related processing that might
- * need to happen in the main application loop. Currently, NimBLE handles
- * most tasks internally, so this function is empty.
+ * NimBLE handles the protocol internally. This falls back to phone
+ * connection parameters where the fast ones were refused, refreshes the
+ * weight broadcast, and sends the
+ * weight stream batch once its first sample has waited for the flush
+ * interval, so a slow sample rate or a large batch size doesn't hold
+ * samples back.
  * 
  * It should be called regularly in the main loop.
  */
 void processBLE() {
-  // Handle any BLE tasks that need to be processed in the main loop
-  // Currently, this is empty as NimBLE handles most tasks internally
+  checkLinkFallback();
+  refreshBroadcast();
+  if (streamCount > 0 && millis() - streamFirstTime >= streamFlushMs) {
+    flushStream();
+  }
 } 
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include "commands.h"
+#include "Arduino.h"
+#include <atomic>
+#include <string.h>
+
+// Bounded multi-producer queue (Vyukov): each cell carries the position it
+// expects next, producers claim a position with one compare-and-swap. Only
+// loop() consumes.
+struct CommandCell {
+  std::atomic<uint32_t> seq;
+  CommandRequest req;
+};
+
+struct CommandQueue {
+  CommandCell cells[COMMAND_QUEUE_LEN];
+  std::atomic<uint32_t> head;   // Next position to write
+  uint32_t tail;                // Next position to read, consumer only
+};
+
+static CommandQueue queues[2];  // Timer commands first
+static CommandHandler command_handler = nullptr;
+static CommandAckHandler ack_handler = nullptr;
+
+static void initQueue(CommandQueue &q)
+{
+  for (uint32_t i = 0; i < COMMAND_QUEUE_LEN; i++)
+    q.cells[i].seq.store(i, std::memory_order_relaxed);
+  q.head.store(0, std::memory_order_relaxed);
+  q.tail = 0;
+}
+
+static bool push(CommandQueue &q, const CommandRequest &req)
+{
+  uint32_t pos = q.head.load(std::memory_order_relaxed);
+  CommandCell *cell;
+  for (;;)
+  {
+    cell = &q.cells[pos & (COMMAND_QUEUE_LEN - 1)];
+    int32_t dif = (int32_t)(cell->seq.load(std::memory_order_acquire) - pos);
+    if (dif == 0)
+    {
+      if (q.head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        break;
+    }
+    else if (dif < 0)
+      return false; // Full
+    else
+      pos = q.head.load(std::memory_order_relaxed);
+  }
+  cell->req = req;
+  cell->seq.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+static bool pop(CommandQueue &q, CommandRequest *req)
+{
+  CommandCell &cell = q.cells[q.tail & (COMMAND_QUEUE_LEN - 1)];
+  if ((int32_t)(cell.seq.load(std::memory_order_acquire) - (q.tail + 1)) < 0)
+    return false; // Empty
+  *req = cell.req;
+  cell.seq.store(q.tail + COMMAND_QUEUE_LEN, std::memory_order_release);
+  q.tail++;
+  return true;
+}
+
+static bool initQueues()
+{
+  initQueue(queues[0]);
+  initQueue(queues[1]);
+  return true;
+}
+static bool queues_ready = initQueues();
+
+static int priorityOf(Command command)
+{
+  switch (command)
+  {
+  case Command::START_TIMER:
+  case Command::STOP_TIMER:
+  case Command::RESET_TIMER:
+  case Command::TOGGLE_TIMER:
+    return 0;
+  default:
+    return 1;
+  }
+}
+
+void setCommandHandler(CommandHandler handler)
+{
+  command_handler = handler;
+}
+
+void setCommandAckHandler(CommandAckHandler handler)
+{
+  ack_handler = handler;
+}
+
+bool postCommand(Command command, CommandSource source, uint8_t seq, uint32_t time)
+{
+  CommandRequest req = {command, source, seq, time != 0 ? time : millis()};
+  if (push(queues[priorityOf(command)], req))
+    return true;
+  finishCommand(req, CommandStatus::QUEUE_FULL);
+  return false;
+}
+
+void finishCommand(const CommandRequest &req, CommandStatus status)
+{
+  if (ack_handler)
+    ack_handler(req, status);
+}
+
+void processCommands()
+{
+  for (CommandQueue &q : queues)
+  {
+    CommandRequest req;
+    bool have_prev = false;
+    Command prev = Command::TARE;
+    while (pop(q, &req))
+    {
+      CommandStatus status;
+      if (have_prev && req.command == prev && req.command != Command::TOGGLE_TIMER)
+        status = CommandStatus::COALESCED; // A second toggle is not a repeat
+      else
+        status = command_handler ? command_handler(req) : CommandStatus::UNKNOWN;
+      prev = req.command;
+      have_prev = true;
+      if (status != CommandStatus::PENDING)
+        finishCommand(req, status);
+    }
+  }
+}
+
+static const char *const command_names[] = {"tare", "start", "stop", "reset", "toggle", "clear"};
+
+const char *commandName(Command command)
+{
+  uint8_t i = (uint8_t)command - (uint8_t)Command::TARE;
+  return i < sizeof(command_names) / sizeof(command_names[0]) ? command_names[i] : "unknown";
+}
+
+bool parseCommand(const char *name, Command *command)
+{
+  for (uint8_t i = 0; i < sizeof(command_names) / sizeof(command_names[0]); i++)
+  {
+    if (strcmp(name, command_names[i]) == 0)
+    {
+      *command = (Command)((uint8_t)Command::TARE + i);
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *commandSourceName(CommandSource source)
+{
+  switch (source)
+  {
+  case CommandSource::TOUCH:
+    return "touch";
+  case CommandSource::BLE:
+    return "BLE";
+  case CommandSource::HTTP:
+    return "HTTP";
+  }
+  return "unknown";
+}
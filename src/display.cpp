@@ -0,0 +1,178 @@
+#include "display.h"
+#include "display_stats.h"
+#include "Arduino.h"
+#include "pin_config.h"
+
+// Panel rows (LVGL columns) are compared and sent in blocks of this height.
+// Smaller blocks send fewer unchanged pixels but open more address windows.
+#define DIFF_BLOCK_ROWS  6
+#define DIFF_BLOCKS      ((TFT_HEIGHT + DIFF_BLOCK_ROWS - 1) / DIFF_BLOCK_ROWS)
+
+// Panel rows gathered per SPI burst
+#define PUSH_CHUNK_ROWS  16
+
+// CASET, RASET and RAMWR with their parameters, sent for every window
+#define WINDOW_CMD_BYTES 11
+
+// Checksums of what each panel currently shows, one per row block
+static uint32_t block_sum[2][DIFF_BLOCKS];
+static bool block_sum_valid[2] = {false, false};
+
+static uint16_t push_buf[PUSH_CHUNK_ROWS * TFT_WIDTH];
+
+void display_invalidate_panels(void)
+{
+  block_sum_valid[0] = false;
+  block_sum_valid[1] = false;
+}
+
+/*
+ * The panels are driven in their native portrait orientation, so a panel row
+ * is an LVGL column. TFT_CS_0 shows the right half flipped vertically and
+ * TFT_CS_1 the left half mirrored:
+ *   panel 0 (x, y) = frame[DISPLAY_VER_RES - 1 - x][TFT_HEIGHT + y]
+ *   panel 1 (x, y) = frame[x][TFT_HEIGHT - y]
+ */
+static inline int panel_col(int panel, int y)
+{
+  return panel == 0 ? TFT_HEIGHT + y : TFT_HEIGHT - y;
+}
+
+static uint32_t block_checksum(const uint16_t *frame, int panel, int block)
+{
+  int y0 = block * DIFF_BLOCK_ROWS;
+  int y1 = min(y0 + DIFF_BLOCK_ROWS, (int)TFT_HEIGHT) - 1;
+  int c0 = min(panel_col(panel, y0), panel_col(panel, y1));
+  int c1 = max(panel_col(panel, y0), panel_col(panel, y1));
+
+  // FNV-1a over the block's pixels
+  uint32_t h = 2166136261u;
+  for (int r = 0; r < DISPLAY_VER_RES; r++)
+  {
+    const uint16_t *p = &frame[r * DISPLAY_HOR_RES + c0];
+    for (int c = c0; c <= c1; c++)
+    {
+      h = (h ^ *p++) * 16777619u;
+    }
+  }
+  return h;
+}
+
+static void push_rows(const uint16_t *frame, int panel, int y0, int y1)
+{
+  display_stats_add_bytes(panel, WINDOW_CMD_BYTES + (y1 - y0 + 1) * TFT_WIDTH * 2);
+  LCD_Address_Set(0, y0, TFT_WIDTH - 1, y1);
+
+  int rows = 0;
+  for (int y = y0; y <= y1; y++)
+  {
+    const uint16_t *src = &frame[panel_col(panel, y)];
+    uint16_t *dst = &push_buf[rows * TFT_WIDTH];
+    if (panel == 0)
+    {
+      for (int x = 0; x < TFT_WIDTH; x++)
+        dst[x] = src[(DISPLAY_VER_RES - 1 - x) * DISPLAY_HOR_RES];
+    }
+    else
+    {
+      for (int x = 0; x < TFT_WIDTH; x++)
+        dst[x] = src[x * DISPLAY_HOR_RES];
+    }
+
+    if (++rows == PUSH_CHUNK_ROWS || y == y1)
+    {
+      lcd_PushPixels(push_buf, rows * TFT_WIDTH);
+      rows = 0;
+    }
+  }
+}
+
+/*
+ * Send the blocks of one panel whose checksum differs from what was last
+ * sent, merging runs of dirty blocks into a single address window.
+ * Only blocks overlapping LVGL columns [x1, x2] are examined.
+ */
+static void flush_panel(const uint16_t *frame, int panel, int x1, int x2)
+{
+  bool valid = block_sum_valid[panel];
+  int run_start = -1;
+
+  for (int b = 0; b <= DIFF_BLOCKS; b++)
+  {
+    bool dirty = false;
+    if (b < DIFF_BLOCKS)
+    {
+      int y0 = b * DIFF_BLOCK_ROWS;
+      int y1 = min(y0 + DIFF_BLOCK_ROWS, (int)TFT_HEIGHT) - 1;
+      int c0 = min(panel_col(panel, y0), panel_col(panel, y1));
+      int c1 = max(panel_col(panel, y0), panel_col(panel, y1));
+      if (!valid || (c1 >= x1 && c0 <= x2))
+      {
+        uint32_t h = block_checksum(frame, panel, b);
+        dirty = !valid || h != block_sum[panel][b];
+        block_sum[panel][b] = h;
+      }
+    }
+
+    if (dirty && run_start < 0)
+    {
+      run_start = b;
+    }
+    else if (!dirty && run_start >= 0)
+    {
+      int y1 = min(b * DIFF_BLOCK_ROWS, (int)TFT_HEIGHT) - 1;
+      if (panel == 0)
+      {
+        TFT_CS_0_L;
+        push_rows(frame, 0, run_start * DIFF_BLOCK_ROWS, y1);
+        TFT_CS_0_H;
+      }
+      else
+      {
+        TFT_CS_1_L;
+        push_rows(frame, 1, run_start * DIFF_BLOCK_ROWS, y1);
+        TFT_CS_1_H;
+      }
+      run_start = -1;
+    }
+  }
+
+  block_sum_valid[panel] = true;
+}
+
+/*
+ * LVGL renders into a single screen-sized buffer (full refresh or direct
+ * mode), so color_p always holds the complete frame. Nothing is sent until
+ * the last area of a refresh; the panels are then diffed block by block
+ * against what they already show.
+ */
+void my_disp_flush(lv_disp_drv_t *disp, const lv_area_t *area, lv_color_t *color_p)
+{
+  if (!lv_disp_flush_is_last(disp))
+  {
+    lv_disp_flush_ready(disp);
+    return;
+  }
+
+  // Limit checksumming to the columns LVGL invalidated this refresh
+  int x1 = 0;
+  int x2 = DISPLAY_HOR_RES - 1;
+  lv_disp_t *d = _lv_refr_get_disp_refreshing();
+  if (d != NULL && d->driver == disp && d->inv_p > 0)
+  {
+    x1 = DISPLAY_HOR_RES;
+    x2 = -1;
+    for (uint32_t i = 0; i < d->inv_p; i++)
+    {
+      if (d->inv_area_joined[i]) continue;
+      x1 = min(x1, (int)d->inv_areas[i].x1);
+      x2 = max(x2, (int)d->inv_areas[i].x2);
+    }
+  }
+
+  const uint16_t *frame = (const uint16_t *)&color_p->full;
+  flush_panel(frame, 0, x1, x2);
+  flush_panel(frame, 1, x1, x2);
+
+  lv_disp_flush_ready(disp);
+}
@@ -0,0 +1,93 @@
+#include "display_power.h"
+#include "Arduino.h"
+#include "jd9613.h"
+#include "pin_config.h"
+
+// The panel needs 120 ms between sleep-in and sleep-out
+#define SLEEP_IN_SETTLE_MS 120
+
+static DisplayPowerState state = DisplayPowerState::ACTIVE;
+static unsigned long last_activity = 0;
+static unsigned long sleep_in_time = 0;
+
+static void setBrightness(uint8_t level)
+{
+  TFT_CS_0_L;
+  TFT_CS_1_L;
+  lcd_setBrightness(level);
+  TFT_CS_0_H;
+  TFT_CS_1_H;
+}
+
+static void setSleep(bool enter)
+{
+  TFT_CS_0_L;
+  TFT_CS_1_L;
+  lcd_sleep(enter);
+  TFT_CS_0_H;
+  TFT_CS_1_H;
+}
+
+void setupDisplayPower()
+{
+  state = DisplayPowerState::ACTIVE;
+  last_activity = millis();
+}
+
+void wakeDisplay()
+{
+  last_activity = millis();
+
+  if (state == DisplayPowerState::ACTIVE)
+    return;
+
+  if (state == DisplayPowerState::SLEEPING)
+  {
+    unsigned long since = millis() - sleep_in_time;
+    if (since < SLEEP_IN_SETTLE_MS)
+      delay(SLEEP_IN_SETTLE_MS - since);
+    setSleep(false);
+  }
+  setBrightness(DISPLAY_BRIGHTNESS_FULL);
+  state = DisplayPowerState::ACTIVE;
+}
+
+void sleepDisplay()
+{
+  if (state == DisplayPowerState::SLEEPING)
+    return;
+
+  setSleep(true);
+  sleep_in_time = millis();
+  state = DisplayPowerState::SLEEPING;
+}
+
+void updateDisplayPower(bool busy)
+{
+  if (busy)
+  {
+    wakeDisplay();
+    return;
+  }
+
+  unsigned long idle = millis() - last_activity;
+  if (state == DisplayPowerState::ACTIVE && idle >= DISPLAY_DIM_TIMEOUT_MS)
+  {
+    setBrightness(DISPLAY_BRIGHTNESS_DIM);
+    state = DisplayPowerState::DIMMED;
+  }
+  if (state == DisplayPowerState::DIMMED && idle >= DISPLAY_SLEEP_TIMEOUT_MS)
+  {
+    sleepDisplay();
+  }
+}
+
+DisplayPowerState getDisplayPowerState()
+{
+  return state;
+}
+
+bool isDisplayAwake()
+{
+  return state != DisplayPowerState::SLEEPING;
+}
@@ -0,0 +1,179 @@
+#include "display_stats.h"
+#include "Arduino.h"
+#include "lvgl.h"
+#include <stdarg.h>
+#include <string.h>
+
+// The ring is written from the LVGL loop and read from the web server and
+// NimBLE tasks, so records go in and out under a short critical section
+#ifdef ESP_PLATFORM
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+#define STATS_LOCK()   portENTER_CRITICAL(&stats_mux)
+#define STATS_UNLOCK() portEXIT_CRITICAL(&stats_mux)
+#else
+#define STATS_LOCK()
+#define STATS_UNLOCK()
+#endif
+
+static display_frame_t ring[DISPLAY_STATS_RECORDS];
+static uint32_t ring_head = 0;  // Next record to write
+static uint32_t ring_count = 0;
+
+// The frame being refreshed, only touched from the LVGL loop
+static display_frame_t cur;
+static bool in_frame = false;
+static uint32_t frame_start, part_start, wait_start, flush_start;
+
+static const uint32_t bucket_limit_us[DISPLAY_STATS_BUCKETS - 1] = {500, 1000, 2000, 4000, 8000, 16000, 32000};
+
+static int bucket(uint32_t us)
+{
+  int b = 0;
+  while (b < DISPLAY_STATS_BUCKETS - 1 && us >= bucket_limit_us[b])
+    b++;
+  return b;
+}
+
+void display_stats_trace(uint8_t event, uint32_t value)
+{
+  uint32_t now = micros();
+  switch (event)
+  {
+  case LV_REFR_PROFILER_FRAME_START:
+    memset(&cur, 0, sizeof(cur));
+    cur.time_ms = millis();
+    cur.areas = value;
+    frame_start = now;
+    in_frame = true;
+    break;
+  case LV_REFR_PROFILER_PART_START:
+    cur.pixels += value;
+    cur.parts++;
+    part_start = now;
+    break;
+  case LV_REFR_PROFILER_PART_END:
+    cur.render_us += now - part_start;
+    break;
+  case LV_REFR_PROFILER_WAIT_START:
+    wait_start = now;
+    break;
+  case LV_REFR_PROFILER_WAIT_END:
+    cur.wait_us += now - wait_start;
+    break;
+  case LV_REFR_PROFILER_FLUSH_START:
+    flush_start = now;
+    break;
+  case LV_REFR_PROFILER_FLUSH_END:
+    cur.flush_us += now - flush_start;
+    break;
+  case LV_REFR_PROFILER_FRAME_END:
+    if (!in_frame)
+      break;
+    cur.frame_us = now - frame_start;
+    in_frame = false;
+    STATS_LOCK();
+    ring[ring_head] = cur;
+    ring_head = (ring_head + 1) % DISPLAY_STATS_RECORDS;
+    if (ring_count < DISPLAY_STATS_RECORDS)
+      ring_count++;
+    STATS_UNLOCK();
+    break;
+  }
+}
+
+void display_stats_add_bytes(int panel, uint32_t bytes)
+{
+  if (in_frame && panel >= 0 && panel < DISPLAY_STATS_PANELS)
+    cur.bytes[panel] += bytes;
+}
+
+uint32_t display_stats_get_frames(display_frame_t *out, uint32_t max)
+{
+  STATS_LOCK();
+  uint32_t n = ring_count < max ? ring_count : max;
+  uint32_t first = (ring_head + DISPLAY_STATS_RECORDS - n) % DISPLAY_STATS_RECORDS;
+  for (uint32_t i = 0; i < n; i++)
+    out[i] = ring[(first + i) % DISPLAY_STATS_RECORDS];
+  STATS_UNLOCK();
+  return n;
+}
+
+void display_stats_get_histogram(display_stats_histogram_t *hist)
+{
+  memset(hist, 0, sizeof(*hist));
+  uint64_t pixels = 0;
+  uint64_t bytes[DISPLAY_STATS_PANELS] = {0};
+
+  // Summed in place: no room for a copy of the ring on the callers' stacks
+  STATS_LOCK();
+  uint32_t n = ring_count;
+  for (uint32_t i = 0; i < n; i++)
+  {
+    const display_frame_t &f = ring[i];
+    hist->frame[bucket(f.frame_us)]++;
+    hist->render[bucket(f.render_us)]++;
+    hist->flush[bucket(f.flush_us)]++;
+    hist->wait[bucket(f.wait_us)]++;
+    if (f.frame_us > hist->max_frame_us)
+      hist->max_frame_us = f.frame_us;
+    pixels += f.pixels;
+    for (int p = 0; p < DISPLAY_STATS_PANELS; p++)
+      bytes[p] += f.bytes[p];
+  }
+  STATS_UNLOCK();
+
+  hist->frames = n;
+  if (n > 0)
+  {
+    hist->avg_pixels = pixels / n;
+    for (int p = 0; p < DISPLAY_STATS_PANELS; p++)
+      hist->avg_bytes[p] = bytes[p] / n;
+  }
+}
+
+static void append(char *buf, size_t size, size_t *len, const char *fmt, ...)
+{
+  if (*len >= size)
+    return;
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(buf + *len, size - *len, fmt, args);
+  va_end(args);
+  if (n > 0)
+    *len += n;
+}
+
+size_t display_stats_format(char *buf, size_t size)
+{
+  display_stats_histogram_t h;
+  display_stats_get_histogram(&h);
+
+  static const char *const names[] = {"frame", "render", "flush", "wait"};
+  // Copied out, the histogram is packed for BLE and its rows may be unaligned
+  uint16_t rows[4][DISPLAY_STATS_BUCKETS];
+  memcpy(rows[0], h.frame, sizeof(rows[0]));
+  memcpy(rows[1], h.render, sizeof(rows[1]));
+  memcpy(rows[2], h.flush, sizeof(rows[2]));
+  memcpy(rows[3], h.wait, sizeof(rows[3]));
+
+  size_t len = 0;
+  append(buf, size, &len, "display: %u frames, max frame %.1f ms, %u px, %u/%u bytes per frame\n", h.frames,
+         h.max_frame_us / 1000.0f, h.avg_pixels, h.avg_bytes[0], h.avg_bytes[1]);
+  append(buf, size, &len, "%-7s %5s %5s %5s %5s %5s %5s %5s %5s\n", "ms", "<0.5", "<1", "<2", "<4", "<8", "<16", "<32", ">=32");
+  for (int r = 0; r < 4; r++)
+  {
+    append(buf, size, &len, "%-7s", names[r]);
+    for (int b = 0; b < DISPLAY_STATS_BUCKETS; b++)
+      append(buf, size, &len, " %5u", rows[r][b]);
+    append(buf, size, &len, "\n");
+  }
+  return len < size ? len : size - 1;
+}
+
+void display_stats_reset(void)
+{
+  STATS_LOCK();
+  ring_head = 0;
+  ring_count = 0;
+  STATS_UNLOCK();
+}
@@ -5,6 +5,7 @@
 float sampleBuffer[WINDOW_SIZE];
 int sampleIndex = 0;
 bool bufferFilled = false;
+static float lastRaw = 0;
 
 // Function for finding median value in array
 float getMedian(float arr[], int n) {
@@ -31,6 +32,7 @@ float getMedian(float arr[], int n) {
 
 float medianFilter(){
     float nyVerdi = updateScale();
+    lastRaw = nyVerdi;
 
     // Put value in buffer and calculate median value
     sampleBuffer[sampleIndex] = nyVerdi;
@@ -50,4 +52,8 @@ float medianFilter(){
       filteredWeight = 0;
     }
     return filteredWeight;
-}
\ No newline at end of file
+}
+
+float lastRawWeight(){
+    return lastRaw;
+}
@@ -0,0 +1,161 @@
+#include "gesture.h"
+#include "Arduino.h"
+#include "display.h"
+
+#define GESTURE_QUEUE_LEN 4
+
+enum class TouchState : uint8_t {
+  IDLE,
+  DOWN,     // Pressed, could still become any gesture
+  HELD      // Long-press sent, waiting for the release
+};
+
+static GestureTimings timings = {GESTURE_TAP_MAX_MS, GESTURE_DOUBLE_TAP_MS, GESTURE_LONG_PRESS_MS, GESTURE_SWIPE_MIN_PX};
+
+static TouchState state = TouchState::IDLE;
+static TouchPoint down;               // Where and when the finger went down
+static TouchPoint last;               // Latest report of this touch
+
+// A tap waits out the double-tap window before it is sent, on panels that have one
+static bool double_tap[2] = {true, true};   // By GesturePanel
+static bool tap_pending = false;
+static GesturePanel tap_panel;
+static uint32_t tap_time;             // Release of the pending tap
+
+static Gesture queue[GESTURE_QUEUE_LEN];
+static uint8_t queue_head = 0;
+static uint8_t queue_count = 0;
+
+static void emit(GestureType type, GesturePanel panel, uint32_t time)
+{
+  if (queue_count == GESTURE_QUEUE_LEN)
+    return; // loop() is not polling, older gestures win
+  Gesture &g = queue[(queue_head + queue_count) % GESTURE_QUEUE_LEN];
+  g.type = type;
+  g.panel = panel;
+  g.time = time;
+  queue_count++;
+}
+
+static GesturePanel panelAt(const TouchPoint &p)
+{
+  return p.x < DISPLAY_HOR_RES / 2 && !p.in_gap ? GesturePanel::LEFT : GesturePanel::RIGHT;
+}
+
+static void flushTap(uint32_t now)
+{
+  if (tap_pending && now - tap_time > timings.double_tap_ms)
+  {
+    emit(GestureType::TAP, tap_panel, tap_time);
+    tap_pending = false;
+  }
+}
+
+static void released(const TouchPoint &p)
+{
+  int dx = last.x - down.x;
+  int dy = last.y - down.y;
+  int adx = dx < 0 ? -dx : dx;
+  int ady = dy < 0 ? -dy : dy;
+  GesturePanel panel = panelAt(down);
+
+  if (adx >= timings.swipe_min_px || ady >= timings.swipe_min_px)
+  {
+    if (adx >= ady)
+      emit(dx < 0 ? GestureType::SWIPE_LEFT : GestureType::SWIPE_RIGHT, panel, p.time);
+    else
+      emit(dy < 0 ? GestureType::SWIPE_UP : GestureType::SWIPE_DOWN, panel, p.time);
+  }
+  else if (p.time - down.time <= timings.tap_max_ms)
+  {
+    if (!double_tap[(uint8_t)panel])
+      emit(GestureType::TAP, panel, p.time);
+    else if (tap_pending && tap_panel == panel)
+    {
+      emit(GestureType::DOUBLE_TAP, panel, p.time);
+      tap_pending = false;
+    }
+    else
+    {
+      tap_pending = true;
+      tap_panel = panel;
+      tap_time = p.time;
+    }
+  }
+  // Pressed too long for a tap, too short for a long-press: nothing
+}
+
+void setGestureTimings(const GestureTimings &t)
+{
+  timings = t;
+}
+
+void setGestureDoubleTap(GesturePanel panel, bool enabled)
+{
+  double_tap[(uint8_t)panel] = enabled;
+  if (!enabled && tap_pending && tap_panel == panel)
+  {
+    emit(GestureType::TAP, tap_panel, tap_time);
+    tap_pending = false;
+  }
+}
+
+void resetGestures()
+{
+  state = TouchState::IDLE;
+  tap_pending = false;
+}
+
+void feedGesture(const TouchPoint &p)
+{
+  switch (state)
+  {
+  case TouchState::IDLE:
+    if (!p.pressed)
+      break;
+    flushTap(p.time); // A press after the window ends the pending tap
+    if (tap_pending && panelAt(p) != tap_panel)
+    {
+      emit(GestureType::TAP, tap_panel, tap_time);
+      tap_pending = false;
+    }
+    down = p;
+    last = p;
+    state = TouchState::DOWN;
+    break;
+
+  case TouchState::DOWN:
+    if (!p.pressed)
+    {
+      released(p);
+      state = TouchState::IDLE;
+      break;
+    }
+    last = p;
+    if (abs(p.x - down.x) < timings.swipe_min_px && abs(p.y - down.y) < timings.swipe_min_px &&
+        p.time - down.time >= timings.long_press_ms)
+    {
+      tap_pending = false;
+      emit(GestureType::LONG_PRESS, panelAt(down), p.time);
+      state = TouchState::HELD;
+    }
+    break;
+
+  case TouchState::HELD:
+    if (!p.pressed)
+      state = TouchState::IDLE;
+    break;
+  }
+}
+
+bool pollGesture(uint32_t now, Gesture *g)
+{
+  if (state == TouchState::IDLE)
+    flushTap(now);
+  if (queue_count == 0)
+    return false;
+  *g = queue[queue_head];
+  queue_head = (queue_head + 1) % GESTURE_QUEUE_LEN;
+  queue_count--;
+  return true;
+}
@@ -164,6 +164,26 @@ void jd9613_init(void)
     TFT_CS_1_H;
 }
 
+void lcd_setBrightness(uint8_t level)
+{
+    WriteComm(0x51);
+    WriteData(level);
+}
+
+void lcd_sleep(bool enter)
+{
+    if (enter)
+    {
+        WriteComm(0x28); // Display off
+        WriteComm(0x10); // Sleep in, panel RAM is retained
+    }
+    else
+    {
+        WriteComm(0x11); // Sleep out
+        delay(5);        // Required before the next command
+        WriteComm(0x29); // Display on
+    }
+}
 
 void lcd_setRotation(uint8_t r)
 {
@@ -231,6 +251,14 @@ void lcd_PushColors(uint16_t *data, uint32_t len)
     SPI.endTransaction();
 }
 
+void lcd_PushPixels(const uint16_t *data, uint32_t len)
+{
+    SPI.beginTransaction(SPISettings(SPI_FREQUENCY, MSBFIRST, TFT_SPI_MODE));
+    TFT_DC_H;
+    SPI.writePixels(data, len * 2); // Each pixel high byte first, same as write16()
+    SPI.endTransaction();
+}
+
 void lcd_PushColors_SoftRotation(uint16_t  x,
                                  uint16_t  y,
                                  uint16_t  width,
@@ -0,0 +1,243 @@
+/**
+ * @file lv_alloc.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "lv_alloc.h"
+#include <stdlib.h>
+#include <string.h>
+#include "lvgl.h"
+#include "src/misc/lv_tlsf.h"
+
+#ifdef ESP_PLATFORM
+    #include "esp_heap_caps.h"
+    #define POOL_ALLOC(size) heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#else
+    #define POOL_ALLOC(size) malloc(size)
+#endif
+
+#if LV_MEM_CUSTOM_TLSF == 0
+    #error "lv_alloc needs LV_MEM_CUSTOM_TLSF 1 in lv_conf.h"
+#endif
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+typedef struct slab_block {
+    struct slab_block * next;
+} slab_block_t;
+
+typedef struct {
+    uint8_t * start;
+    uint8_t * end;
+    slab_block_t * free_list;
+} slab_t;
+
+typedef struct {
+    uint32_t total;
+    uint32_t biggest;
+} free_walk_t;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+static int find_slab(const void * p);
+static bool in_pool(const void * p);
+static void * pool_alloc(size_t size);
+static void stats_add(uint32_t size);
+static void walker(void * ptr, size_t size, int used, void * user);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+/*Sized after the peaks of the scale's screen in host/alloc_bench with headroom:
+ *lv_ll nodes, style entries and label texts are the small classes, objects
+ *and their specific attributes the larger ones*/
+static const uint16_t slab_size[LV_ALLOC_SLAB_CLASSES] = {16, 32, 64, 128};
+static const uint16_t slab_count[LV_ALLOC_SLAB_CLASSES] = {32, 48, 48, 24};
+
+static lv_tlsf_t tlsf;
+static uint8_t * pool_start;
+static uint8_t * pool_end;
+static slab_t slabs[LV_ALLOC_SLAB_CLASSES];
+static lv_alloc_stats_t stats;
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+void lv_alloc_init(void)
+{
+    if(tlsf) return;
+
+    pool_start = POOL_ALLOC(LV_MEM_SIZE);
+    if(pool_start == NULL) return;   /*Everything goes to the system heap*/
+    pool_end = pool_start + LV_MEM_SIZE;
+    tlsf = lv_tlsf_create_with_pool(pool_start, LV_MEM_SIZE);
+    stats.pool_size = LV_MEM_SIZE;
+
+    /*The slabs are taken first, so they sit at the start of the pool for good*/
+    uint32_t c;
+    for(c = 0; c < LV_ALLOC_SLAB_CLASSES; c++) {
+        uint8_t * mem = lv_tlsf_malloc(tlsf, slab_size[c] * slab_count[c]);
+        if(mem == NULL) break;
+        slabs[c].start = mem;
+        slabs[c].end = mem + slab_size[c] * slab_count[c];
+        slabs[c].free_list = NULL;
+
+        /*Hand the blocks out in address order*/
+        uint32_t i;
+        for(i = slab_count[c]; i > 0; i--) {
+            slab_block_t * b = (slab_block_t *)(mem + (i - 1) * slab_size[c]);
+            b->next = slabs[c].free_list;
+            slabs[c].free_list = b;
+        }
+        stats.slab_total[c] = slab_count[c];
+    }
+}
+
+void * lv_alloc_malloc(size_t size)
+{
+    if(tlsf == NULL) lv_alloc_init();
+    stats.alloc_cnt++;
+
+    /*The smallest slab class that fits and still has a free block*/
+    uint32_t c;
+    for(c = 0; c < LV_ALLOC_SLAB_CLASSES; c++) {
+        if(size > slab_size[c] || slabs[c].free_list == NULL) continue;
+        slab_block_t * b = slabs[c].free_list;
+        slabs[c].free_list = b->next;
+        stats.slab_used[c]++;
+        if(stats.slab_used[c] > stats.slab_peak[c]) stats.slab_peak[c] = stats.slab_used[c];
+        stats_add(slab_size[c]);
+        return b;
+    }
+
+    return pool_alloc(size);
+}
+
+void lv_alloc_free(void * p)
+{
+    if(p == NULL) return;
+    stats.free_cnt++;
+
+    int c = find_slab(p);
+    if(c >= 0) {
+        slab_block_t * b = p;
+        b->next = slabs[c].free_list;
+        slabs[c].free_list = b;
+        stats.slab_used[c]--;
+        stats.used -= slab_size[c];
+    }
+    else if(in_pool(p)) {
+        stats.used -= lv_tlsf_block_size(p);
+        lv_tlsf_free(tlsf, p);
+    }
+    else {
+        free(p);
+    }
+}
+
+void * lv_alloc_realloc(void * p, size_t size)
+{
+    if(p == NULL) return lv_alloc_malloc(size);
+
+    size_t old_size;
+    int c = find_slab(p);
+    if(c >= 0) {
+        if(size <= slab_size[c]) return p;
+        old_size = slab_size[c];
+    }
+    else if(in_pool(p)) {
+        old_size = lv_tlsf_block_size(p);
+        void * new_p = lv_tlsf_realloc(tlsf, p, size);
+        if(new_p) {
+            stats.used -= old_size;
+            stats_add(lv_tlsf_block_size(new_p));
+            return new_p;
+        }
+    }
+    else {
+        /*Already on the system heap*/
+        void * new_p = realloc(p, size);
+        if(new_p == NULL) stats.failures++;
+        return new_p;
+    }
+
+    /*Move out of the slab or the full pool*/
+    void * new_p = lv_alloc_malloc(size);
+    if(new_p == NULL) return NULL;
+    memcpy(new_p, p, LV_MIN(old_size, size));
+    lv_alloc_free(p);
+    return new_p;
+}
+
+void lv_alloc_get_stats(lv_alloc_stats_t * s)
+{
+    *s = stats;
+    s->free_biggest = 0;
+    s->frag_pct = 0;
+    if(tlsf == NULL) return;
+
+    free_walk_t w = {0, 0};
+    lv_tlsf_walk_pool(lv_tlsf_get_pool(tlsf), walker, &w);
+    s->free_biggest = w.biggest;
+    if(w.total > 0) s->frag_pct = 100 - (uint8_t)((uint64_t)w.biggest * 100 / w.total);
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static int find_slab(const void * p)
+{
+    const uint8_t * b = p;
+    int c;
+    for(c = 0; c < LV_ALLOC_SLAB_CLASSES; c++) {
+        if(b >= slabs[c].start && b < slabs[c].end) return c;
+    }
+    return -1;
+}
+
+static bool in_pool(const void * p)
+{
+    const uint8_t * b = p;
+    return b >= pool_start && b < pool_end;
+}
+
+static void * pool_alloc(size_t size)
+{
+    void * p = tlsf ? lv_tlsf_malloc(tlsf, size) : NULL;
+    if(p) {
+        stats_add(lv_tlsf_block_size(p));
+        return p;
+    }
+
+    p = malloc(size);
+    if(p) stats.fallbacks++;
+    else stats.failures++;
+    return p;
+}
+
+static void stats_add(uint32_t size)
+{
+    stats.used += size;
+    if(stats.used > stats.peak) stats.peak = stats.used;
+}
+
+static void walker(void * ptr, size_t size, int used, void * user)
+{
+    LV_UNUSED(ptr);
+    if(used) return;
+
+    free_walk_t * w = user;
+    w->total += size;
+    if(size > w->biggest) w->biggest = size;
+}
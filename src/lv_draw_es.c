@@ -0,0 +1,380 @@
+/**
+ * @file lv_draw_es.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "lv_draw_es.h"
+#include <string.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+/*Channels of two swapped RGB565 pixels spread to 16-bit lanes of a word.
+ *A pixel is G[2:0] R[4:0] B[4:0] G[5:3] from bit 0, the first one is in the low half.*/
+#define LANE_5      0x001F001FU
+#define LANE_3      0x00070007U
+#define LANE_8      0x00FF00FFU
+#define LANE_ONE    0x00010001U
+#define LANE_ROUND  ((uint32_t)LV_COLOR_MIX_ROUND_OFS * LANE_ONE)
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+LV_ATTRIBUTE_FAST_MEM static void letter_4bpp(lv_draw_es_ctx_t * es_draw_ctx, lv_color_t color, const lv_area_t * area,
+                                              const lv_point_t * pos, int32_t box_w, const uint8_t * map_p);
+static inline uint32_t lanes_r(uint32_t w);
+static inline uint32_t lanes_g(uint32_t w);
+static inline uint32_t lanes_b(uint32_t w);
+static inline uint32_t lanes_div255(uint32_t x);
+static inline uint32_t lanes_pack(uint32_t r, uint32_t g, uint32_t b);
+static inline uint32_t load2(const lv_color_t * p);
+static inline void fill_mask_px(lv_color_t * d, lv_color_t color, uint32_t frb, uint32_t fg, uint32_t m);
+LV_ATTRIBUTE_FAST_MEM static void fill_opa(lv_color_t * dest_buf, int32_t w, int32_t h, lv_coord_t dest_stride,
+                                           lv_color_t color, lv_opa_t opa);
+LV_ATTRIBUTE_FAST_MEM static void fill_mask(lv_color_t * dest_buf, int32_t w, int32_t h, lv_coord_t dest_stride,
+                                            lv_color_t color, const lv_opa_t * mask, lv_coord_t mask_stride);
+LV_ATTRIBUTE_FAST_MEM static void map_opa(lv_color_t * dest_buf, int32_t w, int32_t h, lv_coord_t dest_stride,
+                                          const lv_color_t * src_buf, lv_coord_t src_stride, lv_opa_t opa);
+
+/**********************
+ *  GLOBAL VARIABLES
+ **********************/
+extern const uint8_t _lv_bpp4_opa_table[16];
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+void lv_draw_es_ctx_init(lv_disp_drv_t * drv, lv_draw_ctx_t * draw_ctx)
+{
+    lv_draw_sw_init_ctx(drv, draw_ctx);
+
+    lv_draw_es_ctx_t * es_draw_ctx = (lv_draw_es_ctx_t *)draw_ctx;
+    es_draw_ctx->base_sw.blend = lv_draw_es_blend;
+    es_draw_ctx->base_sw.base_draw.draw_letter = lv_draw_es_letter;
+    es_draw_ctx->ramp_valid = 0;
+}
+
+void lv_draw_es_ctx_deinit(lv_disp_drv_t * drv, lv_draw_ctx_t * draw_ctx)
+{
+    lv_draw_sw_deinit_ctx(drv, draw_ctx);
+}
+
+LV_ATTRIBUTE_FAST_MEM void lv_draw_es_blend(lv_draw_ctx_t * draw_ctx, const lv_draw_sw_blend_dsc_t * dsc)
+{
+    const lv_opa_t * mask;
+    if(dsc->mask_buf && dsc->mask_res == LV_DRAW_MASK_RES_TRANSP) return;
+    else if(dsc->mask_res == LV_DRAW_MASK_RES_FULL_COVER) mask = NULL;
+    else mask = dsc->mask_buf;
+
+    /*Leave what the kernels don't cover to the stock renderer*/
+    lv_disp_t * disp = _lv_refr_get_disp_refreshing();
+    if(disp->driver->set_px_cb || dsc->blend_mode != LV_BLEND_MODE_NORMAL ||
+       (mask && (dsc->src_buf || dsc->opa < LV_OPA_MAX))) {
+        lv_draw_sw_blend_basic(draw_ctx, dsc);
+        return;
+    }
+
+    lv_area_t blend_area;
+    if(!_lv_area_intersect(&blend_area, dsc->blend_area, draw_ctx->clip_area)) return;
+
+    lv_coord_t dest_stride = lv_area_get_width(draw_ctx->buf_area);
+    lv_color_t * dest_buf = draw_ctx->buf;
+    dest_buf += dest_stride * (blend_area.y1 - draw_ctx->buf_area->y1) + (blend_area.x1 - draw_ctx->buf_area->x1);
+
+    int32_t w = lv_area_get_width(&blend_area);
+    int32_t h = lv_area_get_height(&blend_area);
+
+    if(dsc->src_buf) {
+        lv_coord_t src_stride = lv_area_get_width(dsc->blend_area);
+        const lv_color_t * src_buf = dsc->src_buf;
+        src_buf += src_stride * (blend_area.y1 - dsc->blend_area->y1) + (blend_area.x1 - dsc->blend_area->x1);
+
+        if(dsc->opa >= LV_OPA_MAX) {
+            int32_t y;
+            for(y = 0; y < h; y++) {
+                lv_memcpy(dest_buf, src_buf, w * sizeof(lv_color_t));
+                dest_buf += dest_stride;
+                src_buf += src_stride;
+            }
+        }
+        else {
+            map_opa(dest_buf, w, h, dest_stride, src_buf, src_stride, dsc->opa);
+        }
+    }
+    else if(mask) {
+        /*Same (reversed) offset as lv_draw_sw_blend_basic(), mask_area is the blend area in practice*/
+        lv_coord_t mask_stride = lv_area_get_width(dsc->mask_area);
+        mask += mask_stride * (dsc->mask_area->y1 - blend_area.y1) + (dsc->mask_area->x1 - blend_area.x1);
+        fill_mask(dest_buf, w, h, dest_stride, dsc->color, mask, mask_stride);
+    }
+    else if(dsc->opa >= LV_OPA_MAX) {
+        /*lv_color_fill() already stores words, but full width rows can be one run*/
+        if(w == dest_stride) {
+            lv_color_fill(dest_buf, dsc->color, w * h);
+        }
+        else {
+            int32_t y;
+            for(y = 0; y < h; y++) {
+                lv_color_fill(dest_buf, dsc->color, w);
+                dest_buf += dest_stride;
+            }
+        }
+    }
+    else {
+        fill_opa(dest_buf, w, h, dest_stride, dsc->color, dsc->opa);
+    }
+}
+
+LV_ATTRIBUTE_FAST_MEM void lv_draw_es_letter(lv_draw_ctx_t * draw_ctx, const lv_draw_label_dsc_t * dsc,
+                                             const lv_point_t * pos_p, uint32_t letter)
+{
+    lv_font_glyph_dsc_t g;
+    if(dsc->opa < LV_OPA_MAX || dsc->blend_mode != LV_BLEND_MODE_NORMAL ||
+       !lv_font_get_glyph_dsc(dsc->font, &g, letter, '\0') || g.bpp != 4 || g.resolved_font->subpx) {
+        lv_draw_sw_letter(draw_ctx, dsc, pos_p, letter);
+        return;
+    }
+
+    /*Don't draw anything if the character is empty. E.g. space*/
+    if((g.box_h == 0) || (g.box_w == 0)) return;
+
+    /*Same placement and clipping as lv_draw_sw_letter()*/
+    lv_point_t gpos;
+    gpos.x = pos_p->x + g.ofs_x;
+    gpos.y = pos_p->y + (dsc->font->line_height - dsc->font->base_line) - g.box_h - g.ofs_y;
+
+    lv_area_t area;
+    area.x1 = gpos.x;
+    area.y1 = gpos.y;
+    area.x2 = gpos.x + g.box_w - 1;
+    area.y2 = gpos.y + g.box_h - 1;
+    if(!_lv_area_intersect(&area, &area, draw_ctx->clip_area)) return;
+
+    const uint8_t * map_p = lv_font_get_glyph_bitmap(g.resolved_font, letter);
+    lv_disp_t * disp = _lv_refr_get_disp_refreshing();
+    if(map_p == NULL || disp->driver->set_px_cb || lv_draw_mask_is_any(&area)) {
+        lv_draw_sw_letter(draw_ctx, dsc, pos_p, letter);
+        return;
+    }
+
+    if(draw_ctx->wait_for_finish) draw_ctx->wait_for_finish(draw_ctx);
+
+    letter_4bpp((lv_draw_es_ctx_t *)draw_ctx, dsc->color, &area, &gpos, g.box_w, map_p);
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/*Glyph shades straight to the buffer: 0 keeps the background, 15 is the text color,
+ *the rest come from the ramp, as lv_color_mix(color, bg, _lv_bpp4_opa_table[shade]) would*/
+LV_ATTRIBUTE_FAST_MEM static void letter_4bpp(lv_draw_es_ctx_t * es_draw_ctx, lv_color_t color, const lv_area_t * area,
+                                              const lv_point_t * pos, int32_t box_w, const uint8_t * map_p)
+{
+    lv_draw_ctx_t * draw_ctx = &es_draw_ctx->base_sw.base_draw;
+    lv_coord_t dest_stride = lv_area_get_width(draw_ctx->buf_area);
+    lv_color_t * dest_buf = draw_ctx->buf;
+    dest_buf += dest_stride * (area->y1 - draw_ctx->buf_area->y1) + (area->x1 - draw_ctx->buf_area->x1);
+
+    if(es_draw_ctx->ramp_fg.full != color.full) {
+        es_draw_ctx->ramp_fg = color;
+        es_draw_ctx->ramp_valid = 0;
+    }
+    lv_color_t * ramp = es_draw_ctx->ramp;
+    lv_color_t ramp_bg = es_draw_ctx->ramp_bg;
+    uint32_t ramp_valid = es_draw_ctx->ramp_valid;
+
+    int32_t w = lv_area_get_width(area);
+    int32_t y;
+    for(y = area->y1; y <= area->y2; y++) {
+        /*Two shades per byte, the left one in the high nibble*/
+        uint32_t nibble = (uint32_t)(y - pos->y) * box_w + (area->x1 - pos->x);
+        const uint8_t * src = map_p + (nibble >> 1);
+        uint32_t shift = (nibble & 1) ? 0 : 4;
+        lv_color_t * d = dest_buf;
+        int32_t x;
+        for(x = 0; x < w; x++) {
+            uint32_t shade = (*src >> shift) & 0xF;
+            if(shift == 0) src++;
+            shift ^= 4;
+
+            if(shade == 0) continue;
+            if(shade == 15) {
+                d[x] = color;
+                continue;
+            }
+            if(d[x].full != ramp_bg.full) {
+                ramp_bg = d[x];
+                ramp_valid = 0;
+            }
+            if((ramp_valid & (1U << shade)) == 0) {
+                ramp[shade] = lv_color_mix(color, ramp_bg, _lv_bpp4_opa_table[shade]);
+                ramp_valid |= 1U << shade;
+            }
+            d[x] = ramp[shade];
+        }
+        dest_buf += dest_stride;
+    }
+
+    es_draw_ctx->ramp_bg = ramp_bg;
+    es_draw_ctx->ramp_valid = (uint16_t)ramp_valid;
+}
+
+static inline uint32_t lanes_r(uint32_t w)
+{
+    return (w >> 3) & LANE_5;
+}
+
+static inline uint32_t lanes_g(uint32_t w)
+{
+    return ((w & LANE_3) << 3) | ((w >> 13) & LANE_3);
+}
+
+static inline uint32_t lanes_b(uint32_t w)
+{
+    return (w >> 8) & LANE_5;
+}
+
+/*LV_UDIV255() on both lanes: floor(x / 255) == (x + 1 + (x >> 8)) >> 8 for x < 65535.
+ *Mixed channels stay below 63 * 255 + 128, so nothing carries into the next lane.*/
+static inline uint32_t lanes_div255(uint32_t x)
+{
+    return ((x + LANE_ONE + ((x >> 8) & LANE_8)) >> 8) & LANE_8;
+}
+
+static inline uint32_t lanes_pack(uint32_t r, uint32_t g, uint32_t b)
+{
+    return (r << 3) | (b << 8) | ((g >> 3) & LANE_3) | ((g & LANE_3) << 13);
+}
+
+/*Two pixels from a buffer that may be only 2-byte aligned*/
+static inline uint32_t load2(const lv_color_t * p)
+{
+    return (uint32_t)p[0].full | ((uint32_t)p[1].full << 16);
+}
+
+/*lv_color_mix(color, *d, m) with the color's R and B pre-packed in `frb`*/
+static inline void fill_mask_px(lv_color_t * d, lv_color_t color, uint32_t frb, uint32_t fg, uint32_t m)
+{
+    if(m == LV_OPA_COVER) {
+        *d = color;
+    }
+    else if(m) {
+        uint32_t bg = d->full;
+        uint32_t m_inv = 255 - m;
+        uint32_t rb = lanes_div255(frb * m + (lanes_r(bg) | (lanes_b(bg) << 16)) * m_inv + LANE_ROUND);
+        uint32_t g = lanes_div255(fg * m + lanes_g(bg) * m_inv + LANE_ROUND);
+        d->full = (uint16_t)lanes_pack(rb & 0xFFFF, g, rb >> 16);
+    }
+}
+
+/*A color over the buffer with opacity, two pixels per word*/
+LV_ATTRIBUTE_FAST_MEM static void fill_opa(lv_color_t * dest_buf, int32_t w, int32_t h, lv_coord_t dest_stride,
+                                           lv_color_t color, lv_opa_t opa)
+{
+    uint32_t opa_inv = 255 - opa;
+    uint32_t fr = LV_COLOR_GET_R(color) * opa * LANE_ONE + LANE_ROUND;
+    uint32_t fg = LV_COLOR_GET_G(color) * opa * LANE_ONE + LANE_ROUND;
+    uint32_t fb = LV_COLOR_GET_B(color) * opa * LANE_ONE + LANE_ROUND;
+
+    int32_t y;
+    for(y = 0; y < h; y++) {
+        lv_color_t * d = dest_buf;
+        int32_t x = 0;
+        if((lv_uintptr_t)d & 0x3) {
+            d[0] = lv_color_mix(color, d[0], opa);
+            x = 1;
+        }
+
+        uint32_t * d32 = (uint32_t *)(d + x);
+        for(; x + 1 < w; x += 2) {
+            uint32_t bg = *d32;
+            *d32 = lanes_pack(lanes_div255(fr + lanes_r(bg) * opa_inv),
+                              lanes_div255(fg + lanes_g(bg) * opa_inv),
+                              lanes_div255(fb + lanes_b(bg) * opa_inv));
+            d32++;
+        }
+        if(x < w) d[x] = lv_color_mix(color, d[x], opa);
+
+        dest_buf += dest_stride;
+    }
+}
+
+/*An anti-aliased color (glyphs, rounded corners): R and B of a pixel share a word*/
+LV_ATTRIBUTE_FAST_MEM static void fill_mask(lv_color_t * dest_buf, int32_t w, int32_t h, lv_coord_t dest_stride,
+                                            lv_color_t color, const lv_opa_t * mask, lv_coord_t mask_stride)
+{
+    uint32_t c32 = (uint32_t)color.full | ((uint32_t)color.full << 16);
+    uint32_t frb = LV_COLOR_GET_R(color) | ((uint32_t)LV_COLOR_GET_B(color) << 16);
+    uint32_t fg = LV_COLOR_GET_G(color);
+
+    int32_t y;
+    for(y = 0; y < h; y++) {
+        int32_t x = 0;
+        for(; x < w && ((lv_uintptr_t)&mask[x] & 0x3); x++) {
+            fill_mask_px(&dest_buf[x], color, frb, fg, mask[x]);
+        }
+
+        /*Skip or fill 4 pixels at once where the mask is all 0 or all 255*/
+        for(; x + 4 <= w; x += 4) {
+            uint32_t m32 = *(const uint32_t *)&mask[x];
+            lv_color_t * d = &dest_buf[x];
+            if(m32 == 0xFFFFFFFF) {
+                if((lv_uintptr_t)d & 0x3) {
+                    d[0] = color;
+                    *(uint32_t *)(d + 1) = c32;
+                    d[3] = color;
+                }
+                else {
+                    ((uint32_t *)d)[0] = c32;
+                    ((uint32_t *)d)[1] = c32;
+                }
+            }
+            else if(m32) {
+                fill_mask_px(&d[0], color, frb, fg, mask[x]);
+                fill_mask_px(&d[1], color, frb, fg, mask[x + 1]);
+                fill_mask_px(&d[2], color, frb, fg, mask[x + 2]);
+                fill_mask_px(&d[3], color, frb, fg, mask[x + 3]);
+            }
+        }
+
+        for(; x < w; x++) {
+            fill_mask_px(&dest_buf[x], color, frb, fg, mask[x]);
+        }
+        dest_buf += dest_stride;
+        mask += mask_stride;
+    }
+}
+
+/*An image with opacity, two pixels per word*/
+LV_ATTRIBUTE_FAST_MEM static void map_opa(lv_color_t * dest_buf, int32_t w, int32_t h, lv_coord_t dest_stride,
+                                          const lv_color_t * src_buf, lv_coord_t src_stride, lv_opa_t opa)
+{
+    uint32_t opa_inv = 255 - opa;
+
+    int32_t y;
+    for(y = 0; y < h; y++) {
+        int32_t x = 0;
+        if((lv_uintptr_t)dest_buf & 0x3) {
+            dest_buf[0] = lv_color_mix(src_buf[0], dest_buf[0], opa);
+            x = 1;
+        }
+
+        for(; x + 1 < w; x += 2) {
+            uint32_t fg = load2(&src_buf[x]);
+            uint32_t bg = *(uint32_t *)&dest_buf[x];
+            *(uint32_t *)&dest_buf[x] =
+                lanes_pack(lanes_div255(lanes_r(fg) * opa + lanes_r(bg) * opa_inv + LANE_ROUND),
+                           lanes_div255(lanes_g(fg) * opa + lanes_g(bg) * opa_inv + LANE_ROUND),
+                           lanes_div255(lanes_b(fg) * opa + lanes_b(bg) * opa_inv + LANE_ROUND));
+        }
+        if(x < w) dest_buf[x] = lv_color_mix(src_buf[x], dest_buf[x], opa);
+
+        dest_buf += dest_stride;
+        src_buf += src_stride;
+    }
+}
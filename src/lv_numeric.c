@@ -0,0 +1,355 @@
+/**
+ * @file lv_numeric.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "lv_numeric.h"
+#include <string.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+#define MY_CLASS &lv_numeric_class
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+static void lv_numeric_constructor(const lv_obj_class_t * class_p, lv_obj_t * obj);
+static void lv_numeric_destructor(const lv_obj_class_t * class_p, lv_obj_t * obj);
+static void lv_numeric_event(const lv_obj_class_t * class_p, lv_event_t * e);
+static void draw_main(lv_event_t * e);
+static void build_sprites(lv_obj_t * obj);
+static lv_color_t get_bg_color(lv_obj_t * obj);
+static void get_cell_area(lv_obj_t * obj, const lv_numeric_cell_t * cell, lv_area_t * area);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+const lv_obj_class_t lv_numeric_class = {
+    .constructor_cb = lv_numeric_constructor,
+    .destructor_cb = lv_numeric_destructor,
+    .event_cb = lv_numeric_event,
+    .instance_size = sizeof(lv_numeric_t),
+    .base_class = &lv_obj_class
+};
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+lv_obj_t * lv_numeric_create(lv_obj_t * parent)
+{
+    LV_LOG_INFO("begin");
+    lv_obj_t * obj = lv_obj_class_create_obj(MY_CLASS, parent);
+    lv_obj_class_init_obj(obj);
+    return obj;
+}
+
+void lv_numeric_set_font(lv_obj_t * obj, const lv_font_t * font, const char * charset, uint8_t max_chars)
+{
+    LV_ASSERT_OBJ(obj, MY_CLASS);
+    lv_numeric_t * num = (lv_numeric_t *)obj;
+
+    num->font = font;
+    strncpy(num->charset, charset, LV_NUMERIC_MAX_CHARSET);
+    num->charset[LV_NUMERIC_MAX_CHARSET] = '\0';
+    num->max_chars = LV_MIN(max_chars, LV_NUMERIC_MAX_CELLS);
+    build_sprites(obj);
+
+    lv_coord_t pad_w = lv_obj_get_style_pad_left(obj, LV_PART_MAIN) + lv_obj_get_style_pad_right(obj, LV_PART_MAIN);
+    lv_coord_t pad_h = lv_obj_get_style_pad_top(obj, LV_PART_MAIN) + lv_obj_get_style_pad_bottom(obj, LV_PART_MAIN);
+    lv_obj_set_size(obj, num->max_chars * num->digit_w + pad_w, num->sprite_h + pad_h);
+
+    /*Lay the current text out again with the new cell sizes*/
+    char text[LV_NUMERIC_MAX_CELLS + 1];
+    uint32_t i;
+    for(i = 0; i < num->cell_cnt; i++) text[i] = num->cells[i].ch;
+    text[i] = '\0';
+    num->cell_cnt = 0;
+    lv_numeric_set_text(obj, text);
+    lv_obj_invalidate(obj);
+}
+
+void lv_numeric_set_text(lv_obj_t * obj, const char * text)
+{
+    LV_ASSERT_OBJ(obj, MY_CLASS);
+    lv_numeric_t * num = (lv_numeric_t *)obj;
+
+    lv_numeric_cell_t cells[LV_NUMERIC_MAX_CELLS];
+    uint32_t cnt = 0;
+    lv_coord_t x = 0;
+    while(text[cnt] != '\0' && cnt < num->max_chars) {
+        char ch = text[cnt];
+        const char * p = num->sprite_buf ? strchr(num->charset, ch) : NULL;
+        cells[cnt].ch = ch;
+        cells[cnt].sprite = p ? (int8_t)(p - num->charset) : -1;
+        cells[cnt].x = x;
+        cells[cnt].w = p ? (lv_coord_t)num->sprites[cells[cnt].sprite].header.w : num->blank_w;
+        x += cells[cnt].w;
+        cnt++;
+    }
+
+    if(num->align == LV_TEXT_ALIGN_RIGHT) {
+        /*The object's own width may not be laid out yet*/
+        lv_coord_t shift = num->max_chars * num->digit_w - x;
+        uint32_t i;
+        for(i = 0; i < cnt; i++) cells[i].x += shift;
+    }
+
+    /*Invalidate only the cells that look different*/
+    uint32_t i;
+    lv_area_t a;
+    for(i = 0; i < LV_MAX(cnt, num->cell_cnt); i++) {
+        bool in_old = i < num->cell_cnt;
+        bool in_new = i < cnt;
+        if(in_old && in_new && num->cells[i].sprite == cells[i].sprite &&
+           num->cells[i].x == cells[i].x && num->cells[i].w == cells[i].w) {
+            continue;
+        }
+        if(in_old) {
+            get_cell_area(obj, &num->cells[i], &a);
+            lv_obj_invalidate_area(obj, &a);
+        }
+        if(in_new) {
+            get_cell_area(obj, &cells[i], &a);
+            lv_obj_invalidate_area(obj, &a);
+        }
+    }
+
+    lv_memcpy(num->cells, cells, cnt * sizeof(lv_numeric_cell_t));
+    num->cell_cnt = cnt;
+}
+
+void lv_numeric_set_align(lv_obj_t * obj, lv_text_align_t align)
+{
+    LV_ASSERT_OBJ(obj, MY_CLASS);
+    lv_numeric_t * num = (lv_numeric_t *)obj;
+
+    if(num->align == align) return;
+    num->align = align;
+    lv_numeric_set_font(obj, num->font, num->charset, num->max_chars);
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static void lv_numeric_constructor(const lv_obj_class_t * class_p, lv_obj_t * obj)
+{
+    LV_UNUSED(class_p);
+    LV_TRACE_OBJ_CREATE("begin");
+
+    lv_numeric_t * num = (lv_numeric_t *)obj;
+    num->font = NULL;
+    num->charset[0] = '\0';
+    num->sprite_buf = NULL;
+    num->digit_w = 0;
+    num->blank_w = 0;
+    num->sprite_h = 0;
+    num->sprite_y = 0;
+    num->cell_cnt = 0;
+    num->max_chars = LV_NUMERIC_MAX_CELLS;
+    num->align = LV_TEXT_ALIGN_RIGHT;
+
+    lv_obj_clear_flag(obj, LV_OBJ_FLAG_CLICKABLE);
+    lv_obj_clear_flag(obj, LV_OBJ_FLAG_SCROLLABLE);
+
+    LV_TRACE_OBJ_CREATE("finished");
+}
+
+static void lv_numeric_destructor(const lv_obj_class_t * class_p, lv_obj_t * obj)
+{
+    LV_UNUSED(class_p);
+    lv_numeric_t * num = (lv_numeric_t *)obj;
+
+    lv_mem_free(num->sprite_buf);
+    num->sprite_buf = NULL;
+}
+
+static void lv_numeric_event(const lv_obj_class_t * class_p, lv_event_t * e)
+{
+    LV_UNUSED(class_p);
+
+    lv_res_t res;
+
+    /*Call the ancestor's event handler*/
+    res = lv_obj_event_base(MY_CLASS, e);
+    if(res != LV_RES_OK) return;
+
+    lv_event_code_t code = lv_event_get_code(e);
+    lv_obj_t * obj = lv_event_get_target(e);
+    lv_numeric_t * num = (lv_numeric_t *)obj;
+
+    if(code == LV_EVENT_STYLE_CHANGED) {
+        /*Text or background color may have changed: re-blend the sprites*/
+        if(num->font) {
+            build_sprites(obj);
+            lv_obj_invalidate(obj);
+        }
+    }
+    else if(code == LV_EVENT_DRAW_MAIN) {
+        draw_main(e);
+    }
+}
+
+static void draw_main(lv_event_t * e)
+{
+    lv_obj_t * obj = lv_event_get_target(e);
+    lv_numeric_t * num = (lv_numeric_t *)obj;
+    lv_draw_ctx_t * draw_ctx = lv_event_get_draw_ctx(e);
+
+    if(num->sprite_buf == NULL) return;
+
+    lv_draw_img_dsc_t img_dsc;
+    lv_draw_img_dsc_init(&img_dsc);
+
+    uint32_t i;
+    lv_area_t a;
+    lv_area_t clip;
+    for(i = 0; i < num->cell_cnt; i++) {
+        const lv_numeric_cell_t * cell = &num->cells[i];
+        if(cell->sprite < 0) continue;
+        get_cell_area(obj, cell, &a);
+        if(!_lv_area_intersect(&clip, &a, draw_ctx->clip_area)) continue;
+        lv_draw_img(draw_ctx, &img_dsc, &a, &num->sprites[cell->sprite]);
+    }
+}
+
+static void get_cell_area(lv_obj_t * obj, const lv_numeric_cell_t * cell, lv_area_t * area)
+{
+    lv_numeric_t * num = (lv_numeric_t *)obj;
+    lv_area_t content;
+    lv_obj_get_content_coords(obj, &content);
+    area->x1 = content.x1 + cell->x;
+    area->x2 = area->x1 + cell->w - 1;
+    area->y1 = content.y1;
+    area->y2 = area->y1 + num->sprite_h - 1;
+}
+
+/**
+ * The first fully opaque background behind the object. Sprites are blended
+ * over this color, so they can be copied without any alpha blending.
+ */
+static lv_color_t get_bg_color(lv_obj_t * obj)
+{
+    while(obj) {
+        if(lv_obj_get_style_bg_opa(obj, LV_PART_MAIN) >= LV_OPA_COVER) {
+            return lv_obj_get_style_bg_color(obj, LV_PART_MAIN);
+        }
+        obj = lv_obj_get_parent(obj);
+    }
+    return lv_color_black();
+}
+
+static void build_sprites(lv_obj_t * obj)
+{
+    lv_numeric_t * num = (lv_numeric_t *)obj;
+    const lv_font_t * font = num->font;
+
+    lv_mem_free(num->sprite_buf);
+    num->sprite_buf = NULL;
+    if(font == NULL) return;
+
+    lv_color_t fg = lv_obj_get_style_text_color(obj, LV_PART_MAIN);
+    lv_color_t bg = get_bg_color(obj);
+
+    /*Cell widths and the rows of the line box any glyph actually uses*/
+    lv_coord_t baseline_y = font->line_height - font->base_line;
+    lv_coord_t top = font->line_height;
+    lv_coord_t bottom = 0;
+    lv_coord_t widths[LV_NUMERIC_MAX_CHARSET];
+    lv_font_glyph_dsc_t g;
+    uint32_t n = strlen(num->charset);
+    uint32_t i;
+
+    num->digit_w = 0;
+    for(i = 0; i < n; i++) {
+        char ch = num->charset[i];
+        if(ch >= '0' && ch <= '9' && lv_font_get_glyph_dsc(font, &g, ch, 0)) {
+            num->digit_w = LV_MAX(num->digit_w, g.adv_w);
+        }
+    }
+
+    uint32_t px_total = 0;
+    for(i = 0; i < n; i++) {
+        char ch = num->charset[i];
+        if(!lv_font_get_glyph_dsc(font, &g, ch, 0)) {
+            widths[i] = 0;
+            continue;
+        }
+        widths[i] = (ch >= '0' && ch <= '9') ? num->digit_w : g.adv_w;
+        if(g.box_h > 0) {
+            lv_coord_t gy = baseline_y - g.box_h - g.ofs_y;
+            top = LV_MIN(top, gy);
+            bottom = LV_MAX(bottom, gy + g.box_h);
+        }
+    }
+    if(top >= bottom) {
+        top = 0;
+        bottom = font->line_height;
+    }
+    num->sprite_y = top;
+    num->sprite_h = bottom - top;
+    num->blank_w = lv_font_get_glyph_dsc(font, &g, ' ', 0) ? g.adv_w : num->digit_w / 2;
+
+    for(i = 0; i < n; i++) px_total += widths[i] * num->sprite_h;
+
+    num->sprite_buf = lv_mem_alloc(px_total * sizeof(lv_color_t));
+    LV_ASSERT_MALLOC(num->sprite_buf);
+    if(num->sprite_buf == NULL) return;
+
+    lv_color_t * p = num->sprite_buf;
+    for(i = 0; i < n; i++) {
+        lv_img_dsc_t * img = &num->sprites[i];
+        lv_coord_t w = widths[i];
+        lv_coord_t h = num->sprite_h;
+        lv_memset_00(&img->header, sizeof(img->header));
+        img->header.cf = LV_IMG_CF_TRUE_COLOR;
+        img->header.w = w;
+        img->header.h = h;
+        img->data_size = w * h * sizeof(lv_color_t);
+        img->data = (const uint8_t *)p;
+
+        uint32_t k;
+        for(k = 0; k < (uint32_t)(w * h); k++) p[k] = bg;
+
+        char ch = num->charset[i];
+        const uint8_t * bitmap = NULL;
+        if(w > 0 && lv_font_get_glyph_dsc(font, &g, ch, 0) && g.box_w > 0) {
+            bitmap = lv_font_get_glyph_bitmap(font, ch);
+        }
+
+        if(bitmap) {
+            uint8_t bpp = g.bpp == 3 ? 4 : g.bpp;
+            uint8_t px_mask = (1 << bpp) - 1;
+            lv_coord_t x0 = (w - g.adv_w) / 2 + g.ofs_x;
+            lv_coord_t y0 = baseline_y - g.box_h - g.ofs_y - top;
+            lv_coord_t row, col;
+            for(row = 0; row < g.box_h; row++) {
+                for(col = 0; col < g.box_w; col++) {
+                    lv_coord_t x = x0 + col;
+                    lv_coord_t y = y0 + row;
+                    if(x < 0 || x >= w || y < 0 || y >= h) continue;
+
+                    uint32_t bit = (row * g.box_w + col) * bpp;
+                    uint8_t v = (bitmap[bit >> 3] >> (8 - bpp - (bit & 0x7))) & px_mask;
+                    lv_opa_t opa;
+                    switch(bpp) {
+                        case 1: opa = v ? LV_OPA_COVER : LV_OPA_TRANSP; break;
+                        case 2: opa = v * 85; break;
+                        case 4: opa = v * 17; break;
+                        default: opa = v; break;
+                    }
+
+                    /*Same result as blending the glyph's mask over `bg`*/
+                    if(opa >= LV_OPA_MAX) p[y * w + x] = fg;
+                    else if(opa > LV_OPA_MIN) p[y * w + x] = lv_color_mix(fg, bg, opa);
+                }
+            }
+        }
+        p += w * h;
+    }
+}
@@ -0,0 +1,322 @@
+/**
+ * @file lv_shotchart.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "lv_shotchart.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+#define MY_CLASS &lv_shotchart_class
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+static void lv_shotchart_constructor(const lv_obj_class_t * class_p, lv_obj_t * obj);
+static void lv_shotchart_destructor(const lv_obj_class_t * class_p, lv_obj_t * obj);
+static void lv_shotchart_event(const lv_obj_class_t * class_p, lv_event_t * e);
+static void draw_main(lv_event_t * e);
+static void alloc_points(lv_obj_t * obj);
+static bool grow_range(lv_shotchart_series_t * ser, int16_t v);
+static void invalidate_columns(lv_obj_t * obj, uint32_t col, uint32_t cnt);
+static lv_coord_t value_to_y(const lv_shotchart_series_t * ser, int16_t v, const lv_area_t * content);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+const lv_obj_class_t lv_shotchart_class = {
+    .constructor_cb = lv_shotchart_constructor,
+    .destructor_cb = lv_shotchart_destructor,
+    .event_cb = lv_shotchart_event,
+    .instance_size = sizeof(lv_shotchart_t),
+    .base_class = &lv_obj_class
+};
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+lv_obj_t * lv_shotchart_create(lv_obj_t * parent)
+{
+    LV_LOG_INFO("begin");
+    lv_obj_t * obj = lv_obj_class_create_obj(MY_CLASS, parent);
+    lv_obj_class_init_obj(obj);
+    return obj;
+}
+
+void lv_shotchart_set_series_count(lv_obj_t * obj, uint8_t cnt)
+{
+    LV_ASSERT_OBJ(obj, MY_CLASS);
+    lv_shotchart_t * chart = (lv_shotchart_t *)obj;
+
+    chart->series_cnt = LV_MIN(cnt, LV_SHOTCHART_MAX_SERIES);
+    alloc_points(obj);
+    lv_obj_invalidate(obj);
+}
+
+void lv_shotchart_set_series_color(lv_obj_t * obj, uint8_t id, lv_color_t color)
+{
+    LV_ASSERT_OBJ(obj, MY_CLASS);
+    lv_shotchart_t * chart = (lv_shotchart_t *)obj;
+    if(id >= LV_SHOTCHART_MAX_SERIES) return;
+
+    chart->series[id].color = color;
+    lv_obj_invalidate(obj);
+}
+
+void lv_shotchart_set_range(lv_obj_t * obj, uint8_t id, int16_t min, int16_t max)
+{
+    LV_ASSERT_OBJ(obj, MY_CLASS);
+    lv_shotchart_t * chart = (lv_shotchart_t *)obj;
+    if(id >= LV_SHOTCHART_MAX_SERIES || min >= max) return;
+
+    chart->series[id].min = min;
+    chart->series[id].max = max;
+    chart->series[id].init_min = min;
+    chart->series[id].init_max = max;
+    lv_obj_invalidate(obj);
+}
+
+void lv_shotchart_append(lv_obj_t * obj, const int16_t * values)
+{
+    LV_ASSERT_OBJ(obj, MY_CLASS);
+    lv_shotchart_t * chart = (lv_shotchart_t *)obj;
+    if(chart->point_buf == NULL) return;
+
+    bool rescaled = false;
+    uint32_t col = chart->cursor;
+    uint32_t s;
+    for(s = 0; s < chart->series_cnt; s++) {
+        int16_t v = values[s];
+        if(v == LV_SHOTCHART_POINT_NONE) v++;
+        if(grow_range(&chart->series[s], v)) rescaled = true;
+        chart->series[s].points[col] = v;
+    }
+    chart->cursor = (col + 1) % chart->point_cnt;
+
+    if(rescaled) {
+        chart->rescale_cnt++;
+        lv_obj_invalidate(obj);
+        return;
+    }
+
+    /*The new column, the gap moving over old points and the first old
+     *point after the gap, which loses its connection to the left*/
+    invalidate_columns(obj, col, LV_SHOTCHART_GAP + 2);
+}
+
+void lv_shotchart_clear(lv_obj_t * obj)
+{
+    LV_ASSERT_OBJ(obj, MY_CLASS);
+    lv_shotchart_t * chart = (lv_shotchart_t *)obj;
+
+    uint32_t i;
+    for(i = 0; i < (uint32_t)chart->point_cnt * chart->series_cnt; i++) {
+        chart->point_buf[i] = LV_SHOTCHART_POINT_NONE;
+    }
+    /*A big value of the last shot must not squash the next one*/
+    for(i = 0; i < LV_SHOTCHART_MAX_SERIES; i++) {
+        chart->series[i].min = chart->series[i].init_min;
+        chart->series[i].max = chart->series[i].init_max;
+    }
+    chart->cursor = 0;
+    lv_obj_invalidate(obj);
+}
+
+uint32_t lv_shotchart_get_rescale_count(const lv_obj_t * obj)
+{
+    LV_ASSERT_OBJ(obj, MY_CLASS);
+    const lv_shotchart_t * chart = (const lv_shotchart_t *)obj;
+    return chart->rescale_cnt;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static void lv_shotchart_constructor(const lv_obj_class_t * class_p, lv_obj_t * obj)
+{
+    LV_UNUSED(class_p);
+    LV_TRACE_OBJ_CREATE("begin");
+
+    lv_shotchart_t * chart = (lv_shotchart_t *)obj;
+    uint32_t s;
+    for(s = 0; s < LV_SHOTCHART_MAX_SERIES; s++) {
+        chart->series[s].color = lv_palette_main(s == 0 ? LV_PALETTE_BLUE : LV_PALETTE_ORANGE);
+        chart->series[s].min = 0;
+        chart->series[s].max = 100;
+        chart->series[s].init_min = 0;
+        chart->series[s].init_max = 100;
+        chart->series[s].points = NULL;
+    }
+    chart->point_buf = NULL;
+    chart->point_cnt = 0;
+    chart->cursor = 0;
+    chart->series_cnt = 1;
+    chart->rescale_cnt = 0;
+
+    lv_obj_clear_flag(obj, LV_OBJ_FLAG_CLICKABLE);
+    lv_obj_clear_flag(obj, LV_OBJ_FLAG_SCROLLABLE);
+
+    LV_TRACE_OBJ_CREATE("finished");
+}
+
+static void lv_shotchart_destructor(const lv_obj_class_t * class_p, lv_obj_t * obj)
+{
+    LV_UNUSED(class_p);
+    lv_shotchart_t * chart = (lv_shotchart_t *)obj;
+
+    lv_mem_free(chart->point_buf);
+    chart->point_buf = NULL;
+}
+
+static void lv_shotchart_event(const lv_obj_class_t * class_p, lv_event_t * e)
+{
+    LV_UNUSED(class_p);
+
+    lv_res_t res;
+
+    /*Call the ancestor's event handler*/
+    res = lv_obj_event_base(MY_CLASS, e);
+    if(res != LV_RES_OK) return;
+
+    lv_event_code_t code = lv_event_get_code(e);
+    lv_obj_t * obj = lv_event_get_target(e);
+    lv_shotchart_t * chart = (lv_shotchart_t *)obj;
+
+    if(code == LV_EVENT_SIZE_CHANGED) {
+        /*One point per column*/
+        if(lv_obj_get_content_width(obj) != chart->point_cnt) alloc_points(obj);
+    }
+    else if(code == LV_EVENT_DRAW_MAIN) {
+        draw_main(e);
+    }
+}
+
+/**
+ * Draw the columns in the clip area. Each column is a vertical span from the
+ * previous point to its own, so a column never paints into its neighbours
+ * and can be redrawn alone.
+ */
+static void draw_main(lv_event_t * e)
+{
+    lv_obj_t * obj = lv_event_get_target(e);
+    lv_shotchart_t * chart = (lv_shotchart_t *)obj;
+    lv_draw_ctx_t * draw_ctx = lv_event_get_draw_ctx(e);
+
+    if(chart->point_buf == NULL) return;
+
+    lv_area_t content;
+    lv_obj_get_content_coords(obj, &content);
+
+    lv_area_t clip;
+    if(!_lv_area_intersect(&clip, &content, draw_ctx->clip_area)) return;
+
+    lv_draw_rect_dsc_t rect_dsc;
+    lv_draw_rect_dsc_init(&rect_dsc);
+
+    uint32_t cnt = chart->point_cnt;
+    int32_t c_start = clip.x1 - content.x1;
+    int32_t c_end = clip.x2 - content.x1;
+    uint32_t s;
+    for(s = 0; s < chart->series_cnt; s++) {
+        const lv_shotchart_series_t * ser = &chart->series[s];
+        rect_dsc.bg_color = ser->color;
+
+        int32_t c;
+        for(c = c_start; c <= c_end; c++) {
+            uint32_t dist = (c - chart->cursor + cnt) % cnt;
+            if(dist < LV_SHOTCHART_GAP) continue;
+
+            int16_t v = ser->points[c];
+            if(v == LV_SHOTCHART_POINT_NONE) continue;
+
+            lv_coord_t y = value_to_y(ser, v, &content);
+            lv_coord_t y_prev = y;
+            if(c > 0 && dist > LV_SHOTCHART_GAP && ser->points[c - 1] != LV_SHOTCHART_POINT_NONE) {
+                y_prev = value_to_y(ser, ser->points[c - 1], &content);
+            }
+
+            lv_area_t a;
+            a.x1 = content.x1 + c;
+            a.x2 = a.x1;
+            a.y1 = LV_MIN(y, y_prev);
+            a.y2 = LV_MAX(y, y_prev) + LV_SHOTCHART_LINE_WIDTH - 1;
+            lv_draw_rect(draw_ctx, &rect_dsc, &a);
+        }
+    }
+}
+
+static void alloc_points(lv_obj_t * obj)
+{
+    lv_shotchart_t * chart = (lv_shotchart_t *)obj;
+
+    lv_mem_free(chart->point_buf);
+    chart->point_buf = NULL;
+    chart->point_cnt = 0;
+    chart->cursor = 0;
+
+    lv_coord_t w = lv_obj_get_content_width(obj);
+    if(w <= LV_SHOTCHART_GAP || chart->series_cnt == 0) return;
+
+    chart->point_buf = lv_mem_alloc(w * chart->series_cnt * sizeof(int16_t));
+    LV_ASSERT_MALLOC(chart->point_buf);
+    if(chart->point_buf == NULL) return;
+
+    chart->point_cnt = w;
+    uint32_t s;
+    for(s = 0; s < chart->series_cnt; s++) chart->series[s].points = &chart->point_buf[s * w];
+    lv_shotchart_clear(obj);
+}
+
+/**
+ * Make room for a new value. The range grows past it by a quarter of the
+ * new span, so a rising curve rescales only a few times per shot.
+ * @return true: the range changed and everything has to be redrawn
+ */
+static bool grow_range(lv_shotchart_series_t * ser, int16_t v)
+{
+    if(v >= ser->min && v <= ser->max) return false;
+
+    int32_t min = LV_MIN(ser->min, v);
+    int32_t max = LV_MAX(ser->max, v);
+    int32_t headroom = LV_MAX((max - min) / 4, 1);
+    if(v > ser->max) max += headroom;
+    else min -= headroom;
+
+    ser->min = (int16_t)LV_MAX(min, INT16_MIN + 1);
+    ser->max = (int16_t)LV_MIN(max, INT16_MAX);
+    return true;
+}
+
+static void invalidate_columns(lv_obj_t * obj, uint32_t col, uint32_t cnt)
+{
+    lv_shotchart_t * chart = (lv_shotchart_t *)obj;
+
+    lv_area_t content;
+    lv_obj_get_content_coords(obj, &content);
+
+    cnt = LV_MIN(cnt, chart->point_cnt);
+    while(cnt) {
+        uint32_t run = LV_MIN(cnt, chart->point_cnt - col);
+        lv_area_t a;
+        a.x1 = content.x1 + col;
+        a.x2 = a.x1 + run - 1;
+        a.y1 = content.y1;
+        a.y2 = content.y2;
+        lv_obj_invalidate_area(obj, &a);
+        cnt -= run;
+        col = 0;
+    }
+}
+
+static lv_coord_t value_to_y(const lv_shotchart_series_t * ser, int16_t v, const lv_area_t * content)
+{
+    int32_t h = lv_area_get_height(content) - LV_SHOTCHART_LINE_WIDTH;
+    int32_t v_ofs = LV_CLAMP(ser->min, v, ser->max) - ser->min;
+    return content->y2 - (LV_SHOTCHART_LINE_WIDTH - 1) - (v_ofs * h) / (ser->max - ser->min);
+}
@@ -3,14 +3,22 @@
 #include <scale.h>
 #include <filter.h>
 #include "jd9613.h"
+#include "display.h"
+#include "display_power.h"
+#include "display_stats.h"
 #include "lvgl.h"
+#include "lv_alloc.h"
+#include "lv_draw_es.h"
+#include "ui.h"
+#include "ui_task.h"
 #include "pin_config.h"
 #include "SPI.h"
 #include "time.h"
 #include "sntp.h"
-#define TOUCH_MODULES_CST_SELF
-#include "TouchLib.h"
-#include "Wire.h"
+#include "touch.h"
+#include "gesture.h"
+#include "commands.h"
+#include "shot_log.h"
 #include "wifiManager.h"
 #include <PrettyOTA.h>
 #include "ble_service.h"
@@ -19,105 +27,54 @@
 #error "Please turn on PSRAM option to OPI PSRAM"
 #endif
 
+// WiFi, the web pages and PrettyOTA. Builds with -DESPRESSISCALE_WIFI=0 keep
+// the radio to BLE only and are updated over BLE DFU
+#ifndef ESPRESSISCALE_WIFI
+#define ESPRESSISCALE_WIFI 1
+#endif
+
+// Weight broadcast in the BLE advertisements, off by default: it moves the
+// service UUID to the scan response, where passive scanners don't see it.
+// Builds for scan-only displays set e.g. -DESPRESSISCALE_BLE_BROADCAST_MS=200
+#ifndef ESPRESSISCALE_BLE_BROADCAST_MS
+#define ESPRESSISCALE_BLE_BROADCAST_MS 0
+#endif
+
 WiFiManager wifiManager;
 String header;
 
 AsyncWebServer  server(80); // Server on port 80 (HTTP)
 PrettyOTA       OTAUpdates;
 
-static const uint16_t screenWidth = 294 * 2; // screenWidth = 294 * 2;
-static const uint16_t screenHeight = 126;
+static const uint16_t screenWidth = DISPLAY_HOR_RES; // screenWidth = 294 * 2;
+static const uint16_t screenHeight = DISPLAY_VER_RES;
 static const size_t lv_buffer_size = screenWidth * screenHeight * sizeof(lv_color_t);
 static lv_disp_draw_buf_t draw_buf;
 static lv_color_t *buf = NULL;
-lv_obj_t *label_weight = NULL;
-lv_obj_t *label_timer = NULL; // New label for timer
 
-// Timer variables
+// Timer variables, only touched by loop(): other tasks go through the command bus
 static int timer = 0; // Initialize timer to 0
 static bool timer_running = false; // Timer running state
+static volatile bool tare_in_progress = false; // Set while the tare task runs
+static CommandRequest tare_request; // Acknowledged when the tare task is done
 static unsigned long last_update = 0; // Last update time
+static uint8_t http_seq = 0; // Sequence numbers of /command requests
+static bool shot_recording = false; // The shot log follows timer_running
 
 // For inactivity and deep sleep management
 static unsigned long last_activity_time = 0; // Last activity time
 static float lastWeight = 0; // Last weight value
-
-static EventGroupHandle_t touch_eg;
-#define GET_TOUCH_INT _BV(1)
+static bool touch_woke_display = false; // The touch in progress woke the panels, it is not a gesture
 
 extern uint8_t espressiscale_left_map[];
 extern uint8_t espressiscale_right_map[];
 
-TouchLib touch(Wire, PIN_IIC_SDA, PIN_IIC_SCL, CTS820_SLAVE_ADDRESS);
-
 void my_print(const char *buf)
 {
   Serial.printf(buf);
   Serial.flush();
 }
 
-inline void my_disp_flush(lv_disp_drv_t *disp, const lv_area_t *area, lv_color_t *color_p)
-{
-  // uint32_t w = (area->x2 - area->x1 + 1);
-  uint32_t h = (area->y2 - area->y1 + 1);
-
-  int _w1 = 294 - area->x1;
-  int _w2 = area->x2 - 294 + 1;
-
-  if (_w1 > 0)
-  {
-    TFT_CS_0_L;
-    lcd_PushColors_SoftRotation(area->x1,
-                  area->y1,
-                  _w1,
-                  h,
-                  (uint16_t *)&color_p->full,
-                  2); // Horizontal display
-    TFT_CS_0_H;
-  }
-  if (_w2 > 0)
-  {
-    TFT_CS_1_L;
-    lcd_PushColors_SoftRotation(0,
-                  area->y1,
-                  _w2,
-                  h,
-                  (uint16_t *)&color_p->full,
-                  1); // Horizontal display
-    TFT_CS_1_H;
-  }
-
-  lv_disp_flush_ready(disp);
-}
-
-static void lv_touchpad_read(lv_indev_drv_t *indev_driver, lv_indev_data_t *data)
-{
-  if (touch.read())
-  {
-    TP_Point t = touch.getPoint(0);
-    int16_t x = 126 - t.x;
-    int16_t y = x;
-    x = t.y;
-    data->point.x = x;
-    t.x = x;
-    data->point.y = y;
-    t.y = y;
-
-    /* Adjust black shadow areas. */
-    if (t.x > 326)
-      data->point.x = t.x - 32;
-
-    if (t.x > 294 && t.x < 326)
-      data->state = LV_INDEV_STATE_REL;
-    else
-      data->state = LV_INDEV_STATE_PR;
-  }
-  else
-  {
-    data->state = LV_INDEV_STATE_REL;
-  }
-}
-
 void startWifi(void * parameter){
   wifiManager.setConnectRetries(10);
   wifiManager.autoConnect("EspressiScale");
@@ -126,36 +83,152 @@ void startWifi(void * parameter){
   Serial.println(WiFi.localIP());
 
   OTAUpdates.Begin(&server);
+  server.on("/stats", HTTP_GET, [](AsyncWebServerRequest *request) {
+    char text[512];
+    display_stats_format(text, sizeof(text));
+    request->send(200, "text/plain", text);
+  });
+  // Commands from the network, e.g. POST /command?c=tare, run by loop() like BLE and touch ones
+  server.on("/command", HTTP_POST, [](AsyncWebServerRequest *request) {
+    Command command;
+    bool form = request->hasParam("c", true);
+    if (!form && !request->hasParam("c"))
+    {
+      request->send(400, "text/plain", "missing c");
+      return;
+    }
+    if (!parseCommand(request->getParam("c", form)->value().c_str(), &command))
+    {
+      request->send(400, "text/plain", "unknown command");
+      return;
+    }
+    uint8_t seq = ++http_seq;
+    if (!postCommand(command, CommandSource::HTTP, seq))
+    {
+      request->send(503, "text/plain", "queue full");
+      return;
+    }
+    char text[32];
+    snprintf(text, sizeof(text), "queued %u\n", seq);
+    request->send(202, "text/plain", text);
+  });
   server.begin();
   OTAUpdates.OverwriteAppVersion("1.0.0");
 
   vTaskDelete(NULL);
 }
 
-// Timer control functions for BLE
-void startTimer() {
-  timer_running = true;
-  last_activity_time = millis(); // Reset the activity timer
-  Serial.println("Timer started via BLE");
+// Tares in the background, tareScale() takes a few samples
+static void startTare(const CommandRequest &req)
+{
+  tare_in_progress = true;
+  tare_request = req;
+  xTaskCreate( // To prevent halting the loop
+    [] (void * parameter) {
+      CommandRequest req = tare_request; // loop() may start the next tare once the flag is cleared
+      tareScale(); // Tare the scale
+      tare_in_progress = false; // Clients see the zero right away
+      finishCommand(req, CommandStatus::DONE);
+      vTaskDelete(NULL); // Delete the task once done
+    },
+    "TareTask", // Task name
+    10000, // Stack size
+    NULL, // Task parameter
+    1, // Task priority
+    NULL // Task handle
+  );
 }
 
-void stopTimer() {
+// Stops the timer as of `time`: a second that ticked after it does not count
+static void stopTimer(uint32_t time)
+{
   timer_running = false;
-  last_activity_time = millis(); // Reset the activity timer
-  Serial.println("Timer stopped via BLE");
+  if (timer > 0 && (int32_t)(last_update - time) > 0)
+  {
+    timer--;
+    updateBLETimer(timer);
+  }
 }
 
-void resetTimer() {
-  timer = 0;
-  timer_running = false;
-  updateBLETimer(timer);
+// Command bus executor, called from processCommands() in loop()
+static CommandStatus executeCommand(const CommandRequest &req)
+{
+  Serial.printf("Command %s via %s\n", commandName(req.command), commandSourceName(req.source));
   last_activity_time = millis(); // Reset the activity timer
-  Serial.println("Timer reset via BLE");
+  switch (req.command)
+  {
+  case Command::TARE:
+    if (tare_in_progress)
+      return CommandStatus::COALESCED; // The running tare does it
+    startTare(req);
+    return CommandStatus::PENDING;
+  case Command::START_TIMER:
+    if (!timer_running)
+      last_update = req.time; // The first second counts from when it was asked
+    timer_running = true;
+    break;
+  case Command::STOP_TIMER:
+    if (timer_running)
+      stopTimer(req.time);
+    break;
+  case Command::TOGGLE_TIMER:
+    if (timer_running)
+      stopTimer(req.time);
+    else
+    {
+      timer_running = true;
+      last_update = req.time;
+    }
+    break;
+  case Command::RESET_TIMER:
+    timer = 0;
+    timer_running = false;
+    clearUIChart();
+    updateBLETimer(timer);
+    break;
+  case Command::CLEAR_CHART:
+    clearUIChart();
+    break;
+  default:
+    return CommandStatus::UNKNOWN;
+  }
+  return CommandStatus::DONE;
+}
+
+// Panel actions. The right panel shows the weight, the left one the timer.
+static void handleGesture(const Gesture &g)
+{
+  switch (g.type)
+  {
+  case GestureType::TAP:
+    if (g.panel == GesturePanel::RIGHT)
+      postCommand(Command::TOGGLE_TIMER, CommandSource::TOUCH, 0, g.time); // Counts from the tap, not the end of the double-tap window
+    else
+    {
+      postCommand(Command::RESET_TIMER, CommandSource::TOUCH); // Stops the timer and clears the chart
+      postCommand(Command::TARE, CommandSource::TOUCH);
+    }
+    break;
+  case GestureType::DOUBLE_TAP:
+    if (g.panel == GesturePanel::RIGHT)
+      postCommand(Command::RESET_TIMER, CommandSource::TOUCH); // Keeps the tare
+    break;
+  case GestureType::LONG_PRESS:
+    if (g.panel == GesturePanel::LEFT)
+      postCommand(Command::TARE, CommandSource::TOUCH); // A running shot keeps its timer
+    break;
+  case GestureType::SWIPE_LEFT:
+  case GestureType::SWIPE_RIGHT:
+    postCommand(Command::CLEAR_CHART, CommandSource::TOUCH);
+    break;
+  default:
+    break;
+  }
 }
 
 void setup()
 {
-  touch_eg = xEventGroupCreate();
+  lv_alloc_init(); // LVGL's pool in internal RAM, before WiFi and BLE take theirs
 
   esp_sleep_enable_ext0_wakeup(GPIO_NUM_12, 0); // Touch interrupt is connected to GPIO 12
 
@@ -187,41 +260,37 @@ void setup()
   disp_drv.ver_res = screenHeight;
   disp_drv.flush_cb = my_disp_flush;
   disp_drv.draw_buf = &draw_buf;
-  disp_drv.full_refresh = 1;
+  disp_drv.direct_mode = 1; // Only invalidated areas are redrawn, my_disp_flush() sends what changed
+  disp_drv.draw_ctx_init = lv_draw_es_ctx_init; // Fill/copy/blend kernels for the swapped RGB565 buffer
+  disp_drv.draw_ctx_deinit = lv_draw_es_ctx_deinit;
+  disp_drv.draw_ctx_size = sizeof(lv_draw_es_ctx_t);
 
   lv_disp_drv_register(&disp_drv);
 
-  Wire.begin(PIN_IIC_SDA, PIN_IIC_SCL);
-  touch.init();
-  static lv_indev_drv_t indev_drv;
-  lv_indev_drv_init(&indev_drv);
-  indev_drv.type = LV_INDEV_TYPE_POINTER;
-  indev_drv.read_cb = lv_touchpad_read;
-  lv_indev_drv_register(&indev_drv);
+  setupTouch();
 
   setupScale();
   setupBattery();
-  setupBLE(); // Initialize BLE service
+  setupShotLog(); // Before BLE, which serves the saved shots
+  setupBLE(ESPRESSISCALE_BLE_BROADCAST_MS); // Initialize BLE service
+  setCommandHandler(executeCommand);
+  setGestureDoubleTap(GesturePanel::LEFT, false); // Its taps act at once
+  setCommandAckHandler(ackBLECommand); // Every finished command is acknowledged over BLE
 
   // Clear the display after showing the logo
   lv_obj_clean(lv_scr_act());
 
-  // Set the background color to black
-  lv_obj_set_style_bg_color(lv_scr_act(), lv_color_black(), LV_PART_MAIN);
+  setupUI();
 
-  // Create a label to display the weight
-  label_weight = lv_label_create(lv_scr_act());
-  lv_obj_set_style_text_font(label_weight, &lv_font_montserrat_48, LV_PART_MAIN);
-  lv_obj_align(label_weight, LV_ALIGN_RIGHT_MID, -10, 0);
+  lv_alloc_stats_t mem;
+  lv_alloc_get_stats(&mem);
+  Serial.printf("LVGL heap: %u of %u bytes used, %u fallbacks\n", mem.used, mem.pool_size, mem.fallbacks);
 
-  // Create a label to display the timer
-  label_timer = lv_label_create(lv_scr_act());
-  lv_obj_set_style_text_font(label_timer, &lv_font_montserrat_48, LV_PART_MAIN);
-  lv_obj_align(label_timer, LV_ALIGN_LEFT_MID, 10, 0); // Align to the left
-  
   // Initialize the last activity time
   last_activity_time = millis();
+  setupDisplayPower();
   
+#if ESPRESSISCALE_WIFI
   xTaskCreatePinnedToCore(
     startWifi, // Function to run on this task
     "startWifi", // Task name
@@ -231,6 +300,9 @@ void setup()
     NULL, // Task handle
     0 // Task core
   );
+#endif
+
+  startUITask(); // LVGL runs there from now on
 }
 
 void loop()
@@ -238,52 +310,47 @@ void loop()
   // Read filtered weight
   float currentWeight = medianFilter();
   
-  // Update BLE with current weight
+  // Update BLE with current weight and state, a timer or tare change goes out right away
+  unsigned long timer_ms = timer * 1000UL + (timer_running ? min(millis() - last_update, 999UL) : 0);
+  updateBLEState(timer_ms, timer_running, tare_in_progress, getBatteryLevel());
   updateBLEWeight(currentWeight);
+  streamBLESample(currentWeight, lastRawWeight());
+
+  // LVGL and the panels are shared with the UI task
+  lockUI();
 
   // Update the label with the current weight
-  char weight_str[16];
-  snprintf(weight_str, sizeof(weight_str), "%.1f g", currentWeight);
-  lv_label_set_text(label_weight, weight_str);
+  updateUIWeight(currentWeight);
 
-  if (touch.read())
+  // Touch reports in order, read by the UI task on the touch interrupt
+  TouchPoint t;
+  while (nextTouch(&t))
   {
-    // Any touch interaction should reset the activity timer
-    last_activity_time = millis();
-    
-    TP_Point t = touch.getPoint(0);
-    int16_t x = t.y; // Adjusted to match the screen orientation
-
-    if (x > screenWidth / 2)
+    if (t.pressed)
     {
-      timer_running = !timer_running; // Toggle timer state
-      if (timer_running) {
-        Serial.println("Timer started via touch");
-      } else {
-        Serial.println("Timer stopped via touch");
+      // Any touch interaction should reset the activity timer
+      last_activity_time = millis();
+      if (!isDisplayAwake())
+      {
+        // A touch on a sleeping display only wakes it up
+        touch_woke_display = true;
+        resetGestures();
       }
-      delay(1000); // Debounce delay
-    }
-    else
-    {
-      timer_running = false; // Stop the timer
-      timer = 0; // Reset timer
-      updateBLETimer(timer); // Update BLE with reset timer
-      xTaskCreate( // To prevent halting the loop
-        [] (void * parameter) {
-          tareScale(); // Tare the scale
-          vTaskDelete(NULL); // Delete the task once done
-        },
-        "TareTask", // Task name
-        10000, // Stack size
-        NULL, // Task parameter
-        1, // Task priority
-        NULL // Task handle
-      );
-      Serial.println("Tared and timer reset via touch");
+      wakeDisplay();
     }
+    if (!touch_woke_display)
+      feedGesture(t);
+    if (!t.pressed)
+      touch_woke_display = false;
   }
 
+  Gesture g;
+  while (pollGesture(millis(), &g))
+    handleGesture(g);
+
+  // Touch, BLE and HTTP commands, in order
+  processCommands();
+
   if (timer_running)
   {
     unsigned long current_time = millis();
@@ -297,24 +364,28 @@ void loop()
     }
   }
 
+  // Plot the shot while the timer runs
+  if (timer_running)
+    sampleUIChart(currentWeight);
+
   // Display the timer
-  char timer_str[16];
-  snprintf(timer_str, sizeof(timer_str), "%d s", timer);
-  lv_label_set_text(label_timer, timer_str);
+  updateUITimer(timer);
   
   // Check if the weight has changed significantly (indicating activity)
   if (abs(currentWeight - lastWeight) >= 1.0) {
     last_activity_time = millis(); // Reset the activity timer
+    wakeDisplay();
   }
+
+  // Dim and sleep the panels while idle, never during a running shot
+  updateDisplayPower(timer_running);
   
   // Check for inactivity
   if (!timer_running && millis() - last_activity_time >= 300000) // 5 minutes
   {
     Serial.println("Entering deep sleep due to inactivity...");
-    // Flush the screen to black before going to deep sleep
-    lv_obj_clean(lv_scr_act());
-    lv_obj_set_style_bg_color(lv_scr_act(), lv_color_black(), LV_PART_MAIN);
-    lv_refr_now(NULL); // Refresh the display immediately
+    // The panels are normally in sleep-in already, this blanks them otherwise
+    sleepDisplay();
     esp_deep_sleep_start();
   }
   
@@ -327,21 +398,42 @@ void loop()
   if (batteryStatus < 3) // Check if battery voltage is below 3V
   {
     Serial.println("Battery voltage is low. Entering deep sleep...");
+    endShot(); // Keep a running shot
     // Display low battery message before going to deep sleep
-    lv_label_set_text(label_weight, "Low battery");
+    wakeDisplay();
+    showUILowBattery();
     lv_refr_now(NULL); // Refresh the display immediately
     delay(2000); // Wait for 2 seconds to show the message
-    // Flush the screen to black before going to deep sleep
-    lv_obj_clean(lv_scr_act());
-    lv_obj_set_style_bg_color(lv_scr_act(), lv_color_black(), LV_PART_MAIN);
-    lv_refr_now(NULL); // Refresh the display immediately
+    sleepDisplay();
     esp_deep_sleep_start();
   }
+
+  unlockUI();
+  wakeUITask(UI_WAKE_DATA);
+
+  // Record the shot while the timer runs, saved to flash when it stops
+  if (timer_running != shot_recording)
+  {
+    shot_recording = timer_running;
+    if (shot_recording)
+      startShot();
+    else
+      endShot();
+  }
+  if (shot_recording)
+    sampleShot(currentWeight);
   
   // Process BLE tasks
   processBLE();
 
-  // LVGL task handler
-  lv_task_handler();
+  // Frame time histograms on request from the serial console
+  if (Serial.available() && Serial.read() == 's')
+  {
+    char text[512];
+    display_stats_format(text, sizeof(text));
+    Serial.print(text);
+  }
+
+  // Only paces sensor polling, the UI task runs LVGL when it is due
   delay(10);
 }
\ No newline at end of file
@@ -0,0 +1,211 @@
+#include "shot_log.h"
+#include "Arduino.h"
+#include "FS.h"
+#include "LittleFS.h"
+#include <time.h>
+
+#define SHOT_DIR      "/shots"
+#define SHOT_TMP      SHOT_DIR "/new.tmp"   // Written first, renamed when complete
+#define SHOT_MIN_FREE 16384                 // Bytes left to LittleFS for its metadata blocks
+
+static bool mounted = false;
+static ShotSample *samples = nullptr;       // SHOT_LOG_MAX_SAMPLES in PSRAM
+static uint16_t sample_count = 0;
+static bool recording = false;
+static uint32_t shot_start_ms = 0;
+static uint32_t shot_start_time = 0;
+static unsigned long last_sample = 0;
+static float last_weight = 0;
+static float flow = 0;                      // Smoothed g/s, like the shot chart
+static uint16_t next_id = 1;
+
+static void shotPath(uint16_t id, char *path, size_t size)
+{
+  snprintf(path, size, SHOT_DIR "/%05u.bin", id);
+}
+
+// Shot id from a file name, with or without the directory
+static bool parseId(const char *name, uint16_t *id)
+{
+  const char *base = strrchr(name, '/');
+  base = base ? base + 1 : name;
+  unsigned int n;
+  char ext[4];
+  if (sscanf(base, "%5u.%3s", &n, ext) != 2 || strcmp(ext, "bin") != 0 || n == 0 || n > UINT16_MAX)
+    return false;
+  *id = n;
+  return true;
+}
+
+// Ids of the saved shots, oldest first
+static size_t listIds(uint16_t *ids, size_t max)
+{
+  size_t count = 0;
+  File dir = LittleFS.open(SHOT_DIR);
+  if (!dir || !dir.isDirectory())
+    return 0;
+  for (File f = dir.openNextFile(); f && count < max; f = dir.openNextFile())
+  {
+    uint16_t id;
+    if (!parseId(f.name(), &id))
+      continue;
+    size_t i = count++;
+    for (; i > 0 && ids[i - 1] > id; i--) // Insertion sort, the directory is small
+      ids[i] = ids[i - 1];
+    ids[i] = id;
+  }
+  return count;
+}
+
+bool setupShotLog()
+{
+  if (!LittleFS.begin(true)) // Formats a blank or corrupt partition
+  {
+    Serial.println("LittleFS mount failed, shots are not saved");
+    return false;
+  }
+  LittleFS.mkdir(SHOT_DIR);
+  LittleFS.remove(SHOT_TMP); // Left by a power loss while saving
+
+  samples = (ShotSample *)ps_malloc(SHOT_LOG_MAX_SAMPLES * sizeof(ShotSample));
+  if (!samples)
+    return false;
+
+  uint16_t ids[SHOT_LOG_MAX * 2];
+  size_t count = listIds(ids, SHOT_LOG_MAX * 2);
+  next_id = count ? ids[count - 1] + 1 : 1;
+  mounted = true;
+  Serial.printf("Shot log: %u shots, %u of %u bytes used\n", count, LittleFS.usedBytes(), LittleFS.totalBytes());
+  return true;
+}
+
+void startShot()
+{
+  if (!mounted)
+    return;
+  recording = true;
+  sample_count = 0;
+  shot_start_ms = millis();
+  time_t now = time(NULL);
+  shot_start_time = now > 1600000000 ? now : 0; // Before 2020: the clock was never set
+  last_sample = 0;
+  flow = 0;
+}
+
+void sampleShot(float weight)
+{
+  unsigned long now = millis();
+  if (!recording || sample_count >= SHOT_LOG_MAX_SAMPLES || (sample_count && now - last_sample < SHOT_LOG_SAMPLE_MS))
+    return;
+
+  float dt = (now - last_sample) / 1000.0f;
+  if (sample_count && dt < 0.5f)
+    flow += 0.2f * ((weight - last_weight) / dt - flow);
+  else
+    flow = 0; // First sample
+  last_sample = now;
+  last_weight = weight;
+
+  samples[sample_count].weight = constrain(lroundf(weight * 10), INT16_MIN, INT16_MAX);
+  samples[sample_count].flow = constrain(lroundf(flow * 100), INT16_MIN, INT16_MAX);
+  sample_count++;
+}
+
+// Deletes the oldest shots until there is room for `bytes` more
+static void makeRoom(size_t bytes)
+{
+  uint16_t ids[SHOT_LOG_MAX * 2];
+  size_t count = listIds(ids, SHOT_LOG_MAX * 2);
+  for (size_t i = 0; i < count; i++)
+  {
+    if (count - i < SHOT_LOG_MAX && LittleFS.totalBytes() - LittleFS.usedBytes() >= bytes + SHOT_MIN_FREE)
+      break;
+    char path[24];
+    shotPath(ids[i], path, sizeof(path));
+    LittleFS.remove(path);
+  }
+}
+
+void endShot()
+{
+  if (!recording)
+    return;
+  recording = false;
+  if (sample_count < SHOT_LOG_MIN_SAMPLES)
+    return;
+
+  ShotHeader h;
+  h.magic = SHOT_LOG_MAGIC;
+  h.version = SHOT_LOG_VERSION;
+  h.sample_ms = SHOT_LOG_SAMPLE_MS;
+  h.id = next_id;
+  h.start_time = shot_start_time;
+  h.duration_ms = millis() - shot_start_ms;
+  h.samples = sample_count;
+  h.final_weight = samples[sample_count - 1].weight;
+  size_t size = sizeof(h) + sample_count * sizeof(ShotSample);
+  makeRoom(size);
+
+  // Readers only ever see complete files
+  File f = LittleFS.open(SHOT_TMP, "w");
+  bool ok = f && f.write((const uint8_t *)&h, sizeof(h)) == sizeof(h) &&
+            f.write((const uint8_t *)samples, sample_count * sizeof(ShotSample)) == sample_count * sizeof(ShotSample);
+  if (f)
+    f.close();
+  char path[24];
+  shotPath(h.id, path, sizeof(path));
+  if (!ok || !LittleFS.rename(SHOT_TMP, path))
+  {
+    LittleFS.remove(SHOT_TMP);
+    Serial.println("Saving the shot failed");
+    return;
+  }
+  next_id++;
+  Serial.printf("Shot %u saved: %u samples, %u bytes\n", h.id, h.samples, size);
+}
+
+size_t listShots(ShotInfo *out, size_t max)
+{
+  if (!mounted)
+    return 0;
+  uint16_t ids[SHOT_LOG_MAX * 2];
+  size_t count = listIds(ids, SHOT_LOG_MAX * 2);
+  size_t n = 0;
+  for (size_t i = 0; i < count && n < max; i++)
+  {
+    char path[24];
+    shotPath(ids[i], path, sizeof(path));
+    File f = LittleFS.open(path, "r");
+    ShotHeader h;
+    if (!f || f.read((uint8_t *)&h, sizeof(h)) != sizeof(h) || h.magic != SHOT_LOG_MAGIC)
+      continue;
+    out[n].id = h.id;
+    out[n].start_time = h.start_time;
+    out[n].duration_ms = h.duration_ms;
+    out[n].samples = h.samples;
+    out[n].size = f.size();
+    n++;
+  }
+  return n;
+}
+
+uint8_t *loadShot(uint16_t id, size_t *size)
+{
+  if (!mounted)
+    return nullptr;
+  char path[24];
+  shotPath(id, path, sizeof(path));
+  if (!LittleFS.exists(path))
+    return nullptr;
+  File f = LittleFS.open(path, "r");
+  if (!f)
+    return nullptr;
+  *size = f.size();
+  uint8_t *buf = (uint8_t *)ps_malloc(*size ? *size : 1);
+  if (buf && f.read(buf, *size) != *size)
+  {
+    free(buf);
+    buf = nullptr;
+  }
+  return buf;
+}
@@ -0,0 +1,136 @@
+#include "touch.h"
+#include "Arduino.h"
+#include "Wire.h"
+#include "lvgl.h"
+#include "pin_config.h"
+#include "ui_task.h"
+#define TOUCH_MODULES_CST_SELF
+#include "TouchLib.h"
+
+#define TOUCH_I2C_FREQ 400000   // Fast mode, a report is 5 bytes after the register address
+#define TOUCH_REPORT_LEN 5      // TOUCH_NUM_REG up to TOUCH1_YL_REG
+#define TOUCH_STALE_MS 250      // Reports come every ~10 ms while touched, a finger without them is gone
+#define TOUCH_QUEUE_LEN 16      // Reports waiting for loop()
+
+static EventGroupHandle_t touch_eg;
+#define GET_TOUCH_INT _BV(1)
+
+static TouchLib touch(Wire, PIN_IIC_SDA, PIN_IIC_SCL, CTS820_SLAVE_ADDRESS);
+
+static QueueHandle_t touch_queue;
+static portMUX_TYPE touch_mux = portMUX_INITIALIZER_UNLOCKED;
+static TouchPoint last_point = {0, 0, false, false, 0};
+
+static void IRAM_ATTR touchISR()
+{
+  BaseType_t woken = pdFALSE;
+  xEventGroupSetBitsFromISR(touch_eg, GET_TOUCH_INT, &woken);
+  wakeUITaskFromISR(UI_WAKE_TOUCH);
+  if (woken)
+    portYIELD_FROM_ISR();
+}
+
+// One burst from the touch count register through the first point
+static bool readReport(uint8_t report[TOUCH_REPORT_LEN])
+{
+  Wire.beginTransmission(CTS820_SLAVE_ADDRESS);
+  Wire.write(TOUCH_NUM_REG);
+  if (Wire.endTransmission(false) != 0)
+    return false;
+  return Wire.requestFrom((uint8_t)CTS820_SLAVE_ADDRESS, (uint8_t)TOUCH_REPORT_LEN) == TOUCH_REPORT_LEN &&
+         Wire.readBytes(report, TOUCH_REPORT_LEN) == TOUCH_REPORT_LEN;
+}
+
+// The panels are portrait, the screen is landscape with a black strip
+// between the two halves that is not part of the LVGL display
+static void decodeReport(const uint8_t report[TOUCH_REPORT_LEN], TouchPoint *p)
+{
+  uint16_t tx = ((report[1] & 0x0f) << 8) | report[2];
+  uint16_t ty = ((report[3] & 0x0f) << 8) | report[4];
+  p->pressed = (report[0] & 0x0f) > 0;
+  p->x = ty;
+  p->y = 126 - tx;
+  p->in_gap = p->x > 294 && p->x < 326;
+  if (p->x > 326)
+    p->x -= 32;
+  p->time = millis();
+}
+
+// Hands a report to both consumers: LVGL takes the latest point, loop()'s
+// gesture recognizer every report in order
+static void publish(const TouchPoint &p)
+{
+  portENTER_CRITICAL(&touch_mux);
+  last_point = p;
+  portEXIT_CRITICAL(&touch_mux);
+  xQueueSend(touch_queue, &p, 0); // Dropped if loop() is that far behind
+}
+
+bool readTouch()
+{
+  if (xEventGroupClearBits(touch_eg, GET_TOUCH_INT) & GET_TOUCH_INT)
+  {
+    uint8_t report[TOUCH_REPORT_LEN];
+    TouchPoint p = last_point;
+    if (readReport(report))
+    {
+      decodeReport(report, &p);
+      publish(p);
+    }
+  }
+  else if (last_point.pressed && millis() - last_point.time > TOUCH_STALE_MS)
+  {
+    // The release report was lost
+    TouchPoint p = last_point;
+    p.pressed = false;
+    p.time = millis();
+    publish(p);
+  }
+  return last_point.pressed;
+}
+
+TouchPoint getTouch()
+{
+  portENTER_CRITICAL(&touch_mux);
+  TouchPoint p = last_point;
+  portEXIT_CRITICAL(&touch_mux);
+  if (p.pressed && millis() - p.time > TOUCH_STALE_MS)
+    p.pressed = false;
+  return p;
+}
+
+bool nextTouch(TouchPoint *p)
+{
+  return xQueueReceive(touch_queue, p, 0) == pdTRUE;
+}
+
+static void lv_touchpad_read(lv_indev_drv_t *indev_driver, lv_indev_data_t *data)
+{
+  bool pressed = readTouch();
+  data->point.x = last_point.x;
+  data->point.y = last_point.y;
+  data->state = (pressed && !last_point.in_gap) ? LV_INDEV_STATE_PR : LV_INDEV_STATE_REL;
+
+  // The next report comes with an interrupt, no polling once the finger is up
+  if (!pressed)
+    lv_timer_pause(indev_driver->read_timer);
+}
+
+void setupTouch()
+{
+  touch_eg = xEventGroupCreate();
+  touch_queue = xQueueCreate(TOUCH_QUEUE_LEN, sizeof(TouchPoint));
+
+  Wire.begin(PIN_IIC_SDA, PIN_IIC_SCL);
+  touch.init();
+  Wire.setClock(TOUCH_I2C_FREQ);
+
+  static lv_indev_drv_t indev_drv;
+  lv_indev_drv_init(&indev_drv);
+  indev_drv.type = LV_INDEV_TYPE_POINTER;
+  indev_drv.read_cb = lv_touchpad_read;
+  lv_indev_drv_register(&indev_drv);
+
+  pinMode(PIN_TOUCH_INT, INPUT_PULLUP);
+  attachInterrupt(PIN_TOUCH_INT, touchISR, FALLING);
+}
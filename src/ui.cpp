@@ -0,0 +1,161 @@
+#include "ui.h"
+#include "Arduino.h"
+#include "display.h"
+#include "lvgl.h"
+#include "lv_numeric.h"
+#include "lv_shotchart.h"
+
+static lv_obj_t *label_weight = NULL;
+static lv_obj_t *label_timer = NULL;
+static lv_obj_t *chart_shot = NULL; // Weight and flow curve of the running shot
+
+// Weight readout. Samples arrive whenever loop() gets one from the HX711,
+// the readout moves on its own frame clock: an lv_anim runs the shown
+// value from where it is towards where the flow says the weight will be,
+// and is restarted by every sample. A steady reading is shown as is.
+#define WEIGHT_FRAME_MS   50    // 20 Hz readout while the weight moves
+#define WEIGHT_HORIZON_MS 500   // Longest extrapolation if samples stop coming
+#define WEIGHT_STABLE_GS  0.3f  // Slower flow (g/s) than this is noise, not a pour
+#define WEIGHT_SNAP_G     2.0f  // Bigger steps (tare, cup placed) are not animated
+
+static unsigned long weight_sample_time = 0;
+static float weight_sample = 0;
+static float weight_flow = 0;         // Smoothed g/s between samples
+static int32_t weight_shown = 0;      // Centigrams
+static int32_t weight_shown_tenths = INT32_MIN;
+
+// Shot chart sampling
+static unsigned long last_chart_sample = 0;
+static float chart_last_weight = 0;
+static float chart_flow = 0; // Smoothed flow in g/s
+
+void setupUI()
+{
+  // Set the background color to black
+  lv_obj_set_style_bg_color(lv_scr_act(), lv_color_black(), LV_PART_MAIN);
+
+  // Create a numeric display for the weight, only changed digits are redrawn
+  label_weight = lv_numeric_create(lv_scr_act());
+  lv_numeric_set_align(label_weight, LV_TEXT_ALIGN_RIGHT);
+  lv_numeric_set_font(label_weight, &lv_font_montserrat_48, "0123456789.- g", 8);
+  lv_obj_align(label_weight, LV_ALIGN_RIGHT_MID, -10, 0);
+
+  // Create a numeric display for the timer
+  label_timer = lv_numeric_create(lv_scr_act());
+  lv_numeric_set_align(label_timer, LV_TEXT_ALIGN_LEFT);
+  lv_numeric_set_font(label_timer, &lv_font_montserrat_48, "0123456789 s", 6);
+  lv_obj_align(label_timer, LV_ALIGN_LEFT_MID, 10, 0); // Align to the left
+
+  // Shot chart along the bottom of both panels, appending only redraws a few columns
+  chart_shot = lv_shotchart_create(lv_scr_act());
+  lv_obj_set_size(chart_shot, DISPLAY_HOR_RES - 20, 30);
+  lv_obj_align(chart_shot, LV_ALIGN_BOTTOM_MID, 0, -4);
+  lv_shotchart_set_series_count(chart_shot, 2);
+  lv_shotchart_set_series_color(chart_shot, 0, lv_palette_main(LV_PALETTE_BLUE)); // Weight
+  lv_shotchart_set_series_color(chart_shot, 1, lv_palette_main(LV_PALETTE_ORANGE)); // Flow
+  lv_shotchart_set_range(chart_shot, 0, 0, 400); // 0 - 40 g
+  lv_shotchart_set_range(chart_shot, 1, 0, 30); // 0 - 3 g/s
+}
+
+static void showWeight(int32_t centigrams)
+{
+  weight_shown = centigrams;
+  int32_t tenths = (centigrams + (centigrams < 0 ? -5 : 5)) / 10;
+  if (tenths == weight_shown_tenths)
+    return;
+  weight_shown_tenths = tenths;
+
+  char weight_str[16];
+  snprintf(weight_str, sizeof(weight_str), "%.1f g", tenths / 10.0f);
+  lv_numeric_set_text(label_weight, weight_str);
+}
+
+static void weightAnimExec(void *var, int32_t value)
+{
+  LV_UNUSED(var);
+  showWeight(value);
+}
+
+// Linear, but only steps on WEIGHT_FRAME_MS boundaries so the readout is
+// redrawn at a fixed rate however often the anim timer runs
+static int32_t weightAnimPath(const lv_anim_t *a)
+{
+  int32_t t = a->act_time - a->act_time % WEIGHT_FRAME_MS;
+  return a->start_value + (int64_t)(a->end_value - a->start_value) * t / a->time;
+}
+
+void updateUIWeight(float weight)
+{
+  unsigned long now = millis();
+  unsigned long dt = now - weight_sample_time;
+  if (dt == 0)
+    return;
+
+  float step = weight - weight_sample;
+  if (dt < WEIGHT_HORIZON_MS && fabsf(step) < WEIGHT_SNAP_G)
+    weight_flow += 0.3f * (step * 1000.0f / dt - weight_flow);
+  else
+    weight_flow = 0; // First sample after a pause or a jump
+  weight_sample_time = now;
+  weight_sample = weight;
+
+  int32_t target = lroundf(weight * 100);
+  if (fabsf(weight_flow) < WEIGHT_STABLE_GS)
+  {
+    lv_anim_del(label_weight, weightAnimExec);
+    showWeight(target);
+    return;
+  }
+
+  lv_anim_t a;
+  lv_anim_init(&a);
+  lv_anim_set_var(&a, label_weight);
+  lv_anim_set_exec_cb(&a, weightAnimExec);
+  lv_anim_set_path_cb(&a, weightAnimPath);
+  lv_anim_set_values(&a, weight_shown, target + lroundf(weight_flow * WEIGHT_HORIZON_MS / 10.0f));
+  lv_anim_set_time(&a, WEIGHT_HORIZON_MS);
+  lv_anim_start(&a);
+}
+
+void updateUITimer(int seconds)
+{
+  char timer_str[16];
+  snprintf(timer_str, sizeof(timer_str), "%d s", seconds);
+  lv_numeric_set_text(label_timer, timer_str);
+}
+
+// Adds a weight and flow point to the shot chart at 10 Hz
+void sampleUIChart(float weight)
+{
+  unsigned long now = millis();
+  if (now - last_chart_sample < 100)
+    return;
+
+  float dt = (now - last_chart_sample) / 1000.0f;
+  if (dt < 0.5f)
+    chart_flow += 0.2f * ((weight - chart_last_weight) / dt - chart_flow);
+  else
+    chart_flow = 0; // First sample after a pause
+  last_chart_sample = now;
+  chart_last_weight = weight;
+
+  int16_t values[2] = {
+    (int16_t)constrain(weight * 10, -32000, 32000), // 0.1 g
+    (int16_t)constrain(chart_flow * 10, -32000, 32000) // 0.1 g/s
+  };
+  lv_shotchart_append(chart_shot, values);
+}
+
+void clearUIChart()
+{
+  lv_shotchart_clear(chart_shot);
+}
+
+void showUILowBattery()
+{
+  lv_obj_add_flag(label_weight, LV_OBJ_FLAG_HIDDEN);
+  lv_obj_t *label_low = lv_label_create(lv_scr_act());
+  lv_obj_set_style_text_font(label_low, &lv_font_montserrat_28, LV_PART_MAIN);
+  lv_label_set_text(label_low, "Low battery");
+  lv_obj_align(label_low, LV_ALIGN_RIGHT_MID, -10, 0);
+}
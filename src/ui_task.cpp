@@ -0,0 +1,119 @@
+#include "ui_task.h"
+#include "Arduino.h"
+#include "display_power.h"
+#include "lvgl.h"
+#include "touch.h"
+
+#define UI_TASK_STACK    8192
+#define UI_TASK_PRIORITY 2    // Above loop() so a wakeup is served right away
+#define UI_TASK_CORE     1
+
+static TaskHandle_t ui_task = NULL;
+static SemaphoreHandle_t ui_mutex = NULL;
+
+// Runs LVGL's timers and returns how long until one is due again. The
+// refresh timer only runs while something is invalidated.
+static uint32_t runLVGL()
+{
+  lv_disp_t *disp = lv_disp_get_default();
+  uint32_t wait_ms = lv_timer_handler();
+  if (disp->inv_p == 0)
+  {
+    lv_timer_pause(disp->refr_timer);
+    return wait_ms;
+  }
+
+  // Invalidated after the refresh ran, e.g. by an animation
+  lv_timer_resume(disp->refr_timer);
+  return min(wait_ms, (uint32_t)LV_DISP_DEF_REFR_PERIOD);
+}
+
+static void handleWake(uint32_t reasons)
+{
+  if (reasons & UI_WAKE_DATA)
+  {
+    lv_disp_t *disp = lv_disp_get_default();
+    if (disp->inv_p != 0)
+    {
+      lv_timer_resume(disp->refr_timer);
+      lv_timer_ready(disp->refr_timer);
+    }
+  }
+  if (reasons & UI_WAKE_TOUCH)
+  {
+    // LVGL isn't run while the panels sleep, the touch that wakes them is read here
+    if (!isDisplayAwake())
+      readTouch();
+    for (lv_indev_t *indev = lv_indev_get_next(NULL); indev; indev = lv_indev_get_next(indev))
+    {
+      lv_timer_resume(indev->driver->read_timer);
+      lv_timer_ready(indev->driver->read_timer);
+    }
+  }
+}
+
+static void uiTask(void *parameter)
+{
+  for (;;)
+  {
+    // Refresh is stopped while the panels sleep, wakeDisplay() is followed by a wakeup
+    TickType_t wait = portMAX_DELAY;
+    lockUI();
+    if (isDisplayAwake())
+    {
+      uint32_t wait_ms = runLVGL();
+      if (wait_ms != LV_NO_TIMER_READY)
+        wait = max(pdMS_TO_TICKS(wait_ms), (TickType_t)1);
+    }
+    unlockUI();
+
+    uint32_t reasons = 0;
+    if (xTaskNotifyWait(0, UINT32_MAX, &reasons, wait) == pdTRUE)
+    {
+      lockUI();
+      handleWake(reasons);
+      unlockUI();
+    }
+  }
+}
+
+void startUITask()
+{
+  ui_mutex = xSemaphoreCreateRecursiveMutex();
+  xTaskCreatePinnedToCore(
+    uiTask, // Function to run on this task
+    "ui", // Task name
+    UI_TASK_STACK, // Stack size
+    NULL, // Task parameter
+    UI_TASK_PRIORITY, // Task priority
+    &ui_task, // Task handle
+    UI_TASK_CORE // Task core
+  );
+}
+
+void wakeUITask(uint32_t reason)
+{
+  if (ui_task)
+    xTaskNotify(ui_task, reason, eSetBits);
+}
+
+void IRAM_ATTR wakeUITaskFromISR(uint32_t reason)
+{
+  BaseType_t woken = pdFALSE;
+  if (ui_task)
+    xTaskNotifyFromISR(ui_task, reason, eSetBits, &woken);
+  if (woken)
+    portYIELD_FROM_ISR();
+}
+
+void lockUI()
+{
+  if (ui_mutex)
+    xSemaphoreTakeRecursive(ui_mutex, portMAX_DELAY);
+}
+
+void unlockUI()
+{
+  if (ui_mutex)
+    xSemaphoreGiveRecursive(ui_mutex);
+}